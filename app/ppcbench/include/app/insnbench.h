@@ -0,0 +1,83 @@
+#pragma once
+
+#include <stdint.h>
+#include <sys/types.h>
+
+// instruction cost chains for `insnbench`, shared with the unit test that checks what they compute
+// latency: LAT_REPT copies of the op, each reading the result of the one before
+// throughput: TPUT_REPT rounds of CHAINS independent chains, enough to cover the multiply latency
+
+#define LAT_REPT   64
+#define TPUT_REPT  16
+#define CHAINS     6
+
+#define INSN_STR_(x) #x
+#define INSN_STR(x) INSN_STR_(x)
+
+#define INSN_CLOBBERS "cr0", "cr1", "cr2", "cr3", "cr4", "cr5", "cr6", "cr7", "xer"
+
+typedef uint64_t (*chain_fn)(uint iters, uint64_t a, uint64_t s);
+
+// I(d, s, cr) is the op with destination/first source d, second source s and compare field cr
+// d is "b", addi and addis read an ra of r0 as 0, which would cut the chain
+#define CHAIN(name, I) \
+  static uint64_t name##_lat(uint iters, uint64_t a, uint64_t s) { \
+    for (uint i = 0; i < iters; i++) { \
+      __asm__ volatile(".rept " INSN_STR(LAT_REPT) "\n" I("%0", "%1", "0") ".endr" \
+                       : "+b"(a) : "r"(s) : INSN_CLOBBERS); \
+    } \
+    return a; \
+  } \
+  static uint64_t name##_tput(uint iters, uint64_t a, uint64_t s) { \
+    uint64_t b = a + 1, c = a + 2, d = a + 3, e = a + 4, f = a + 5; \
+    for (uint i = 0; i < iters; i++) { \
+      __asm__ volatile(".rept " INSN_STR(TPUT_REPT) "\n" \
+                       I("%0", "%6", "0") I("%1", "%6", "1") I("%2", "%6", "2") \
+                       I("%3", "%6", "3") I("%4", "%6", "4") I("%5", "%6", "5") ".endr" \
+                       : "+b"(a), "+b"(b), "+b"(c), "+b"(d), "+b"(e), "+b"(f) : "r"(s) : INSN_CLOBBERS); \
+    } \
+    return a ^ b ^ c ^ d ^ e ^ f; \
+  }
+
+// alu
+#define I_ADD(d, s, cr)      "add " d "," d "," s "\n"
+#define I_ADD_RC(d, s, cr)   "add. " d "," d "," s "\n"
+#define I_ADDI(d, s, cr)     "addi " d "," d ",1\n"
+#define I_ADDC(d, s, cr)     "addc " d "," d "," s "\n"
+#define I_ADDE(d, s, cr)     "adde " d "," d "," s "\n"
+#define I_SUBF(d, s, cr)     "subf " d "," s "," d "\n"
+#define I_NEG(d, s, cr)      "neg " d "," d "\n"
+#define I_MULLI(d, s, cr)    "mulli " d "," d ",3\n"
+#define I_MULLW(d, s, cr)    "mullw " d "," d "," s "\n"
+#define I_MULLD(d, s, cr)    "mulld " d "," d "," s "\n"
+#define I_MULHD(d, s, cr)    "mulhd " d "," d "," s "\n"
+#define I_DIVW(d, s, cr)     "divw " d "," d "," s "\n"
+#define I_DIVD(d, s, cr)     "divd " d "," d "," s "\n"
+// cmp
+#define I_CMPD(d, s, cr)     "cmpd " cr "," d "," s "\n"
+#define I_CMPLD(d, s, cr)    "cmpld " cr "," d "," s "\n"
+#define I_CMPDI(d, s, cr)    "cmpdi " cr "," d ",0\n"
+// logical
+#define I_AND(d, s, cr)      "and " d "," d "," s "\n"
+#define I_AND_RC(d, s, cr)   "and. " d "," d "," s "\n"
+#define I_ANDI_RC(d, s, cr)  "andi. " d "," d ",0x7fff\n"
+#define I_OR(d, s, cr)       "or " d "," d "," s "\n"
+#define I_XOR(d, s, cr)      "xor " d "," d "," s "\n"
+#define I_NAND(d, s, cr)     "nand " d "," d "," s "\n"
+#define I_CNTLZD(d, s, cr)   "cntlzd " d "," d "\n"
+#define I_EXTSW(d, s, cr)    "extsw " d "," d "\n"
+// rotate, rldicl ...,60,8 is (x >> 4) & 0x00ffffffffffffff in one op, SRDI_AND the same in two
+#define I_RLDICL(d, s, cr)   "rldicl " d "," d ",60,8\n"
+#define I_RLDICL_RC(d, s, cr) "rldicl. " d "," d ",60,8\n"
+#define I_SRDI_AND(d, s, cr) "srdi " d "," d ",4\n" "and " d "," d "," s "\n"
+#define I_RLWINM(d, s, cr)   "rlwinm " d "," d ",4,8,27\n"
+#define I_RLDIMI(d, s, cr)   "rldimi " d "," s ",8,48\n"
+#define I_RLDCL(d, s, cr)    "rldcl " d "," d "," s ",0\n"
+// shift
+#define I_SLD(d, s, cr)      "sld " d "," d "," s "\n"
+#define I_SRD(d, s, cr)      "srd " d "," d "," s "\n"
+#define I_SRAD(d, s, cr)     "srad " d "," d "," s "\n"
+#define I_SRADI(d, s, cr)    "sradi " d "," d ",1\n"
+#define I_SLW(d, s, cr)      "slw " d "," d "," s "\n"
+#define I_SRAW(d, s, cr)     "sraw " d "," d "," s "\n"
+#define I_SRAWI(d, s, cr)    "srawi " d "," d ",1\n"
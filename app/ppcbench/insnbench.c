@@ -0,0 +1,132 @@
+#include <app/insnbench.h>
+#include <arch/cpu_regs.h>
+#include <arch/ops.h>
+#include <arch/ppc64.h>
+#include <arch/ticks.h>
+#include <lk/console_cmd.h>
+#include <lk/err.h>
+#include <lk/macros.h>
+#include <stdio.h>
+#include <stdint.h>
+
+// each row is one instruction (or sequence), per op in picoseconds and in core cycles, cycles are
+// timebase ticks times ppc64_cycles_per_tb, only meaningful where the platform knows that ratio
+// the chains themselves are in app/insnbench.h
+// record forms and compares in the throughput chains all write cr0 (compares cr0..cr5), the loop
+// around each block adds a few instructions per 64 or 96 ops
+// every measurement runs with interrupts off and the best of RUNS is kept
+
+#define RUNS       5
+#define ITERS      20000
+
+CHAIN(add, I_ADD)
+CHAIN(add_rc, I_ADD_RC)
+CHAIN(addi, I_ADDI)
+CHAIN(addc, I_ADDC)
+CHAIN(adde, I_ADDE)
+CHAIN(subf, I_SUBF)
+CHAIN(neg, I_NEG)
+CHAIN(mulli, I_MULLI)
+CHAIN(mullw, I_MULLW)
+CHAIN(mulld, I_MULLD)
+CHAIN(mulhd, I_MULHD)
+CHAIN(divw, I_DIVW)
+CHAIN(divd, I_DIVD)
+CHAIN(cmpd, I_CMPD)
+CHAIN(cmpld, I_CMPLD)
+CHAIN(cmpdi, I_CMPDI)
+CHAIN(and, I_AND)
+CHAIN(and_rc, I_AND_RC)
+CHAIN(andi_rc, I_ANDI_RC)
+CHAIN(or, I_OR)
+CHAIN(xor, I_XOR)
+CHAIN(nand, I_NAND)
+CHAIN(cntlzd, I_CNTLZD)
+CHAIN(extsw, I_EXTSW)
+CHAIN(rldicl, I_RLDICL)
+CHAIN(rldicl_rc, I_RLDICL_RC)
+CHAIN(srdi_and, I_SRDI_AND)
+CHAIN(rlwinm, I_RLWINM)
+CHAIN(rldimi, I_RLDIMI)
+CHAIN(rldcl, I_RLDCL)
+CHAIN(sld, I_SLD)
+CHAIN(srd, I_SRD)
+CHAIN(srad, I_SRAD)
+CHAIN(sradi, I_SRADI)
+CHAIN(slw, I_SLW)
+CHAIN(sraw, I_SRAW)
+CHAIN(srawi, I_SRAWI)
+
+struct insn_bench {
+  const char *group;
+  const char *name;
+  chain_fn lat;               // NULL where a chain has nothing to depend on, compares write only a cr field
+  chain_fn tput;
+  uint64_t s;                 // the second source, 1 keeps multiplies and divides from collapsing to 0
+};
+
+#define BOTH(group, name, s) { group, #name, name##_lat, name##_tput, s }
+#define TPUT(group, name, s) { group, #name, NULL, name##_tput, s }
+
+#define MASK56 0x00ffffffffffffffULL
+
+static const struct insn_bench benches[] = {
+  BOTH("alu", add, 1), BOTH("alu", add_rc, 1), BOTH("alu", addi, 1), BOTH("alu", addc, 1),
+  BOTH("alu", adde, 1), BOTH("alu", subf, 1), BOTH("alu", neg, 1), BOTH("alu", mulli, 1),
+  BOTH("alu", mullw, 1), BOTH("alu", mulld, 1), BOTH("alu", mulhd, 1), BOTH("alu", divw, 1),
+  BOTH("alu", divd, 1),
+  TPUT("cmp", cmpd, 1), TPUT("cmp", cmpld, 1), TPUT("cmp", cmpdi, 1),
+  BOTH("logical", and, ~0ULL), BOTH("logical", and_rc, ~0ULL), BOTH("logical", andi_rc, 0),
+  BOTH("logical", or, 1), BOTH("logical", xor, 1), BOTH("logical", nand, 1), BOTH("logical", cntlzd, 0),
+  BOTH("logical", extsw, 0),
+  BOTH("rotate", rldicl, 0), BOTH("rotate", rldicl_rc, 0), BOTH("rotate", srdi_and, MASK56),
+  BOTH("rotate", rlwinm, 0), BOTH("rotate", rldimi, 0x5a), BOTH("rotate", rldcl, 3),
+  BOTH("shift", sld, 1), BOTH("shift", srd, 1), BOTH("shift", srad, 1), BOTH("shift", sradi, 0),
+  BOTH("shift", slw, 1), BOTH("shift", sraw, 1), BOTH("shift", srawi, 0),
+};
+
+static volatile uint64_t sink;
+
+static lk_ticks_t best_of(chain_fn fn, uint iters, uint64_t s) {
+  lk_ticks_t best = UINT64_MAX;
+  for (uint r = 0; r < RUNS; r++) {
+    arch_disable_ints();
+    lk_ticks_t start = lk_ticks();
+    sink = fn(iters, 0x0123456789abcdefULL, s);
+    lk_ticks_t t = lk_ticks() - start;
+    arch_enable_ints();
+    if (t < best) best = t;
+  }
+  return best;
+}
+
+static void print_cost(lk_ticks_t ticks, uint64_t ops) {
+  uint64_t ps = lk_ticks_to_ns(ticks) * 1000 / ops;
+  uint64_t cyc100 = ticks * ppc64_cycles_per_tb * 100 / ops;
+  printf(" %8llu %5llu.%02llu", ps, cyc100 / 100, cyc100 % 100);
+}
+
+static int cmd_insnbench(int argc, const console_cmd_args *argv) {
+  uint iters = argc > 1 ? argv[1].u : ITERS;
+  if (!iters) return ERR_INVALID_ARGS;
+
+  printf("# insnbench tb_hz %llu cycles_per_tb %u pvr %#llx iters %u\n", lk_ticks_freq(), ppc64_cycles_per_tb,
+         pvr_read(), iters);
+  printf("# %-8s %-10s %8s %8s %8s %8s\n", "group", "insn", "lat_ps", "lat_cyc", "tput_ps", "tput_cyc");
+  for (uint i = 0; i < countof(benches); i++) {
+    const struct insn_bench *b = &benches[i];
+    printf("%-10s %-10s", b->group, b->name);
+    if (b->lat) {
+      print_cost(best_of(b->lat, iters, b->s), (uint64_t)iters * LAT_REPT);
+    } else {
+      printf(" %8s %8s", "-", "-");
+    }
+    print_cost(best_of(b->tput, iters, b->s), (uint64_t)iters * TPUT_REPT * CHAINS);
+    printf("\n");
+  }
+  return 0;
+}
+
+STATIC_COMMAND_START
+STATIC_COMMAND("insnbench", "instruction latency and throughput [iterations]", &cmd_insnbench)
+STATIC_COMMAND_END(insnbench);
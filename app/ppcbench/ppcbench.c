@@ -0,0 +1,238 @@
+#include <arch/cpu_regs.h>
+#include <arch/hypercalls.h>
+#include <arch/ops.h>
+#include <arch/ppc64.h>
+#include <arch/ticks.h>
+#include <kernel/event.h>
+#include <kernel/mutex.h>
+#include <kernel/spinlock.h>
+#include <kernel/thread.h>
+#include <kernel/timer.h>
+#include <lk/console_cmd.h>
+#include <lk/err.h>
+#include <lk/macros.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// os primitive costs in timebase ticks, min/median/p99 over many samples, printed one row per
+// measurement so two runs can be diffed, `# ` lines are comments, the rest is
+//   name batch samples min median p99
+// a batched row times `batch` operations per sample and divides, for things close to the timebase resolution
+// the thread benchmarks pin everything to the calling cpu, the handoffs wake a thread one priority above
+// the caller, so it runs the moment it is woken and the sample is just the wakeup
+
+#define MAX_SAMPLES 4096
+#define BATCH       16
+
+static lk_ticks_t samples[MAX_SAMPLES];
+
+static int compare_ticks(const void *a, const void *b) {
+  lk_ticks_t x = *(const lk_ticks_t *)a, y = *(const lk_ticks_t *)b;
+  return x < y ? -1 : x > y;
+}
+
+static void report(const char *name, uint batch, uint n) {
+  qsort(samples, n, sizeof(samples[0]), compare_ticks);
+  uint p99 = MIN(n * 99 / 100, n - 1);
+  printf("%-22s %5u %7u %8llu %8llu %8llu\n", name, batch, n, samples[0] / batch, samples[n / 2] / batch,
+         samples[p99] / batch);
+}
+
+// the worker side of the thread benchmarks
+static struct {
+  volatile bool stop;
+  volatile lk_ticks_t woke;
+  event_t go;
+  mutex_t lock;
+} peer;
+
+static thread_t *start_peer(const char *name, thread_start_routine entry, int priority) {
+  peer.stop = false;
+  thread_t *t = thread_create(name, entry, NULL, priority, DEFAULT_STACK_SIZE);
+  if (!t) return NULL;
+  thread_set_pinned_cpu(t, arch_curr_cpu_num());
+  thread_resume(t);
+  return t;
+}
+
+static int yield_peer(void *arg) {
+  while (!peer.stop) thread_yield();
+  return 0;
+}
+
+// two threads of the same priority taking turns, one sample is a switch away and one back
+static void bench_yield(uint n) {
+  thread_t *t = start_peer("bench yield", yield_peer, get_current_thread()->priority);
+  if (!t) return;
+  thread_yield();
+  for (uint i = 0; i < n; i++) {
+    lk_ticks_t start = lk_ticks();
+    thread_yield();
+    samples[i] = lk_ticks() - start;
+  }
+  peer.stop = true;
+  thread_join(t, NULL, INFINITE_TIME);
+  report("yield_roundtrip", 1, n);
+}
+
+static int event_peer(void *arg) {
+  for (;;) {
+    event_wait(&peer.go);
+    if (peer.stop) return 0;
+    peer.woke = lk_ticks();
+  }
+}
+
+static void bench_event(uint n) {
+  event_init(&peer.go, false, EVENT_FLAG_AUTOUNSIGNAL);
+  thread_t *t = start_peer("bench event", event_peer, get_current_thread()->priority + 1);
+  if (!t) return;
+  for (uint i = 0; i < n; i++) {
+    lk_ticks_t start = lk_ticks();
+    event_signal(&peer.go, true);
+    samples[i] = peer.woke - start;
+  }
+  peer.stop = true;
+  event_signal(&peer.go, true);
+  thread_join(t, NULL, INFINITE_TIME);
+  event_destroy(&peer.go);
+  report("event_handoff", 1, n);
+}
+
+// blocks on the mutex the caller holds, takes the time once it has it and hands it straight back
+static int mutex_peer(void *arg) {
+  for (;;) {
+    event_wait(&peer.go);
+    if (peer.stop) return 0;
+    mutex_acquire(&peer.lock);
+    peer.woke = lk_ticks();
+    mutex_release(&peer.lock);
+  }
+}
+
+static void bench_mutex(uint n) {
+  event_init(&peer.go, false, EVENT_FLAG_AUTOUNSIGNAL);
+  mutex_init(&peer.lock);
+  thread_t *t = start_peer("bench mutex", mutex_peer, get_current_thread()->priority + 1);
+  if (!t) return;
+  for (uint i = 0; i < n; i++) {
+    mutex_acquire(&peer.lock);
+    event_signal(&peer.go, true);  // the peer runs until it blocks on the mutex
+    lk_ticks_t start = lk_ticks();
+    mutex_release(&peer.lock);
+    samples[i] = peer.woke - start;
+  }
+  peer.stop = true;
+  event_signal(&peer.go, true);
+  thread_join(t, NULL, INFINITE_TIME);
+  mutex_destroy(&peer.lock);
+  event_destroy(&peer.go);
+  report("mutex_handoff", 1, n);
+}
+
+static void bench_spinlock(uint n) {
+  spin_lock_t lock = SPIN_LOCK_INITIAL_VALUE;
+  for (uint i = 0; i < n; i++) {
+    lk_ticks_t start = lk_ticks();
+    for (uint j = 0; j < BATCH; j++) {
+      spin_lock_saved_state_t state;
+      spin_lock_irqsave(&lock, state);
+      spin_unlock_irqrestore(&lock, state);
+    }
+    samples[i] = lk_ticks() - start;
+  }
+  report("spin_lock_irqsave", BATCH, n);
+
+  for (uint i = 0; i < n; i++) {
+    arch_disable_ints();
+    lk_ticks_t start = lk_ticks();
+    for (uint j = 0; j < BATCH; j++) {
+      spin_lock(&lock);
+      spin_unlock(&lock);
+    }
+    samples[i] = lk_ticks() - start;
+    arch_enable_ints();
+  }
+  report("spin_lock", BATCH, n);
+}
+
+// re-setting the cppr xics_init_percpu() left, about the least work an hcall can do
+// with MSR[HV] set there is no hypervisor to call, as on xenon
+static void bench_hcall(uint n) {
+  if (mfmsr() & MSR_HV) {
+    printf("# hcall_roundtrip skipped, running as the hypervisor\n");
+    return;
+  }
+  for (uint i = 0; i < n; i++) {
+    lk_ticks_t start = lk_ticks();
+    do_hypercall4(H_CPPR, 0xff, 0, 0, 0);
+    samples[i] = lk_ticks() - start;
+  }
+  report("hcall_roundtrip", 1, n);
+}
+
+static enum handler_return timer_fired(timer_t *t, lk_time_t now, void *arg) {
+  peer.woke = lk_ticks();
+  event_signal(&peer.go, false);
+  return INT_RESCHEDULE;
+}
+
+// how long after its deadline a 1ms oneshot runs its callback, each sample costs a millisecond
+static void bench_timer(uint n) {
+  timer_t timer;
+  timer_initialize(&timer);
+  event_init(&peer.go, false, EVENT_FLAG_AUTOUNSIGNAL);
+  lk_ticks_t delay = lk_ticks_freq() / 1000;
+  for (uint i = 0; i < n; i++) {
+    lk_ticks_t start = lk_ticks();
+    timer_set_oneshot(&timer, 1, timer_fired, NULL);
+    event_wait(&peer.go);
+    lk_ticks_t late = peer.woke - start;
+    samples[i] = late > delay ? late - delay : 0;
+  }
+  event_destroy(&peer.go);
+  report("timer_late_1ms", 1, n);
+}
+
+static void bench_malloc(uint n, size_t size, const char *name) {
+  void *p[BATCH];
+  for (uint i = 0; i < n; i++) {
+    lk_ticks_t start = lk_ticks();
+    for (uint j = 0; j < BATCH; j++) p[j] = malloc(size);
+    for (uint j = 0; j < BATCH; j++) free(p[j]);
+    samples[i] = lk_ticks() - start;
+  }
+  report(name, BATCH, n);
+}
+
+static int cmd_ppcbench(int argc, const console_cmd_args *argv) {
+  uint n = argc > 1 ? argv[1].u : 1000;
+  if (n == 0 || n > MAX_SAMPLES) {
+    printf("samples between 1 and %u\n", MAX_SAMPLES);
+    return ERR_INVALID_ARGS;
+  }
+
+  // everything below runs on this cpu
+  thread_t *self = get_current_thread();
+  int pinned = self->pinned_cpu;
+  thread_set_pinned_cpu(self, arch_curr_cpu_num());
+
+  printf("# ppcbench tb_hz %llu pvr %#llx cpu %u\n", lk_ticks_freq(), pvr_read(), arch_curr_cpu_num());
+  printf("# %-20s %5s %7s %8s %8s %8s\n", "name", "batch", "samples", "min", "median", "p99");
+  bench_yield(n);
+  bench_event(n);
+  bench_mutex(n);
+  bench_spinlock(n);
+  bench_hcall(n);
+  bench_timer(MAX(n / 10, 1u));
+  bench_malloc(n, 64, "malloc_free_64");
+  bench_malloc(n, 4096, "malloc_free_4096");
+
+  thread_set_pinned_cpu(self, pinned);
+  return 0;
+}
+
+STATIC_COMMAND_START
+STATIC_COMMAND("ppcbench", "os primitive latencies in timebase ticks [samples]", &cmd_ppcbench)
+STATIC_COMMAND_END(ppcbench);
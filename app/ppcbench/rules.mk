@@ -0,0 +1,8 @@
+LOCAL_DIR := $(GET_LOCAL_DIR)
+
+MODULE := $(LOCAL_DIR)
+
+MODULE_SRCS += $(LOCAL_DIR)/insnbench.c
+MODULE_SRCS += $(LOCAL_DIR)/ppcbench.c
+
+include make/module.mk
@@ -1,27 +1,171 @@
 #include <arch.h>
+#include <arch/hpt.h>
+#include <arch/ops.h>
+#include <arch/pmu.h>
+#include <arch/ppc64.h>
+#include <kernel/thread.h>
+#include <lk/console_cmd.h>
 #include <lk/debug.h>
+#include <lk/err.h>
+#include <lk/macros.h>
+#include <lk/main.h>
+#include <platform.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <target.h>
 
-void __WEAK arch_idle(void) {
-    asm volatile("nop");
+size_t ppc64_dcbz_size;
+
+static void zero_range(uint8_t *p, uint8_t *end) {
+  for (; p < end && ((uintptr_t)p & 7); p++) *p = 0;
+  for (; p + 8 <= end; p += 8) *(uint64_t *)p = 0;
+  for (; p < end; p++) *p = 0;
 }
 
+// the first thing _start calls, nothing in bss may be written before the very end
+// dcbz zeroes a whole block without reading it from memory, 32 bytes on a 970 unless HID5 widens it
+// and a 128 byte line on xenon, so the size is measured on bss itself: ones in, one dcbz, count the zeroes
 void clear_bss(void) {
   extern uint8_t __bss_start, __bss_end;
-  for (uint8_t *t = &__bss_start; t < &__bss_end; t++) {
-    *t = 0;
+  uint8_t *p = &__bss_start, *end = &__bss_end;
+  uint64_t *probe = (uint64_t *)ROUNDUP((uintptr_t)p, 256);
+  size_t block = 0;
+  if ((uint8_t *)probe + 256 <= end) {
+    for (uint i = 0; i < 32; i++) probe[i] = ~0ULL;
+    __asm__ volatile("dcbz 0, %0" : : "r"(probe) : "memory");
+    while (block < 256 && probe[block / 8] == 0) block += 8;
+    if (block < 32 || (block & (block - 1))) block = 0;
+  }
+  if (!block) {
+    zero_range(p, end);
+    return;
   }
+
+  uint8_t *lo = (uint8_t *)ROUNDUP((uintptr_t)p, block);
+  uint8_t *hi = (uint8_t *)ROUNDDOWN((uintptr_t)end, block);
+  zero_range(p, lo);
+  for (uint8_t *b = lo; b < hi; b += block) {
+    __asm__ volatile("dcbz 0, %0" : : "r"(b) : "memory");
+  }
+  zero_range(hi, end);
+  ppc64_dcbz_size = block;
 }
 
 void arch_early_init(void) {
+  ppc64_cache_init();
+  ppc64_timer_init_percpu();
+  ppc64_exceptions_init();
+  ppc64_fpu_init_percpu();
 }
 
 void arch_init(void) {
+  ppc64_pmu_init();
+  ppc64_idle_init();
+  ppc64_mp_init();
+}
+
+STATIC_ASSERT(offsetof(struct ppc64_chain_params, go) == CHAIN_GO);
+STATIC_ASSERT(offsetof(struct ppc64_chain_params, dest) == CHAIN_DEST);
+STATIC_ASSERT(offsetof(struct ppc64_chain_params, src) == CHAIN_SRC);
+STATIC_ASSERT(offsetof(struct ppc64_chain_params, len) == CHAIN_LEN);
+STATIC_ASSERT(offsetof(struct ppc64_chain_params, entry) == CHAIN_ENTRY);
+STATIC_ASSERT(offsetof(struct ppc64_chain_params, block) == CHAIN_BLOCK);
+STATIC_ASSERT(sizeof(struct ppc64_chain_params) == CHAIN_PARAMS_SIZE);
+
+extern uint8_t ppc64_chain_tramp_start[], ppc64_chain_tramp_params[], ppc64_chain_tramp_end[];
+
+// pages the heap gives back until one is clear of both ranges, the ones that were not are kept until then
+#define CHAIN_TRAMP_TRIES 8
+
+static bool overlaps(uint64_t a, uint64_t alen, uint64_t b, uint64_t blen) {
+  return a < b + blen && b < a + alen;
+}
+
+static void *chain_tramp_alloc(uint64_t src, uint64_t dest, uint64_t len) {
+  size_t size = ppc64_chain_tramp_end - ppc64_chain_tramp_start;
+  void *tries[CHAIN_TRAMP_TRIES];
+  void *found = NULL;
+  uint n = 0;
+  while (!found && n < CHAIN_TRAMP_TRIES) {
+    void *p = memalign(PAGE_SIZE, size);
+    if (!p) break;
+    uint64_t pa = (uintptr_t)p & ~PPC64_LINEAR_BASE;
+    if (overlaps(pa, size, src, len) || overlaps(pa, size, dest, len)) {
+      tries[n++] = p;
+    } else {
+      found = p;
+    }
+  }
+  while (n) free(tries[--n]);
+  return found;
+}
+
+status_t ppc64_chain_load(const void *image, size_t len, uint64_t load, uint64_t entry,
+                          ulong arg0, ulong arg1, ulong arg2, ulong arg3) {
+  uint64_t src = (uintptr_t)image & ~PPC64_LINEAR_BASE;
+  len = ROUNDUP(len, 8);
+  dprintf(INFO, "chain load: 0x%zx bytes from 0x%llx to 0x%llx, entry 0x%llx, args 0x%lx 0x%lx 0x%lx 0x%lx\n",
+          len, src, load, entry, arg0, arg1, arg2, arg3);
+
+  // the image may land on top of this kernel, so the copy runs from a page clear of both
+  uint8_t *tramp = chain_tramp_alloc(src, load, len);
+  if (!tramp) return ERR_NO_MEMORY;
+  size_t size = ppc64_chain_tramp_end - ppc64_chain_tramp_start;
+  memcpy(tramp, ppc64_chain_tramp_start, size);
+  struct ppc64_chain_params *params =
+      (struct ppc64_chain_params *)(tramp + (ppc64_chain_tramp_params - ppc64_chain_tramp_start));
+  *params = (struct ppc64_chain_params){
+    .dest = load,
+    .src = src,
+    .len = len,
+    .entry = entry,
+    .block = MIN(ppc64_dcache_block, ppc64_icache_block),
+  };
+  arch_sync_cache_range((addr_t)tramp, size);
+  uint64_t tramp_pa = (uintptr_t)tramp & ~PPC64_LINEAR_BASE;
+
+  // the new image treats whichever cpu enters _start as its boot cpu, it has to be the one firmware booted
+  thread_t *t = get_current_thread();
+  thread_set_pinned_cpu(t, 0);
+  while (arch_curr_cpu_num() != 0) thread_yield();
+
+  arch_disable_ints();
+  target_quiesce();
+  platform_quiesce();
+  // to the trampoline's hold, not the image's, which is not there yet
+  if (!ppc64_mp_park_secondaries(tramp_pa)) dprintf(ALWAYS, "chain load: going ahead without every cpu parked\n");
+
+  ppc64_mmu_quiesce();
+  ppc64_chain_enter(tramp_pa, arg0, arg1, arg2, arg3);
 }
 
+// the image must already be in place and synced to the icache (arch_sync_cache_range)
 void arch_chain_load(void *entry, ulong arg0, ulong arg1, ulong arg2, ulong arg3) {
-  panic("unimplemented");
+  uint64_t pa = (uintptr_t)entry & ~PPC64_LINEAR_BASE;
+  ppc64_chain_load(entry, 0, pa, pa, arg0, arg1, arg2, arg3);
+  panic("chain load: no page for the trampoline\n");
 }
 
-void arch_clean_cache_range(addr_t start, size_t len) {
-  //PANIC_UNIMPLEMENTED;
+// every build links at the same address (16M, stage1.ld), so a new one is staged elsewhere and given <load>
+static int cmd_chain(int argc, const console_cmd_args *argv) {
+  if (argc < 3) {
+    printf("usage: %s <image> <length> [load r3 r4 r5 r6]\n", argv[0].str);
+    printf("copies the image staged at <image> to real address <load> and starts it there, in place without <load>\n");
+    printf("r3-r6 default to the boot args of this kernel\n");
+    return ERR_INVALID_ARGS;
+  }
+  const void *image = (const void *)argv[1].u;
+  size_t len = argv[2].u;
+  uint64_t load = argc > 3 ? argv[3].u : ((uintptr_t)image & ~PPC64_LINEAR_BASE);
+  ulong args[4];
+  for (uint i = 0; i < 4; i++) args[i] = (int)(4 + i) < argc ? argv[4 + i].u : lk_boot_args[i];
+  status_t err = ppc64_chain_load(image, len, load, load, args[0], args[1], args[2], args[3]);
+  printf("chain load failed: %d\n", err);
+  return err;
 }
+
+STATIC_COMMAND_START
+STATIC_COMMAND("chain", "start a staged image in place of this kernel <image> <length> [load r3 r4 r5 r6]", &cmd_chain)
+STATIC_COMMAND_END(ppc64_arch);
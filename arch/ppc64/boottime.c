@@ -0,0 +1,94 @@
+#include <arch/ppc64.h>
+#include <arch/ticks.h>
+#include <lk/console_cmd.h>
+#include <lk/init.h>
+#include <stdio.h>
+
+// boot timeline, a timebase stamp at _start, after the bss clear, at every LK init level and wherever
+// else ppc64_boot_mark() is called, printed by `boottime`
+// the timebase runs from power on (xenon) or from vm start (qemu), so the first stamp also shows the
+// time spent in firmware and the loader
+
+#define BOOT_MARKS 48
+
+struct boot_mark {
+  uint64_t tb;
+  const char *name;
+};
+
+static struct boot_mark marks[BOOT_MARKS];
+static uint nmarks;
+static uint dropped;
+
+void ppc64_boot_mark(const char *name) {
+  uint i = __atomic_fetch_add(&nmarks, 1, __ATOMIC_RELAXED);
+  if (i >= BOOT_MARKS) {
+    __atomic_fetch_add(&dropped, 1, __ATOMIC_RELAXED);
+    return;
+  }
+  marks[i].tb = lk_ticks();
+  marks[i].name = name;
+}
+
+// boot.S, right after clear_bss, with the timebase it read on entry
+void ppc64_boot_start(uint64_t start_tb) {
+  marks[0].tb = start_tb;
+  marks[0].name = "_start";
+  nmarks = 1;
+  ppc64_boot_mark("bss cleared");
+}
+
+// each runs among the hooks of its level, lk_main calls the function named before starting the level
+static const char *level_name(uint level) {
+  switch (level) {
+    case LK_INIT_LEVEL_EARLIEST: return "level earliest";
+    case LK_INIT_LEVEL_ARCH_EARLY: return "level arch_early, arch_early_init done";
+    case LK_INIT_LEVEL_PLATFORM_EARLY: return "level platform_early, platform_early_init done";
+    case LK_INIT_LEVEL_TARGET_EARLY: return "level target_early";
+    case LK_INIT_LEVEL_HEAP: return "level heap";
+    case LK_INIT_LEVEL_VM: return "level vm";
+    case LK_INIT_LEVEL_KERNEL: return "level kernel";
+    case LK_INIT_LEVEL_THREADING: return "level threading, bootstrap2 running";
+    case LK_INIT_LEVEL_ARCH: return "level arch, arch_init done";
+    case LK_INIT_LEVEL_PLATFORM: return "level platform, platform_init done";
+    case LK_INIT_LEVEL_TARGET: return "level target";
+    case LK_INIT_LEVEL_APPS: return "level apps, apps started";
+  }
+  return "level ?";
+}
+
+static void mark_level(uint level) {
+  ppc64_boot_mark(level_name(level));
+}
+
+LK_INIT_HOOK(boottime_earliest, mark_level, LK_INIT_LEVEL_EARLIEST);
+LK_INIT_HOOK(boottime_arch_early, mark_level, LK_INIT_LEVEL_ARCH_EARLY);
+LK_INIT_HOOK(boottime_platform_early, mark_level, LK_INIT_LEVEL_PLATFORM_EARLY);
+LK_INIT_HOOK(boottime_target_early, mark_level, LK_INIT_LEVEL_TARGET_EARLY);
+LK_INIT_HOOK(boottime_heap, mark_level, LK_INIT_LEVEL_HEAP);
+LK_INIT_HOOK(boottime_vm, mark_level, LK_INIT_LEVEL_VM);
+LK_INIT_HOOK(boottime_kernel, mark_level, LK_INIT_LEVEL_KERNEL);
+LK_INIT_HOOK(boottime_threading, mark_level, LK_INIT_LEVEL_THREADING);
+LK_INIT_HOOK(boottime_arch, mark_level, LK_INIT_LEVEL_ARCH);
+LK_INIT_HOOK(boottime_platform, mark_level, LK_INIT_LEVEL_PLATFORM);
+LK_INIT_HOOK(boottime_target, mark_level, LK_INIT_LEVEL_TARGET);
+LK_INIT_HOOK(boottime_apps, mark_level, LK_INIT_LEVEL_APPS);
+
+static int cmd_boottime(int argc, const console_cmd_args *argv) {
+  uint n = nmarks < BOOT_MARKS ? nmarks : BOOT_MARKS;
+  if (!n) return 0;
+
+  printf("timebase %llu at _start, %llu us since it started\n", marks[0].tb, lk_ticks_to_us(marks[0].tb));
+  printf("since _start   step\n");
+  for (uint i = 0; i < n; i++) {
+    uint64_t since = marks[i].tb - marks[0].tb;
+    uint64_t step = i ? marks[i].tb - marks[i - 1].tb : 0;
+    printf("%9llu us  %7llu us  %s\n", lk_ticks_to_us(since), lk_ticks_to_us(step), marks[i].name);
+  }
+  if (dropped) printf("%u marks dropped\n", dropped);
+  return 0;
+}
+
+STATIC_COMMAND_START
+STATIC_COMMAND("boottime", "boot timeline, from _start to the apps", &cmd_boottime)
+STATIC_COMMAND_END(ppc64_boottime);
@@ -0,0 +1,97 @@
+#include <arch/ops.h>
+#include <arch/ppc64.h>
+#include <arch/cpu_regs.h>
+#include <lk/console_cmd.h>
+#include <lk/macros.h>
+#include <stdio.h>
+
+// cache range ops for the LK api, one dcbst/dcbf/icbi per block and one barrier per range
+// the 970, cell and xenon are all coherent with dma, so on them these matter for code loading and for
+// handing buffers to other masters that are not, a cache block is 128 bytes on all of them
+
+// unknown cores start at the smallest block any 64 bit core has, more ops than needed but never too few
+#define BLOCK_MIN 32
+
+uint32_t ppc64_dcache_block = BLOCK_MIN;
+uint32_t ppc64_icache_block = BLOCK_MIN;
+
+static const struct {
+  uint16_t pvr_version;
+  uint16_t dblock;
+  uint16_t iblock;
+} cache_models[] = {
+  { 0x0039, 128, 128 }, // 970
+  { 0x003c, 128, 128 }, // 970fx
+  { 0x0044, 128, 128 }, // 970mp
+  { 0x0045, 128, 128 }, // 970gx
+  { 0x004b, 128, 128 }, // power8e
+  { 0x004c, 128, 128 }, // power8nvl
+  { 0x004d, 128, 128 }, // power8
+  { 0x004e, 128, 128 }, // power9
+  { 0x0080, 128, 128 }, // power10
+  { 0x0070, 128, 128 }, // cell ppu
+  { 0x0071, 128, 128 }, // xenon
+};
+
+void ppc64_cache_init(void) {
+  uint16_t version = pvr_read() >> 16;
+  for (uint i = 0; i < countof(cache_models); i++) {
+    if (cache_models[i].pvr_version == version) {
+      ppc64_cache_set_block_size(cache_models[i].dblock, cache_models[i].iblock);
+      return;
+    }
+  }
+}
+
+void ppc64_cache_set_block_size(uint32_t dblock, uint32_t iblock) {
+  // ignore anything that could not be a block size, a too large one would skip blocks
+  if (dblock >= BLOCK_MIN && dblock <= PAGE_SIZE && !(dblock & (dblock - 1))) ppc64_dcache_block = dblock;
+  if (iblock >= BLOCK_MIN && iblock <= PAGE_SIZE && !(iblock & (iblock - 1))) ppc64_icache_block = iblock;
+}
+
+#define BLOCK_LOOP(insn, block, start, len) do { \
+    addr_t _end = (start) + (len); \
+    for (addr_t _a = ROUNDDOWN((start), (block)); _a < _end; _a += (block)) { \
+      __asm__ volatile(insn " 0, %0" : : "r"(_a) : "memory"); \
+    } \
+  } while (0)
+
+// writes dirty blocks back, they stay valid
+void arch_clean_cache_range(addr_t start, size_t len) {
+  if (!len) return;
+  BLOCK_LOOP("dcbst", ppc64_dcache_block, start, len);
+  __asm__ volatile("sync" ::: "memory");
+}
+
+// writes dirty blocks back and drops them
+void arch_clean_invalidate_cache_range(addr_t start, size_t len) {
+  if (!len) return;
+  BLOCK_LOOP("dcbf", ppc64_dcache_block, start, len);
+  __asm__ volatile("sync" ::: "memory");
+}
+
+// server cores have no dcbi, the supervisor has no way to drop a block without writing it back, so
+// this is a clean and invalidate, callers have to clean before handing a buffer to the device anyway
+void arch_invalidate_cache_range(addr_t start, size_t len) {
+  arch_clean_invalidate_cache_range(start, len);
+}
+
+// makes stores to the range visible to instruction fetch on this cpu, icbi is broadcast to the others,
+// they only need an isync of their own (or any interrupt) before running the new code
+void arch_sync_cache_range(addr_t start, size_t len) {
+  if (!len) return;
+  BLOCK_LOOP("dcbst", ppc64_dcache_block, start, len);
+  __asm__ volatile("sync" ::: "memory");
+  BLOCK_LOOP("icbi", ppc64_icache_block, start, len);
+  __asm__ volatile("sync; isync" ::: "memory");
+}
+
+static int cmd_cache(int argc, const console_cmd_args *argv) {
+  printf("pvr %#llx, dcache block %u, icache block %u, dcbz %zu\n", pvr_read(),
+         ppc64_dcache_block, ppc64_icache_block, ppc64_dcbz_size);
+  return 0;
+}
+
+STATIC_COMMAND_START
+STATIC_COMMAND("cache", "cache block sizes in use", &cmd_cache)
+STATIC_COMMAND_END(ppc64_cache);
@@ -0,0 +1,182 @@
+#include <arch/cpu_regs.h>
+#include <arch/ops.h>
+#include <arch/pmu.h>
+#include <arch/ppc64.h>
+#include <kernel/thread.h>
+#include <lk/console_cmd.h>
+#include <lk/debug.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+STATIC_ASSERT(offsetof(struct ppc64_percpu, ex_r9) == PERCPU_EX_R9);
+STATIC_ASSERT(offsetof(struct ppc64_percpu, ex_tb) == PERCPU_EX_TB);
+STATIC_ASSERT(offsetof(struct ppc64_percpu, ex_common) == PERCPU_EX_COMMON);
+STATIC_ASSERT(offsetof(struct ppc64_percpu, ex_fast) == PERCPU_EX_FAST);
+STATIC_ASSERT(offsetof(struct ppc64_iframe, gpr) == IFRAME_GPR(0));
+STATIC_ASSERT(offsetof(struct ppc64_iframe, lr) == IFRAME_LR);
+STATIC_ASSERT(offsetof(struct ppc64_iframe, srr0) == IFRAME_SRR0);
+STATIC_ASSERT(offsetof(struct ppc64_iframe, vector) == IFRAME_VECTOR);
+STATIC_ASSERT(offsetof(struct ppc64_iframe, entry_tb) == IFRAME_TB);
+STATIC_ASSERT(offsetof(struct ppc64_iframe, full) == IFRAME_FULL);
+STATIC_ASSERT(sizeof(struct ppc64_iframe) == IFRAME_SIZE);
+
+extern uint8_t ppc64_vectors_start[], ppc64_vectors_end[];
+void ppc64_exc_common(void);
+void ppc64_exc_fast(void);
+enum handler_return ppc64_exception_handler(struct ppc64_iframe *frame);
+enum handler_return ppc64_irq_handler(struct ppc64_iframe *frame);
+
+#define VECTOR_BASE 0x100
+#define LI_R9       0x39200000 // addi r9, 0, 0
+
+// entry-to-handler latency in timebase ticks, per cpu and vector
+struct exc_stats {
+  uint64_t count;
+  uint64_t total;
+  uint32_t min;
+  uint32_t max;
+};
+
+#define EXC_SLOTS 32
+static struct exc_stats exc_stats[SMP_MAX_CPUS][EXC_SLOTS];
+
+static uint exc_slot(uint64_t vector) {
+  // 0xf00 and 0xf20 share a 0x80 block
+  return vector == 0xf20 ? EXC_SLOTS - 1 : (vector >> 7) & (EXC_SLOTS - 1);
+}
+
+static inline void exc_account(const struct ppc64_iframe *frame) {
+  uint32_t latency = tbl_read() - frame->entry_tb;
+  struct exc_stats *s = &exc_stats[arch_curr_cpu_num()][exc_slot(frame->vector)];
+  if (s->count == 0 || latency < s->min) s->min = latency;
+  if (latency > s->max) s->max = latency;
+  s->count++;
+  s->total += latency;
+}
+
+__WEAK enum handler_return platform_irq(struct ppc64_iframe *frame) {
+  return INT_NO_RESCHEDULE;
+}
+
+__WEAK void platform_irq_init_percpu(void) {
+}
+
+__WEAK bool platform_external_irq_hv(void) {
+  return false;
+}
+
+void ppc64_dump_iframe(const struct ppc64_iframe *frame) {
+  printf("vector 0x%llx%s, cpu %u\n", frame->vector, frame->hv ? " (hv)" : "", arch_curr_cpu_num());
+  printf("srr0 0x%016llx srr1 0x%016llx\n", frame->srr0, frame->srr1);
+  printf("lr   0x%016llx ctr  0x%016llx\n", frame->lr, frame->ctr);
+  printf("cr   0x%08llx xer 0x%016llx\n", frame->cr, frame->xer);
+  printf("dar  0x%016llx dsisr 0x%08llx\n", frame->dar, frame->dsisr);
+  uint ngpr = frame->full ? 32 : 14;
+  for (uint i = 0; i < ngpr; i += 4) {
+    printf("r%-2u 0x%016llx 0x%016llx 0x%016llx 0x%016llx\n", i,
+        frame->gpr[i], frame->gpr[i + 1], frame->gpr[i + 2], frame->gpr[i + 3]);
+  }
+}
+
+enum handler_return ppc64_exception_handler(struct ppc64_iframe *frame) {
+  exc_account(frame);
+
+  switch (frame->vector) {
+    case 0x300:
+    case 0x400:
+      if (ppc64_mmu_fault(frame)) return INT_NO_RESCHEDULE;
+      break;
+    case 0x980:
+      return ppc64_hdecrementer_irq(frame);
+    case 0xf00:
+      return ppc64_pmu_irq(frame);
+  }
+
+  ppc64_dump_iframe(frame);
+  panic("unhandled exception 0x%llx at 0x%llx\n", frame->vector, frame->srr0);
+}
+
+enum handler_return ppc64_irq_handler(struct ppc64_iframe *frame) {
+  exc_account(frame);
+
+  switch (frame->vector) {
+    case 0x100:
+      // a thread paused with the interrupts it waits for enabled in TSCR (xenon idle) restarts here,
+      // srr1 says which one woke it, and it is handled as if it had come in through its own vector
+      switch (frame->srr1 & SRR1_WAKE_MASK) {
+        case SRR1_WAKE_DEC:
+          ppc64_idle_wake(frame);
+          return ppc64_decrementer_irq(frame);
+        case SRR1_WAKE_EE:
+          ppc64_idle_wake(frame);
+          return platform_irq(frame);
+      }
+      ppc64_dump_iframe(frame);
+      panic("system reset at 0x%llx\n", frame->srr0);
+    case 0x900:
+      ppc64_idle_wake(frame);
+      return ppc64_decrementer_irq(frame);
+    case 0x800:
+    case 0xf20:
+      if (ppc64_fpu_unavailable(frame)) return INT_NO_RESCHEDULE;
+      ppc64_dump_iframe(frame);
+      panic("unit unavailable 0x%llx with the unit on, pc 0x%llx\n", frame->vector, frame->srr0);
+    case 0x380:
+    case 0x480:
+      if (ppc64_slb_miss(frame)) return INT_NO_RESCHEDULE;
+      ppc64_dump_iframe(frame);
+      panic("segment miss at 0x%llx, pc 0x%llx\n", frame->vector == 0x380 ? frame->dar : frame->srr0, frame->srr0);
+  }
+  ppc64_idle_wake(frame);
+  return platform_irq(frame);
+}
+
+void ppc64_exceptions_init_percpu(void) {
+  struct ppc64_percpu *p = ppc64_get_percpu();
+  p->ex_common = (uint64_t)&ppc64_exc_common;
+  p->ex_fast = (uint64_t)&ppc64_exc_fast;
+  platform_irq_init_percpu();
+}
+
+// copies the vector stubs down to real address 0x100 and up, once, on the boot cpu
+void ppc64_exceptions_init(void) {
+  uint8_t *dest = (uint8_t *)VECTOR_BASE;
+  const uint8_t *src = ppc64_vectors_start + VECTOR_BASE;
+  size_t len = ppc64_vectors_end - src;
+
+  memcpy(dest, src, len);
+
+  if (platform_external_irq_hv()) {
+    uint32_t *insn = (uint32_t *)(dest + 0x500 - VECTOR_BASE + EXC_STUB_HV_OFFSET);
+    DEBUG_ASSERT((*insn & 0xffff0000) == LI_R9);
+    *insn = LI_R9 | 1;
+  }
+
+  arch_sync_cache_range((addr_t)dest, len);
+
+  ppc64_exceptions_init_percpu();
+}
+
+static int cmd_irqlat(int argc, const console_cmd_args *argv) {
+  if (argc > 1 && !strcmp(argv[1].str, "reset")) {
+    memset(exc_stats, 0, sizeof(exc_stats));
+    return 0;
+  }
+
+  printf("entry-to-handler latency, timebase ticks\n");
+  printf("cpu  vector  count       min  avg  max\n");
+  for (uint cpu = 0; cpu < SMP_MAX_CPUS; cpu++) {
+    for (uint slot = 0; slot < EXC_SLOTS; slot++) {
+      const struct exc_stats *s = &exc_stats[cpu][slot];
+      if (!s->count) continue;
+      uint vector = slot == EXC_SLOTS - 1 ? 0xf20 : slot << 7;
+      printf("%3u  0x%04x  %-10llu  %3u  %3llu  %u\n", cpu, vector, s->count, s->min, s->total / s->count, s->max);
+    }
+  }
+  return 0;
+}
+
+STATIC_COMMAND_START
+STATIC_COMMAND("irqlat", "exception entry latency stats [reset]", &cmd_irqlat)
+STATIC_COMMAND_END(ppc64_exceptions);
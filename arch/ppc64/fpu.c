@@ -0,0 +1,65 @@
+#include <arch/arch_thread.h>
+#include <arch/ops.h>
+#include <arch/ppc64.h>
+#include <kernel/thread.h>
+#include <lk/debug.h>
+#include <stddef.h>
+
+// lazy fp and vmx switching
+// a switched in thread starts with MSR[FP] and MSR[VEC] off, its first fp or vmx instruction traps to
+// 0x800 or 0xf20, which loads its registers and turns the unit on for the return
+// switching out saves only the units that were loaded, so integer-only threads never save or restore
+// percpu fp_live records which units hold the current thread's registers, the exception exit copies it
+// into SRR1, a thread preempted from an interrupt comes back with its units off if it lost them
+// interrupt handlers must not use fp or vmx, they would clobber the registers of the thread they interrupted
+
+STATIC_ASSERT(offsetof(struct ppc64_percpu, fp_live) == PERCPU_FP_LIVE);
+STATIC_ASSERT(offsetof(struct ppc64_fp_state, fpscr) == FP_STATE_FPSCR);
+STATIC_ASSERT(offsetof(struct ppc64_vmx_state, vscr) == VMX_STATE_VSCR);
+STATIC_ASSERT(offsetof(struct ppc64_vmx_state, vrsave) == VMX_STATE_VRSAVE);
+
+// fpu.S
+void ppc64_fp_save(struct ppc64_fp_state *s);
+void ppc64_fp_restore(const struct ppc64_fp_state *s);
+void ppc64_vmx_save(struct ppc64_vmx_state *s);
+void ppc64_vmx_restore(const struct ppc64_vmx_state *s);
+
+static inline void units_off(void) {
+  __asm__ volatile("mtmsrd %0\n"
+                   "isync" : : "r"(mfmsr() & ~(uint64_t)(MSR_FP | MSR_VEC)) : "memory");
+}
+
+// whatever firmware or early boot left in the registers belongs to nobody
+void ppc64_fpu_init_percpu(void) {
+  ppc64_get_percpu()->fp_live = 0;
+  units_off();
+}
+
+// 0x800 and 0xf20, through the fast exception path, fp and vmx registers are not touched on the way in
+bool ppc64_fpu_unavailable(struct ppc64_iframe *frame) {
+  struct ppc64_percpu *p = ppc64_get_percpu();
+  struct arch_thread *t = &get_current_thread()->arch;
+  uint64_t unit = frame->vector == 0x800 ? MSR_FP : MSR_VEC;
+  // the unit was on, so this is not a trap we caused
+  if (p->fp_live & unit) return false;
+
+  if (unit == MSR_FP) {
+    ppc64_fp_restore(&t->fp);
+    t->fp_traps++;
+  } else {
+    ppc64_vmx_restore(&t->vmx);
+    t->vmx_traps++;
+  }
+  p->fp_live |= unit;
+  return true;
+}
+
+// interrupts are off, the exception exit and the next thread both see the units off afterwards
+void ppc64_fpu_context_switch(struct thread *oldthread) {
+  struct ppc64_percpu *p = ppc64_get_percpu();
+  if (!p->fp_live) return;
+  if (p->fp_live & MSR_FP) ppc64_fp_save(&oldthread->arch.fp);
+  if (p->fp_live & MSR_VEC) ppc64_vmx_save(&oldthread->arch.vmx);
+  p->fp_live = 0;
+  units_off();
+}
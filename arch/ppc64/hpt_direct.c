@@ -0,0 +1,142 @@
+#include <arch/cpu_regs.h>
+#include <arch/hpt.h>
+#include <lk/compiler.h>
+#include <stddef.h>
+
+// hpt backend for cores we own outright (xenon), the table lives in our memory and SDR1 points at it
+// callers hold the mmu lock, which also keeps tlbie to one cpu at a time as older cores require
+
+#define DIRECT_PTEG_SHIFT HPT_MIN_PTEG_SHIFT
+#define DIRECT_HTAB_SIZE  ((1UL << DIRECT_PTEG_SHIFT) * HPT_PTEG_SLOTS * 16)
+
+struct hpte {
+  volatile uint64_t v;
+  volatile uint64_t r;
+};
+
+// SDR1 wants the table aligned to its own size
+static struct hpte htab[DIRECT_HTAB_SIZE / sizeof(struct hpte)] __ALIGNED(DIRECT_HTAB_SIZE);
+
+static void direct_init_percpu(void) {
+  // HTABORG | HTABSIZE, where the size field is log2(PTEG's) - 11
+  sdr1_write((uint64_t)htab | (DIRECT_PTEG_SHIFT - HPT_MIN_PTEG_SHIFT));
+  __asm__ volatile("ptesync" ::: "memory");
+}
+
+static uint direct_init(void) {
+  direct_init_percpu();
+  return DIRECT_PTEG_SHIFT;
+}
+
+static long direct_insert(uint64_t ptex, uint64_t v, uint64_t r, bool exact) {
+  if (!exact) {
+    uint64_t group = ptex & ~(HPT_PTEG_SLOTS - 1);
+    for (ptex = group; ptex < group + HPT_PTEG_SLOTS; ptex++) {
+      if (!(htab[ptex].v & HPTE_V_VALID)) break;
+    }
+    if (ptex == group + HPT_PTEG_SLOTS) return -1;
+  } else if (htab[ptex].v & HPTE_V_VALID) {
+    return -1;
+  }
+
+  // the walker must never see a valid dword 0 next to a stale dword 1
+  htab[ptex].r = r;
+  __asm__ volatile("eieio" ::: "memory");
+  htab[ptex].v = v;
+  __asm__ volatile("ptesync" ::: "memory");
+  return ptex;
+}
+
+// the 4K form carries only the low 48 bits of the va, tlbie flushes every page that matches them
+// the large form (L=1) drops the va bits inside the 16MB page and takes the LP encoding at bit 12
+#define TLBIE_LP_SHIFT 12
+#define LARGE_LP       0    // the first large page size, what the linear map uses
+
+static inline void tlbie(uint64_t vpn, bool large) {
+  uint64_t rb = (vpn << HPT_PAGE_SHIFT) & 0x0000fffffffff000ULL;
+  if (large) {
+    rb = (rb & ~((1ULL << HPT_LARGE_SHIFT) - 1)) | (LARGE_LP << TLBIE_LP_SHIFT);
+    __asm__ volatile("tlbie %0,1" : : "r"(rb) : "memory");
+  } else {
+    __asm__ volatile("tlbie %0,0" : : "r"(rb) : "memory");
+  }
+}
+
+static void invalidate(uint64_t ptex, uint64_t vpn, bool large) {
+  htab[ptex].v = 0;
+  __asm__ volatile("ptesync" ::: "memory");
+  tlbie(vpn, large);
+  __asm__ volatile("eieio\n"
+                   "tlbsync\n"
+                   "ptesync" ::: "memory");
+}
+
+static bool holds(uint64_t ptex, uint64_t v) {
+  uint64_t cur = htab[ptex].v;
+  return (cur & HPTE_V_VALID) && !((cur ^ v) & (HPTE_V_AVPN_MASK | HPTE_V_SECONDARY));
+}
+
+static bool direct_remove(uint64_t ptex, uint64_t v, uint64_t vpn) {
+  if (!holds(ptex, v)) return false;
+  invalidate(ptex, vpn, htab[ptex].v & HPTE_V_LARGE);
+  return true;
+}
+
+// every tlbie of the batch, then one tlbsync to wait for them all
+static uint direct_remove_batch(const uint64_t *ptex, const uint64_t *v, const uint64_t *vpn, uint count) {
+  uint done = 0, large = 0;
+  for (uint i = 0; i < count; i++) {
+    if (!holds(ptex[i], v[i])) continue;
+    if (htab[ptex[i]].v & HPTE_V_LARGE) large |= 1U << i;
+    htab[ptex[i]].v = 0;
+    done |= 1U << i;
+  }
+  if (!done) return 0;
+
+  __asm__ volatile("ptesync" ::: "memory");
+  for (uint i = 0; i < count; i++) {
+    if (done & (1U << i)) tlbie(vpn[i], large & (1U << i));
+  }
+  __asm__ volatile("eieio\n"
+                   "tlbsync\n"
+                   "ptesync" ::: "memory");
+  return done;
+}
+
+static bool direct_protect(uint64_t ptex, uint64_t v, uint64_t vpn, uint64_t r) {
+  if (!holds(ptex, v)) return false;
+  const uint64_t mask = HPTE_R_PP_RO | HPTE_R_N;
+  htab[ptex].r = (htab[ptex].r & ~mask) | (r & mask);
+  __asm__ volatile("ptesync" ::: "memory");
+  tlbie(vpn, htab[ptex].v & HPTE_V_LARGE);
+  __asm__ volatile("eieio\n"
+                   "tlbsync\n"
+                   "ptesync" ::: "memory");
+  return true;
+}
+
+static bool direct_evict(uint64_t ptex) {
+  uint64_t cur = htab[ptex].v;
+  if (cur & HPTE_V_BOLTED) return false;
+  if (cur & HPTE_V_VALID) invalidate(ptex, hpte_vpn(cur, ptex), cur & HPTE_V_LARGE);
+  return true;
+}
+
+static void direct_clear(void) {
+  for (uint64_t ptex = 0; ptex < DIRECT_HTAB_SIZE / sizeof(struct hpte); ptex++) {
+    uint64_t cur = htab[ptex].v;
+    if (cur & HPTE_V_VALID) invalidate(ptex, hpte_vpn(cur, ptex), cur & HPTE_V_LARGE);
+  }
+}
+
+const struct hpt_ops hpt_direct_ops = {
+  .name = "direct",
+  .init = direct_init,
+  .init_percpu = direct_init_percpu,
+  .insert = direct_insert,
+  .remove = direct_remove,
+  .evict = direct_evict,
+  .remove_batch = direct_remove_batch,
+  .protect = direct_protect,
+  .clear = direct_clear,
+};
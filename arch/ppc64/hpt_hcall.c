@@ -0,0 +1,164 @@
+#include <arch/hpt.h>
+#include <arch/hypercalls.h>
+#include <arch/ticks.h>
+#include <lk/compiler.h>
+#include <lk/console_cmd.h>
+#include <stdio.h>
+#include <string.h>
+
+// hpt backend for PAPR guests (qemu pseries), the hypervisor owns the table and does the tlb flushes
+// callers hold the mmu lock, which also covers the stats
+
+// qemu sizes the table from the ram size, the platform replaces this with ibm,pft-size
+uint hpt_hcall_pft_shift = 18;
+
+// count and timebase ticks of each page table hypercall, indexed by opcode / 4
+#define HCALL_SLOTS (H_BULK_REMOVE / 4 + 1)
+
+static struct {
+  uint64_t count;
+  uint64_t ticks;
+} hcall_stats[HCALL_SLOTS];
+
+static uint64_t hcall_exits;
+
+static int64_t hcall(uint32_t opcode, uint64_t ret[8], uint64_t a, uint64_t b, uint64_t c, uint64_t d,
+                     uint64_t e, uint64_t f, uint64_t g, uint64_t h) {
+  lk_ticks_t start = lk_ticks();
+  int64_t status = do_hypercall_ret(opcode, ret, a, b, c, d, e, f, g, h);
+  hcall_stats[opcode / 4].ticks += lk_ticks() - start;
+  hcall_stats[opcode / 4].count++;
+  hcall_exits++;
+  return status;
+}
+
+static uint hcall_init(void) {
+  // 128 bytes per PTEG
+  return hpt_hcall_pft_shift - 7;
+}
+
+static long hcall_insert(uint64_t ptex, uint64_t v, uint64_t r, bool exact) {
+  uint64_t ret[8];
+  // without H_EXACT the hypervisor takes the first free slot of the group and tells us which
+  // PAPR has no multi entry H_ENTER, so inserts stay one exit each
+  int64_t status = hcall(H_ENTER, ret, exact ? H_EXACT : 0, ptex, v, r, 0, 0, 0, 0);
+  if (status != H_SUCCESS) return -1;
+  return ret[0];
+}
+
+static bool hcall_remove(uint64_t ptex, uint64_t v, uint64_t vpn) {
+  uint64_t ret[8];
+  // H_AVPN makes the hypervisor check the slot still holds our page
+  int64_t status = hcall(H_REMOVE, ret, H_AVPN, ptex, v & HPTE_V_AVPN_MASK, 0, 0, 0, 0, 0);
+  return status == H_SUCCESS;
+}
+
+static uint hcall_remove_batch(const uint64_t *ptex, const uint64_t *v, const uint64_t *vpn, uint count) {
+  uint64_t spec[2 * HBR_MAX] = { 0 };
+  for (uint i = 0; i < HBR_MAX; i++) {
+    spec[2 * i] = i < count ? HBR_REQUEST | HBR_AVPN | ptex[i] : HBR_END;
+    if (i < count) spec[2 * i + 1] = v[i] & HPTE_V_AVPN_MASK;
+  }
+
+  uint64_t ret[8];
+  int64_t status = hcall(H_BULK_REMOVE, ret, spec[0], spec[1], spec[2], spec[3], spec[4], spec[5], spec[6], spec[7]);
+  if (status != H_SUCCESS) {
+    // a malformed specifier stops the whole call, fall back to one at a time
+    uint done = 0;
+    for (uint i = 0; i < count; i++) {
+      if (hcall_remove(ptex[i], v[i], vpn[i])) done |= 1U << i;
+    }
+    return done;
+  }
+
+  uint done = 0;
+  for (uint i = 0; i < count; i++) {
+    if (HBR_RC(ret[2 * i]) == 0) done |= 1U << i;
+  }
+  return done;
+}
+
+static bool hcall_protect(uint64_t ptex, uint64_t v, uint64_t vpn, uint64_t r) {
+  uint64_t ret[8];
+  uint64_t flags = H_AVPN | (r & (HPTE_R_PP_RO | HPTE_R_N));
+  return hcall(H_PROTECT, ret, flags, ptex, v & HPTE_V_AVPN_MASK, 0, 0, 0, 0, 0) == H_SUCCESS;
+}
+
+static bool hcall_evict(uint64_t ptex) {
+  uint64_t ret[8];
+  if (hcall(H_READ, ret, 0, ptex, 0, 0, 0, 0, 0, 0) != H_SUCCESS) return false;
+  if (ret[0] & HPTE_V_BOLTED) return false;
+  if (!(ret[0] & HPTE_V_VALID)) return true;
+  // H_ANDCOND refuses if the slot got bolted since the read
+  return hcall(H_REMOVE, ret, H_ANDCOND, ptex, HPTE_V_BOLTED, 0, 0, 0, 0, 0) == H_SUCCESS;
+}
+
+// the table stays with the hypervisor across a chain load, so the next kernel would find ours in it
+// one H_READ_4 per 4 slots, the ones in use go out HPT_BATCH at a time through H_BULK_REMOVE
+static void hcall_clear(void) {
+  uint64_t slots = 1ULL << (hpt_hcall_pft_shift - 4);
+  uint64_t ptex[HPT_BATCH], v[HPT_BATCH], vpn[HPT_BATCH] = { 0 };
+  uint n = 0;
+  for (uint64_t group = 0; group < slots; group += 4) {
+    uint64_t ret[8];
+    if (hcall(H_READ, ret, H_READ_4, group, 0, 0, 0, 0, 0, 0) != H_SUCCESS) continue;
+    for (uint i = 0; i < 4; i++) {
+      if (!(ret[2 * i] & HPTE_V_VALID)) continue;
+      ptex[n] = group + i;
+      v[n] = ret[2 * i];
+      if (++n == HPT_BATCH) {
+        hcall_remove_batch(ptex, v, vpn, n);
+        n = 0;
+      }
+    }
+  }
+  if (n) hcall_remove_batch(ptex, v, vpn, n);
+}
+
+static uint64_t hcall_exit_count(void) {
+  return hcall_exits;
+}
+
+const struct hpt_ops hpt_hcall_ops = {
+  .name = "hcall",
+  .init = hcall_init,
+  .insert = hcall_insert,
+  .remove = hcall_remove,
+  .evict = hcall_evict,
+  .remove_batch = hcall_remove_batch,
+  .protect = hcall_protect,
+  .exits = hcall_exit_count,
+  .clear = hcall_clear,
+};
+
+static int cmd_hcalls(int argc, const console_cmd_args *argv) {
+  static const struct {
+    uint32_t opcode;
+    const char *name;
+  } names[] = {
+    { H_REMOVE, "H_REMOVE" },
+    { H_ENTER, "H_ENTER" },
+    { H_READ, "H_READ" },
+    { H_PROTECT, "H_PROTECT" },
+    { H_BULK_REMOVE, "H_BULK_REMOVE" },
+  };
+
+  if (argc > 1 && !strcmp(argv[1].str, "reset")) {
+    memset(hcall_stats, 0, sizeof(hcall_stats));
+    return 0;
+  }
+
+  printf("%llu page table hypercalls\n", hcall_exits);
+  printf("hcall          count       avg ns\n");
+  for (uint i = 0; i < countof(names); i++) {
+    uint64_t count = hcall_stats[names[i].opcode / 4].count;
+    if (!count) continue;
+    printf("%-14s %-11llu %llu\n", names[i].name, count,
+           lk_ticks_to_ns(hcall_stats[names[i].opcode / 4].ticks) / count);
+  }
+  return 0;
+}
+
+STATIC_COMMAND_START
+STATIC_COMMAND("hcalls", "page table hypercall counts and latency [reset]", &cmd_hcalls)
+STATIC_COMMAND_END(hpt_hcall);
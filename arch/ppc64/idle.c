@@ -0,0 +1,168 @@
+#include <arch.h>
+#include <arch/ops.h>
+#include <arch/ppc64.h>
+#include <arch/ticks.h>
+#include <arch/timer_wheel.h>
+#include <kernel/thread.h>
+#include <lk/console_cmd.h>
+#include <lk/debug.h>
+#include <lk/macros.h>
+#include <stdio.h>
+#include <string.h>
+
+// idle state selection
+// state 0 spins at low smt priority and works everywhere, platforms add deeper ones (H_CEDE on pseries,
+// the thread pause on xenon)
+// the deepest state is picked whose measured wake latency is small next to the time left until the
+// next timer deadline, so a timer never fires much later than it would have from a spin
+
+#define IDLE_MAX_STATES 4
+
+// a state is only used when its wake latency is at most 1/IDLE_BUDGET_FACTOR of the time left
+#define IDLE_BUDGET_FACTOR 4
+
+struct idle_stats {
+  uint64_t entries;
+  uint64_t residency;   // timebase ticks spent in the state
+  uint64_t timer_wakes; // ended by the deadline we planned around, the only wakes with a known target
+  uint64_t latency;     // sum over timer wakes, of interrupt entry minus deadline
+  uint32_t latency_min;
+  uint32_t latency_max;
+};
+
+static struct idle_stats idle_stats[SMP_MAX_CPUS][IDLE_MAX_STATES];
+
+// per state, a running average of the wake latency in timebase ticks, 0 until the first sample
+static uint64_t latency_est[IDLE_MAX_STATES];
+
+static void spin_enter(void) {
+  struct ppc64_percpu *p = ppc64_get_percpu();
+  arch_enable_ints();
+  // low priority hands most of the issue slots to the sibling thread
+  __asm__ volatile("or 1,1,1");
+  // an interrupt ending the wait puts the priority back itself, it may switch threads before we see it
+  while (p->idle_state && !p->ipi_pending);
+  __asm__ volatile("or 2,2,2");
+}
+
+static const struct ppc64_idle_state idle_spin = {
+  .name = "spin",
+  .enter = spin_enter,
+  .latency_us = 0,
+};
+
+static const struct ppc64_idle_state *states[IDLE_MAX_STATES] = { &idle_spin };
+static uint nstates = 1;
+
+__WEAK const struct ppc64_idle_state *platform_idle_states(uint *count) {
+  *count = 0;
+  return NULL;
+}
+
+// on the boot cpu, before the secondaries start idling
+void ppc64_idle_init(void) {
+  uint count;
+  const struct ppc64_idle_state *deeper = platform_idle_states(&count);
+  for (uint i = 0; i < count && i + 1 < IDLE_MAX_STATES; i++) {
+    states[i + 1] = &deeper[i];
+  }
+  nstates = 1 + MIN(count, IDLE_MAX_STATES - 1);
+}
+
+static uint64_t idle_latency(uint i) {
+  return latency_est[i] ? latency_est[i] : lk_us_to_ticks(states[i]->latency_us);
+}
+
+static uint idle_select(bool timed, uint64_t deadline, uint64_t now) {
+  if (!timed) return nstates - 1;
+  if ((int64_t)(deadline - now) <= 0) return 0;
+  uint64_t budget = deadline - now;
+  uint i = nstates - 1;
+  while (i > 0 && idle_latency(i) * IDLE_BUDGET_FACTOR > budget) i--;
+  return i;
+}
+
+static void idle_account(uint cpu, uint i, uint64_t entered, uint64_t wake, bool timed, uint64_t deadline) {
+  struct idle_stats *s = &idle_stats[cpu][i];
+  s->entries++;
+  s->residency += wake - entered;
+  if (!timed || (int64_t)(wake - deadline) < 0) return;
+
+  uint32_t late = wake - deadline;
+  if (s->timer_wakes == 0 || late < s->latency_min) s->latency_min = late;
+  if (late > s->latency_max) s->latency_max = late;
+  s->timer_wakes++;
+  s->latency += late;
+  // 1/8 weight per sample, shared by all cpus, a lost update now and then does not matter
+  latency_est[i] = latency_est[i] ? latency_est[i] - latency_est[i] / 8 + late / 8 : late;
+}
+
+void __WEAK arch_idle(void) {
+  // the halt paths idle with interrupts off, none of the states may turn them back on and nothing
+  // may be scheduled, so those get a short spin and return with the caller's MSR[EE] untouched
+  if (arch_ints_disabled()) {
+    __asm__ volatile("or 1,1,1\n"
+                     "or 2,2,2");
+    return;
+  }
+  if (ppc64_mp_handle_ipi() == INT_RESCHEDULE) {
+    thread_preempt();
+    return;
+  }
+  struct ppc64_percpu *p = ppc64_get_percpu();
+  uint cpu = arch_curr_cpu_num();
+  arch_disable_ints();
+  if (p->ipi_pending) {
+    arch_enable_ints();
+    return;
+  }
+  uint64_t deadline;
+  bool timed = ppc64_timer_next(&deadline);
+  uint64_t entered = lk_ticks();
+  uint i = idle_select(timed, deadline, entered);
+
+  p->idle_state = i + 1;
+  states[i]->enter();
+
+  // the waking interrupt may have switched threads, idle_wake still says when it arrived
+  arch_disable_ints();
+  if (p->idle_state) {
+    // an ipi we polled for, or a state that gave up early
+    p->idle_state = 0;
+    p->idle_wake = lk_ticks();
+  }
+  uint64_t wake = p->idle_wake;
+  arch_enable_ints();
+  idle_account(cpu, i, entered, wake, timed, deadline);
+}
+
+static int cmd_idle(int argc, const console_cmd_args *argv) {
+  if (argc > 1 && !strcmp(argv[1].str, "reset")) {
+    memset(idle_stats, 0, sizeof(idle_stats));
+    return 0;
+  }
+
+  printf("state  latency(us)  min residency(us)\n");
+  for (uint i = 0; i < nstates; i++) {
+    uint64_t lat = lk_ticks_to_us(idle_latency(i));
+    printf("%-6s %-12llu %llu%s\n", states[i]->name, lat, lat * IDLE_BUDGET_FACTOR,
+           latency_est[i] || i == 0 ? "" : " (assumed)");
+  }
+
+  printf("cpu state  entries     residency(ms) timer wakes  latency min/avg/max(us)\n");
+  for (uint cpu = 0; cpu < SMP_MAX_CPUS; cpu++) {
+    for (uint i = 0; i < nstates; i++) {
+      const struct idle_stats *s = &idle_stats[cpu][i];
+      if (!s->entries) continue;
+      uint64_t avg = s->timer_wakes ? s->latency / s->timer_wakes : 0;
+      printf("%-3u %-6s %-11llu %-13llu %-12llu %llu/%llu/%llu\n", cpu, states[i]->name, s->entries,
+             lk_ticks_to_ms(s->residency), s->timer_wakes, lk_ticks_to_us(s->latency_min),
+             lk_ticks_to_us(avg), lk_ticks_to_us(s->latency_max));
+    }
+  }
+  return 0;
+}
+
+STATIC_COMMAND_START
+STATIC_COMMAND("idle", "idle states, residency and wake latency [reset]", &cmd_idle)
+STATIC_COMMAND_END(ppc64_idle);
@@ -2,40 +2,38 @@
 
 #include <lk/compiler.h>
 #include <lk/debug.h>
+#include <arch/ppc64.h>
 
+// mtmsrd with L=1 only touches EE and RI
 static inline void arch_enable_ints(void) {
-  // TODO, only actually enable interrupts, when the codebase is ready to accept them
-  // Xell leaves the decrementer ticking, and will rudely interrupt/crash things
-  //__asm__ volatile("mtmsrd %0, 1": : "r"(0x200 | 0x8000));
+  __asm__ volatile("mtmsrd %0, 1": : "r"(MSR_EE | MSR_RI) : "memory");
 }
 static inline void arch_disable_ints(void) {
-  __asm__ volatile("mtmsrd %0, 1": : "r"(0x200));
+  __asm__ volatile("mtmsrd %0, 1": : "r"(MSR_RI) : "memory");
 }
 
 static inline struct thread *arch_get_current_thread(void) {
-  struct thread *thread_reg;
-  __asm__ volatile("add %0, %%r13, %1" : "=r"(thread_reg) : "r"(0));
-  //printf("arch_get_current_thread() == 0x%llx\n", (uint64_t)thread_reg);
-  return thread_reg;
+  return ppc64_get_percpu()->current_thread;
 }
 
 static inline void arch_set_current_thread(struct thread *t) {
-  //printf("arch_set_current_thread(0x%llx)\n", (uint64_t)t);
-  __asm__ volatile ("add %%r13, %0, %1" : : "r"(t), "r"(0));
+  ppc64_get_percpu()->current_thread = t;
 }
 
 static inline bool arch_ints_disabled(void) {
   uint32_t state;
 
   __asm__ volatile("mfmsr %0": "=r" (state));
-  return !(state & 0x8000);
+  return !(state & MSR_EE);
 }
 
 static inline uint arch_curr_cpu_num(void) {
-  return 0;
-  uint64_t pir;
-  __asm__("mfspr %0, 1023" : "=r"(pir));
-  return pir;
+  return ppc64_get_percpu()->cpu_num;
 }
 
-static inline ulong arch_cycle_count(void) { return 0; }
+// the pmcs are per thread and only 32 bits, so scale the timebase instead
+static inline ulong arch_cycle_count(void) {
+  ulong tb;
+  __asm__ volatile("mftb %0" : "=r"(tb));
+  return tb * ppc64_cycles_per_tb;
+}
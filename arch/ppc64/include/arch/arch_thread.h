@@ -1,7 +1,20 @@
 #pragma once
 
+#include <lk/compiler.h>
 #include <sys/types.h>
 
+// loaded on first use after a switch and saved when switched out, see fpu.c
+struct ppc64_fp_state {
+  uint64_t fpr[32];       // 0
+  uint64_t fpscr;         // 256
+};
+
+struct ppc64_vmx_state {
+  uint64_t vr[32][2];     // 0
+  uint32_t vscr[4];       // 512, mfvscr leaves it in the last word
+  uint32_t vrsave;        // 528
+} __ALIGNED(16);
+
 struct arch_thread {
   uint64_t lr;  // 0
   uint64_t sp;  // 8
@@ -23,4 +36,11 @@ struct arch_thread {
   uint64_t r29; // 136
   uint64_t r30; // 144
   uint64_t r31; // 152
+  uint64_t pmu_counts[6]; // 160, see arch/pmu.h
+  uint64_t slb_misses;    // 208
+  uint64_t cr;            // 216, for cr2-cr4
+  uint64_t fp_traps;      // 224, times the fp state was loaded lazily
+  uint64_t vmx_traps;     // 232
+  struct ppc64_fp_state fp;
+  struct ppc64_vmx_state vmx;
 };
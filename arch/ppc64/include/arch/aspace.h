@@ -1,4 +1,14 @@
 #pragma once
 
+#include <stdint.h>
+#include <sys/types.h>
+
+// the hashed page table is only a cache, every mapping also lives in a small software radix tree
+// that query, unmap and the fault path walk, see mmu.c
 struct arch_aspace {
+  uint64_t *radix;
+  vaddr_t base;
+  size_t size;
+  uint32_t ctx;   // selects the vsids, 0 is the kernel
+  uint flags;
 };
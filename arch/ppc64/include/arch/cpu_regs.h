@@ -52,6 +52,7 @@ make_spr(dsisr, 18);
 // data storage interupt status register, why a load/store causd a fault
 make_spr(dar, 19);
 // data address register, the addr that caused a fault
+make_spr(dec, 22); // decrementer, interrupts when bit 0 goes from 0 to 1
 make_spr(sdr1, 25); // 0x19, the physical addr that the root page table starts at
 // 0:4, htable size, must be 0-28
 // addr must be 256kb aligned
@@ -64,9 +65,23 @@ make_spr(uctrl, 136); // 0x88
 make_spr(ctrl, 152); // 0x98
 make_spr(pvr, 287);
 
+make_spr(hdec, 310); // hypervisor decrementer
 make_spr(hrmor, 313); // HRMOR
 
 make_spr(lpcr, 318); // 0x13e
 
+// performance monitor, book3s layout, the cell derived xenon core does not have these
+make_spr(mmcra, 786);
+make_spr(pmc1, 787);
+make_spr(pmc2, 788);
+make_spr(pmc3, 789);
+make_spr(pmc4, 790);
+make_spr(pmc5, 791);
+make_spr(pmc6, 792);
+make_spr(mmcr0, 795);
+make_spr(mmcr1, 798);
+
+make_spr(tscr, 921); // 0x399, thread switch control, on cell and xenon also what wakes a paused thread
+
 make_spr(hid0, 1008); //0x3f0, 1<<22=nap, 1<<23=doze, 1<<24=deepnap
 make_spr(pir, 1023);
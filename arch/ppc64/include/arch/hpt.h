@@ -0,0 +1,150 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+// hashed page table, book3s 4K pages in 256MB segments, see section 5.7.7 of book3s
+
+#define HPT_PAGE_SHIFT      12
+#define HPT_LARGE_SHIFT     24   // the first large page size, 16MB on everything we run on
+#define HPT_SEGMENT_SHIFT   28
+#define HPT_PTEG_SLOTS      8
+#define HPT_MIN_PTEG_SHIFT  11   // 2^11 PTEG's of 128 bytes, the 256KB minimum
+#define HPT_BATCH           4    // removes handed to a backend at once, what H_BULK_REMOVE takes
+
+#define SLB_ENTRIES         32   // the architected minimum, 970 and cell have 64
+#define SLB_BOLTED          8    // low slb entries holding kernel segments, see slb.c
+
+// dword 0
+#define HPTE_V_VALID        0x1ULL
+#define HPTE_V_SECONDARY    0x2ULL
+#define HPTE_V_LARGE        0x4ULL
+#define HPTE_V_BOLTED       0x10ULL  // software bit, never picked for eviction
+#define HPTE_V_AVPN_SHIFT   7
+#define HPTE_V_AVPN_MASK    (~0x7fULL)
+
+// dword 1
+#define HPTE_R_PP_RW        0x2ULL   // with key 1, which every segment uses
+#define HPTE_R_PP_RO        0x3ULL
+#define HPTE_R_N            0x4ULL   // no execute
+#define HPTE_R_G            0x8ULL
+#define HPTE_R_M            0x10ULL
+#define HPTE_R_I            0x20ULL
+#define HPTE_R_W            0x40ULL
+#define HPTE_R_C            0x80ULL
+#define HPTE_R_R            0x100ULL
+#define HPTE_R_RPN_MASK     0x0ffffffffffff000ULL
+
+// the 65 bit virtual address space leaves 37 bits of vsid for 256MB segments
+#define VSID_BITS           37
+#define VSID_MODULUS        ((1ULL << VSID_BITS) - 1)
+#define VSID_MULTIPLIER     268435399ULL // prime, spreads neighbouring segments across the table
+
+// a backend owns the table itself, the engine only ever hands it whole PTE's and slot numbers
+struct hpt_ops {
+  const char *name;
+  // sets up the table, returns log2 of the number of PTEG's
+  uint (*init)(void);
+  // optional, run on each secondary cpu as it comes up
+  void (*init_percpu)(void);
+  // writes v/r into a free slot of the group starting at `ptex`, or into `ptex` itself if `exact`
+  // returns the slot used, or -1 when there was nothing free
+  long (*insert)(uint64_t ptex, uint64_t v, uint64_t r, bool exact);
+  // invalidates `ptex` if it still holds the page `v` was built for, and flushes it from the tlb
+  // `vpn` is the virtual page number of that page, returns false if the slot held something else
+  bool (*remove)(uint64_t ptex, uint64_t v, uint64_t vpn);
+  // clears `ptex` whatever it holds, unless it is bolted, returns false if it was left alone
+  bool (*evict)(uint64_t ptex);
+  // optional, remove() for up to HPT_BATCH slots at once, returns a bitmask of the ones that held their page
+  uint (*remove_batch)(const uint64_t *ptex, const uint64_t *v, const uint64_t *vpn, uint count);
+  // optional, rewrites the pp and N bits of `ptex` from `r` in place, false if it held something else
+  bool (*protect)(uint64_t ptex, uint64_t v, uint64_t vpn, uint64_t r);
+  // optional, how often the backend has left the kernel, hypercalls for the hcall one
+  uint64_t (*exits)(void);
+  // optional, drops every entry, bolted ones too, for handing the machine to another kernel
+  // runs with translation off and the other cpus parked
+  void (*clear)(void);
+};
+
+struct hpt_stats {
+  uint64_t ptegs;
+  uint64_t inserts;
+  uint64_t secondary;  // inserts that went to the secondary PTEG
+  uint64_t evictions;
+  uint64_t removes;
+  uint64_t stale;      // unmaps whose hpt copy had already been evicted
+  uint64_t protects;   // permission changes done in place
+  uint64_t faults;     // evicted entries put back by the storage fault
+};
+
+void hpt_get_stats(struct hpt_stats *out);
+
+extern const struct hpt_ops hpt_direct_ops;
+extern const struct hpt_ops hpt_hcall_ops;
+
+// log2 of the table size in bytes, from "ibm,pft-size" in the device tree
+extern uint hpt_hcall_pft_shift;
+
+// all of ram is mapped here, with bolted 16MB pages when the mmu is on
+// real mode ignores the top 4 bits of an address, so these work with it off as well
+#define PPC64_LINEAR_BASE   0xc000000000000000ULL
+
+// platform hooks
+// picks the backend
+const struct hpt_ops *platform_hpt_ops(void);
+// bytes of ram starting at physical 0, the extent of the linear map
+uint64_t platform_ram_size(void);
+// true if the kernel can run with translation on, which needs 16MB pages for the linear map
+// and every device reachable through hypercalls or a mapping
+bool platform_kernel_translation(void);
+
+// vsid for segment `esid` of address space context `ctx`, 0 is the kernel
+static inline uint64_t hpt_vsid(uint32_t ctx, uint64_t esid) {
+  // the low 2^48 bytes and the 0xc... kernel region each get a private window per context
+  uint64_t proto = ((uint64_t)ctx << 21) | ((esid >> 32) == 0xc ? 1ULL << 20 : 0) | (esid & 0xfffff);
+  unsigned __int128 x = (unsigned __int128)proto * VSID_MULTIPLIER;
+  // x mod 2^n-1 by folding, no divide
+  uint64_t lo = (uint64_t)(x & VSID_MODULUS), hi = (uint64_t)(x >> VSID_BITS);
+  uint64_t vsid = lo + hi;
+  vsid = (vsid & VSID_MODULUS) + (vsid >> VSID_BITS);
+  return vsid == VSID_MODULUS ? 0 : vsid;
+}
+
+// primary hash, the secondary is its complement, both get masked down to a PTEG index
+static inline uint64_t hpt_hash_shift(uint64_t vsid, uint64_t ea, uint page_shift) {
+  uint64_t page = (ea & ((1ULL << HPT_SEGMENT_SHIFT) - 1)) >> page_shift;
+  return (vsid & ((1ULL << 39) - 1)) ^ page;
+}
+
+static inline uint64_t hpt_hash(uint64_t vsid, uint64_t ea) {
+  return hpt_hash_shift(vsid, ea, HPT_PAGE_SHIFT);
+}
+
+// the virtual address is 65 bits, so it only ever exists split up: the virtual page number is
+// va >> 12, which fits, and the avpn in dword 0 is va >> 23, (vsid << 5) | the top 5 bits of the offset
+static inline uint64_t hpt_seg_offset(uint64_t ea) {
+  return ea & ((1ULL << HPT_SEGMENT_SHIFT) - 1);
+}
+
+static inline uint64_t hpt_vpn(uint64_t vsid, uint64_t ea) {
+  return (vsid << (HPT_SEGMENT_SHIFT - HPT_PAGE_SHIFT)) | (hpt_seg_offset(ea) >> HPT_PAGE_SHIFT);
+}
+
+static inline uint64_t hpte_v(uint64_t vsid, uint64_t ea) {
+  uint64_t avpn = (vsid << (HPT_SEGMENT_SHIFT - 23)) | (hpt_seg_offset(ea) >> 23);
+  return (avpn << HPTE_V_AVPN_SHIFT) | HPTE_V_VALID;
+}
+
+// rebuilds the virtual page number of the page held by `v` in slot `ptex`, for flushing an evicted entry
+static inline uint64_t hpte_vpn(uint64_t v, uint64_t ptex) {
+  uint64_t avpn = v >> HPTE_V_AVPN_SHIFT;
+  // a large page starts on a 16MB boundary, the avpn already holds all of its page index
+  if (v & HPTE_V_LARGE) return avpn << (23 - HPT_PAGE_SHIFT);
+  uint64_t vsid = avpn >> (HPT_SEGMENT_SHIFT - 23);
+  uint64_t group = ptex / HPT_PTEG_SLOTS;
+  if (v & HPTE_V_SECONDARY) group = ~group;
+  // the avpn holds the top 5 bits of the page index, the hash gives back the low 11
+  uint64_t page = (group ^ vsid) & 0x7ff;
+  return (avpn << (23 - HPT_PAGE_SHIFT)) | page;
+}
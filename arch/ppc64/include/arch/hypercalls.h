@@ -1,13 +1,45 @@
 #pragma once
 
+#include <stdint.h>
+
 // look for spapr_register_hypercall() in qemu
+#define H_REMOVE                0x04
 #define H_ENTER                 0x08
+#define H_READ                  0x10
+#define H_PROTECT               0x18
+#define H_BULK_REMOVE           0x24
+#define H_EOI                   0x64
+#define H_CPPR                  0x68
+#define H_IPI                   0x6c
+#define H_XIRR                  0x74
+#define H_CEDE                  0xe0
+#define H_VIO_SIGNAL            0x104
 #define H_GET_TERM_CHAR         0x54
 #define H_PUT_TERM_CHAR         0x58
+#define KVMPPC_H_RTAS           0xf000
+
+// status codes, returned in r3
+#define H_SUCCESS               0
+#define H_PTEG_FULL             (-6)
+#define H_NOT_FOUND             (-14)
 
 uint64_t do_hypercall4(uint32_t opcode, uint64_t a, uint64_t b, uint64_t c, uint64_t d);
+// for hypercalls that return more than a status, r4-r11 are copied into ret[]
+uint64_t do_hypercall_ret(uint32_t opcode, uint64_t ret[8], uint64_t a, uint64_t b, uint64_t c, uint64_t d,
+                          uint64_t e, uint64_t f, uint64_t g, uint64_t h);
 
+#define H_READ_4          (1ULL<<(63-6))        /* Return the 4 PTEs of the aligned group */
 #define H_EXACT           (1ULL<<(63-24))       /* Use exact PTE or return H_PTEG_FULL */
+#define H_AVPN            (1ULL<<(63-32))       /* An avpn is provided as a sanity test */
+#define H_ANDCOND         (1ULL<<(63-33))       /* Fail if any of the given pte0 bits are set */
+
+// H_BULK_REMOVE translation specifier high words, the low words are the avpn
+#define HBR_REQUEST       (1ULL<<62)
+#define HBR_RESPONSE      (2ULL<<62)
+#define HBR_END           (3ULL<<62)
+#define HBR_AVPN          (1ULL<<57)            /* same check as H_AVPN */
+#define HBR_RC(tsh)       (((tsh) >> 60) & 3)   /* 0 removed, 1 not found, 2 bad parameter, 3 hardware error */
+#define HBR_MAX           4
 static inline uint64_t h_enter(uint64_t flags, uint64_t ptex, uint64_t pte0, uint64_t pte1) {
   return do_hypercall4(H_ENTER, flags, ptex, pte0, pte1);
 }
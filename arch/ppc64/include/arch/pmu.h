@@ -0,0 +1,45 @@
+#pragma once
+
+#include <kernel/thread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+// events the perf api knows how to count, the encoding behind each one is per core model
+enum pmu_event {
+  PMU_CYCLES,
+  PMU_INSTRUCTIONS,
+  PMU_L1D_MISS,
+  PMU_L2_MISS,
+  PMU_ERAT_MISS,
+  PMU_TLB_MISS,
+  PMU_NUM_EVENTS
+};
+
+#define PMU_EVENT_BIT(e) (1U << (e))
+
+struct ppc64_iframe;
+
+struct pmu_counts {
+  uint64_t count[PMU_NUM_EVENTS];
+};
+
+void ppc64_pmu_init(void);
+const char *pmu_model_name(void);
+const char *pmu_event_name(enum pmu_event e);
+// bitmask of the events the running core can count
+uint32_t pmu_available_events(void);
+
+// starts counting `events` on every cpu, each thread accumulates its own counts from here on
+status_t pmu_enable(uint32_t events);
+void pmu_disable(void);
+uint32_t pmu_enabled_events(void);
+
+// counts accumulated by `t`, including what is still in the counters if `t` is running here
+void pmu_read_thread(thread_t *t, struct pmu_counts *out);
+
+// called from arch_context_switch() while the pmu is enabled
+extern bool ppc64_pmu_active;
+void ppc64_pmu_context_switch(thread_t *oldthread, thread_t *newthread);
+// the performance monitor exception, folds the counters before they wrap
+enum handler_return ppc64_pmu_irq(struct ppc64_iframe *frame);
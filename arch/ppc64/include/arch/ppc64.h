@@ -0,0 +1,292 @@
+#pragma once
+
+#include <arch/defines.h>
+
+// MSR bits
+#define MSR_SF  (1ULL << 63)
+#define MSR_HV  (1ULL << 60)
+#define MSR_VEC (1 << 25)
+#define MSR_POW (1 << 18)
+#define MSR_EE  0x8000
+#define MSR_PR  0x4000
+#define MSR_FP  0x2000
+#define MSR_ME  0x1000
+#define MSR_IR  0x20
+#define MSR_DR  0x10
+#define MSR_PMM 0x4
+#define MSR_RI  0x2
+
+// SRR1 of the system reset that restarts a paused thread (cell and xenon), which interrupt woke it
+#define SRR1_WAKE_MASK  0x00380000
+#define SRR1_WAKE_EE    0x00200000
+#define SRR1_WAKE_DEC   0x00180000
+
+// offsets into struct ppc64_percpu, for use from assembly
+#define PERCPU_CURRENT_THREAD 0
+#define PERCPU_CPU_NUM        8
+#define PERCPU_HW_ID          12
+#define PERCPU_BOOT_STACK     16
+#define PERCPU_EX_R9          64
+#define PERCPU_EX_R10         72
+#define PERCPU_EX_R11         80
+#define PERCPU_EX_R12         88
+#define PERCPU_EX_TB          96
+#define PERCPU_EX_COMMON      104
+#define PERCPU_EX_FAST        112
+#define PERCPU_FP_LIVE        120
+#define PERCPU_SIZE           CACHE_LINE
+
+// struct ppc64_fp_state and struct ppc64_vmx_state, see arch/arch_thread.h
+#define FP_STATE_FPSCR        256
+#define VMX_STATE_VSCR        512
+#define VMX_STATE_VRSAVE      528
+
+// struct ppc64_iframe, starts with a minimal ELFv2 stack frame header so C can be called with r1 pointing at it
+#define IFRAME_GPR(n)   (32 + 8 * (n))
+#define IFRAME_LR       288
+#define IFRAME_CTR      296
+#define IFRAME_XER      304
+#define IFRAME_CR       312
+#define IFRAME_SRR0     320
+#define IFRAME_SRR1     328
+#define IFRAME_VECTOR   336
+#define IFRAME_HV       344
+#define IFRAME_TB       352
+#define IFRAME_DAR      360
+#define IFRAME_DSISR    368
+#define IFRAME_FULL     376
+#define IFRAME_SIZE     384
+
+// ELFv2 lets leaf functions use 288 bytes below r1, the exception entry must skip it
+#define STACK_RED_ZONE  288
+
+// where xell and _start hold the secondary threads, from the start of the image
+#define PPC64_SECONDARY_HOLD 0x60
+
+// struct ppc64_chain_params, the words the chain load trampoline in boot.S works from
+#define CHAIN_GO              0
+#define CHAIN_DEST            8
+#define CHAIN_SRC             16
+#define CHAIN_LEN             24
+#define CHAIN_ENTRY           32
+#define CHAIN_BLOCK           40
+#define CHAIN_PARAMS_SIZE     48
+
+// byte offset of the `li r9, hv` in each exception stub, patched when a vector uses HSRR0/1
+#define EXC_STUB_HV_OFFSET 40
+
+#ifndef ASSEMBLY
+
+#include <lk/compiler.h>
+#include <sys/types.h>
+#include <stdint.h>
+
+struct thread;
+struct arch_aspace;
+
+// one per hardware thread, r13 always points at the entry of the running cpu
+// each entry is padded to whole cache lines, so the cpus dont false-share
+struct ppc64_percpu {
+  struct thread *current_thread;  // 0
+  uint32_t cpu_num;               // 8
+  uint32_t hw_id;                 // 12, PIR on xenon, interrupt server# on pseries
+  uint64_t boot_stack;            // 16, initial r1 for secondary cpus
+  volatile uint32_t ipi_pending;  // 24, bitmask of mp_ipi_t and PPC64_IPI_PARK
+  volatile uint32_t online;       // 28
+  int64_t tb_skew;                // 32, timebase difference to cpu 0, measured at bring-up
+  uint32_t pmu_gen;                // 40, pmu configuration last programmed on this cpu
+  volatile uint32_t idle_state;   // 44, 1 + idle state while arch_idle waits, the waking interrupt clears it
+  uint64_t pmu_tb_start;          // 48, timebase when the current thread was switched in
+  uint64_t idle_wake;             // 56, entry timebase of that interrupt
+
+  // scratch space for the exception stubs, see boot.S
+  uint64_t ex_r9;                 // 64
+  uint64_t ex_r10;                // 72
+  uint64_t ex_r11;                // 80
+  uint64_t ex_r12;                // 88
+  uint64_t ex_tb;                 // 96, timebase at vector entry
+  uint64_t ex_common;             // 104, address of ppc64_exc_common
+  uint64_t ex_fast;               // 112, address of ppc64_exc_fast
+
+  uint64_t fp_live;               // 120, MSR_FP | MSR_VEC, units holding the current thread's registers
+} __ALIGNED(CACHE_LINE);
+
+extern struct ppc64_percpu ppc64_percpu[SMP_MAX_CPUS];
+
+static inline struct ppc64_percpu *ppc64_get_percpu(void) {
+  struct ppc64_percpu *p;
+  __asm__ volatile("mr %0, %%r13" : "=r"(p));
+  return p;
+}
+
+static inline struct ppc64_percpu *ppc64_get_percpu_for(uint cpu) {
+  return &ppc64_percpu[cpu];
+}
+
+struct ppc64_iframe {
+  uint64_t backchain;
+  uint64_t cr_save;
+  uint64_t lr_save;
+  uint64_t toc_save;
+  uint64_t gpr[32];   // r14-r31 are only valid when `full` is set
+  uint64_t lr;
+  uint64_t ctr;
+  uint64_t xer;
+  uint64_t cr;
+  uint64_t srr0;
+  uint64_t srr1;
+  uint64_t vector;
+  uint64_t hv;        // taken through HSRR0/HSRR1
+  uint64_t entry_tb;
+  uint64_t dar;
+  uint64_t dsisr;
+  uint64_t full;
+};
+
+// core cycles per timebase tick, for arch_cycle_count(), see pmu.c
+extern uint32_t ppc64_cycles_per_tb;
+
+static inline uint64_t mfmsr(void) {
+  uint64_t msr;
+  __asm__ volatile("mfmsr %0" : "=r"(msr));
+  return msr;
+}
+
+// arch.c
+// bytes zeroed by one dcbz, measured while clearing bss, 0 if it could not be
+extern size_t ppc64_dcbz_size;
+
+// cache.c
+// cache block sizes the range ops step by, from the pvr, a platform may refine them from its device tree
+extern uint32_t ppc64_dcache_block;
+extern uint32_t ppc64_icache_block;
+void ppc64_cache_init(void);
+void ppc64_cache_set_block_size(uint32_t dblock, uint32_t iblock);
+
+// starts another kernel in place of this one, `len` bytes staged at `image`, anywhere in the linear map,
+// are copied to real address `load` once everything else has stopped, then entered at real address `entry`
+// like _start, in real mode on cpu 0 with r3-r6 = arg0-arg3, the other cpus are handed to platform_park_cpu
+// only returns when no page for the trampoline could be found clear of both ranges
+status_t ppc64_chain_load(const void *image, size_t len, uint64_t load, uint64_t entry,
+                          ulong arg0, ulong arg1, ulong arg2, ulong arg3);
+
+// boot.S
+// r3 = the real address to start at, r4-r7 become its r3-r6, leaves with translation, interrupts, fp and vmx off
+void ppc64_chain_enter(uint64_t entry, uint64_t r3, uint64_t r4, uint64_t r5, uint64_t r6) __NO_RETURN;
+
+// what the chain load trampoline works from, at ppc64_chain_tramp_params in its copy
+struct ppc64_chain_params {
+  uint64_t go;      // 0 until the image is in place, then where the secondaries jump
+  uint64_t dest;
+  uint64_t src;
+  uint64_t len;     // a multiple of 8
+  uint64_t entry;
+  uint64_t block;   // the step for dcbst and icbi
+};
+
+// mp.c
+// not an mp_ipi_t, sent by ppc64_chain_load to take the other cpus out of the kernel
+#define PPC64_IPI_PARK 31
+
+void ppc64_mp_init(void);
+enum handler_return ppc64_mp_handle_ipi(void);
+// sends every online secondary to platform_park_cpu(entry), false if one of them did not go
+bool ppc64_mp_park_secondaries(uint64_t entry);
+void ppc64_secondary_entry(uint cpu) __NO_RETURN;
+void ppc64_secondary_start(uint cpu); // boot.S, entry point handed to the platform
+
+// boottime.c
+// adds a timebase stamp to the boot timeline, `name` must stay valid
+void ppc64_boot_mark(const char *name);
+
+// exceptions.c
+void ppc64_exceptions_init(void);
+void ppc64_exceptions_init_percpu(void);
+void ppc64_dump_iframe(const struct ppc64_iframe *frame);
+
+// fpu.c
+void ppc64_fpu_init_percpu(void);
+bool ppc64_fpu_unavailable(struct ppc64_iframe *frame);
+void ppc64_fpu_context_switch(struct thread *oldthread);
+
+// idle.c
+// a way for a cpu to wait, shallowest first, arch_idle picks one from the next timer deadline
+struct ppc64_idle_state {
+  const char *name;
+  // entered with interrupts disabled, returns with them enabled once an interrupt has been taken
+  // or an ipi is pending, returning early is fine
+  // only used when arch_idle was called with interrupts enabled
+  void (*enter)(void);
+  uint32_t latency_us;  // wake latency to assume until it has been measured
+};
+
+void ppc64_idle_init(void);
+// deeper states than the spin every cpu has, none by default
+const struct ppc64_idle_state *platform_idle_states(uint *count);
+// called by the interrupt paths, ends the idle state this cpu was in
+static inline void ppc64_idle_wake(const struct ppc64_iframe *frame) {
+  struct ppc64_percpu *p = ppc64_get_percpu();
+  if (!p->idle_state) return;
+  __asm__ volatile("or 2,2,2"); // back to medium smt priority, in case the spin state lowered it
+  p->idle_wake = frame->entry_tb;
+  p->idle_state = 0;
+}
+
+// mmu.c
+void ppc64_mmu_init_percpu(void);
+bool ppc64_mmu_fault(struct ppc64_iframe *frame);
+bool ppc64_mmu_segment(vaddr_t ea, uint32_t *ctx, bool *large);
+// ppc64_chain_load, drops to real mode and empties the page table
+void ppc64_mmu_quiesce(void);
+// changes only the ARCH_MMU_FLAG_PERM_* bits of the pages mapped in the range, holes are skipped
+status_t ppc64_mmu_protect(struct arch_aspace *aspace, vaddr_t vaddr, uint count, uint flags);
+
+// slb.c
+// reserve one of the low entries for kernel segment `esid`, false once they are all taken
+bool ppc64_slb_bolt(uint64_t esid);
+void ppc64_slb_init_percpu(void);
+bool ppc64_slb_miss(struct ppc64_iframe *frame);
+void ppc64_slb_flush(void);
+
+// timer.c
+void ppc64_timer_init_percpu(void);
+enum handler_return ppc64_decrementer_irq(struct ppc64_iframe *frame);
+enum handler_return ppc64_hdecrementer_irq(struct ppc64_iframe *frame);
+
+// ksyms.c
+// true if `addr` is inside the kernel image
+bool ppc64_kernel_addr(uint64_t addr);
+// the text symbol `addr` falls in, from the table ksyms.sh fills in after the link, `start` gets its address
+// NULL without a table or for an address outside the kernel
+const char *ppc64_ksym(uint64_t addr, uint64_t *start);
+
+// profile.c
+// return addresses up the ELFv2 back chain from stack pointer `sp`, innermost first, stores at most `max`
+// into `pcs` and returns how many, reads nothing outside of `lo` to `hi`
+uint ppc64_backchain(uint64_t sp, uint64_t lo, uint64_t hi, uint64_t *pcs, uint max);
+// samples every online cpu `hz` times a second until stopped, keeping the first `samples` of each cpu
+status_t ppc64_profile_start(uint hz, uint samples);
+void ppc64_profile_stop(void);
+// samples taken on `cpu` since the last start
+uint ppc64_profile_count(uint cpu);
+
+// platform hooks for secondary cpu bring-up
+// platform_secondary_cpu_count() may also fill in the hw_id of each cpu
+uint platform_secondary_cpu_count(void);
+// start logical cpu `cpu`, it must enter ppc64_secondary_start with r3 = cpu
+status_t platform_start_secondary_cpu(uint cpu);
+// nudge `cpu` after an ipi was queued for it
+void platform_send_ipi(uint cpu);
+// true if the timebase may be written by this kernel (hypervisor state)
+bool platform_timebase_writable(void);
+// takes the calling secondary out of the kernel for a chain load to the image at real address `entry`
+// runs in real mode with interrupts off, the default jumps to the new image's secondary hold
+void platform_park_cpu(uint64_t entry) __NO_RETURN;
+
+// platform interrupt controller hooks
+enum handler_return platform_irq(struct ppc64_iframe *frame);
+void platform_irq_init_percpu(void);
+// true if external interrupts are delivered through HSRR0/HSRR1
+bool platform_external_irq_hv(void);
+
+#endif // ASSEMBLY
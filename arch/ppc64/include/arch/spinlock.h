@@ -4,23 +4,78 @@
 
 #define SPIN_LOCK_INITIAL_VALUE (0)
 
+// ticket lock, the upper halfword is the next ticket to hand out,
+// the lower halfword is the ticket currently being served
 typedef unsigned int spin_lock_t;
 
 typedef unsigned int spin_lock_saved_state_t;
 typedef unsigned int spin_lock_save_flags_t;
 
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define SPIN_LOCK_OWNER_HALF 1
+#else
+#define SPIN_LOCK_OWNER_HALF 0
+#endif
+
+// operands used as RA of addis or as the base of a d-form load take "b", with r0 there the
+// instruction would see a literal 0
 static inline void arch_spin_lock(spin_lock_t *lock) {
-    // TODO, actually spin
-    // it only works, because its set to single-core mode, and irq's are turned off before getting the lock
-    *lock = 1;
+    unsigned int old, tmp;
+
+    // take a ticket
+    __asm__ volatile(
+        "1: lwarx   %0, 0, %2\n"
+        "   addis   %1, %0, 1\n"
+        "   stwcx.  %1, 0, %2\n"
+        "   bne-    1b\n"
+        : "=&b"(old), "=&r"(tmp)
+        : "r"(lock)
+        : "cr0", "memory");
+
+    // wait for it to be served, at low smt priority so the sibling thread gets the issue slots
+    __asm__ volatile(
+        "   clrlwi  %0, %2, 16\n"
+        "   cmpw    %0, %3\n"
+        "   beq+    3f\n"
+        "   or      1,1,1\n"
+        "2: lwz     %0, 0(%1)\n"
+        "   clrlwi  %0, %0, 16\n"
+        "   cmpw    %0, %3\n"
+        "   bne-    2b\n"
+        "   or      2,2,2\n"
+        "3: isync\n"
+        : "=&r"(tmp)
+        : "b"(lock), "r"(old), "r"(old >> 16)
+        : "cr0", "memory");
 }
 
+// returns 0 if the lock was taken
 static inline int arch_spin_trylock(spin_lock_t *lock) {
-    return 0;
+    unsigned int old, tmp;
+
+    __asm__ volatile(
+        "1: lwarx   %0, 0, %2\n"
+        "   rotlwi  %1, %0, 16\n"
+        "   cmpw    %1, %0\n"
+        "   bne-    2f\n"
+        "   addis   %1, %0, 1\n"
+        "   stwcx.  %1, 0, %2\n"
+        "   bne-    1b\n"
+        "   isync\n"
+        "2:\n"
+        : "=&b"(old), "=&r"(tmp)
+        : "r"(lock)
+        : "cr0", "memory");
+
+    return (old >> 16) != (old & 0xffff);
 }
 
 static inline void arch_spin_unlock(spin_lock_t *lock) {
-    *lock = 0;
+    volatile unsigned short *owner = (volatile unsigned short *)lock + SPIN_LOCK_OWNER_HALF;
+
+    // only the holder writes the owner half, so a plain store is enough once the critical section is ordered
+    __asm__ volatile("lwsync" ::: "memory");
+    *owner = *owner + 1;
 }
 
 static inline void arch_spin_lock_init(spin_lock_t *lock) {
@@ -28,7 +83,8 @@ static inline void arch_spin_lock_init(spin_lock_t *lock) {
 }
 
 static inline bool arch_spin_lock_held(spin_lock_t *lock) {
-    return *lock != 0;
+    unsigned int val = *(volatile spin_lock_t *)lock;
+    return (val >> 16) != (val & 0xffff);
 }
 
 /* default arm flag is to just disable plain irqs */
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <arch/cpu_regs.h>
+#include <stdint.h>
+
+// raw timebase ticks, for hot paths that want a timestamp now and a conversion later (or never)
+typedef uint64_t lk_ticks_t;
+
+static inline lk_ticks_t lk_ticks(void) {
+  return tbl_read();
+}
+
+// x * (whole + frac / 2^64), a multiply and a mulhdu instead of a divide
+struct tb_scale {
+  uint64_t whole;
+  uint64_t frac;
+};
+
+static inline uint64_t tb_scale_apply(const struct tb_scale *s, uint64_t x) {
+  return x * s->whole + (uint64_t)(((unsigned __int128)x * s->frac) >> 64);
+}
+
+// num / den as a whole part and a 64 bit binary fraction
+struct tb_scale tb_scale_make(uint64_t num, uint64_t den);
+
+// filled in by ppc64_timebase_init()
+extern uint64_t ppc64_tb_freq;
+extern struct tb_scale ppc64_tb_to_ns, ppc64_tb_to_us, ppc64_tb_to_ms;
+extern struct tb_scale ppc64_us_to_tb;
+
+static inline uint64_t lk_ticks_freq(void) {
+  return ppc64_tb_freq;
+}
+
+static inline uint64_t lk_ticks_to_ns(lk_ticks_t ticks) {
+  return tb_scale_apply(&ppc64_tb_to_ns, ticks);
+}
+
+static inline uint64_t lk_ticks_to_us(lk_ticks_t ticks) {
+  return tb_scale_apply(&ppc64_tb_to_us, ticks);
+}
+
+static inline uint64_t lk_ticks_to_ms(lk_ticks_t ticks) {
+  return tb_scale_apply(&ppc64_tb_to_ms, ticks);
+}
+
+static inline lk_ticks_t lk_us_to_ticks(uint64_t us) {
+  return tb_scale_apply(&ppc64_us_to_tb, us);
+}
+
+static inline lk_ticks_t lk_ms_to_ticks(uint64_t ms) {
+  return lk_us_to_ticks(ms * 1000);
+}
+
+// recomputes the scales, platforms call this once they know the real frequency, from platform_early_init
+// current_time() carries on from where the old frequency had it
+void ppc64_timebase_init(uint64_t freq);
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <kernel/spinlock.h>
+#include <lk/list.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+// hierarchical timer wheel, in timebase ticks
+// level n has 64 slots of 2^(5 + 6n) ticks each, so arm and cancel are O(1) list operations
+// and the next deadline is found with one bit scan per level
+#define TIMER_WHEEL_LEVELS      5
+#define TIMER_WHEEL_SLOT_BITS   6
+#define TIMER_WHEEL_SLOTS       (1 << TIMER_WHEEL_SLOT_BITS)
+#define TIMER_WHEEL_SHIFT0      5
+
+struct ppc64_timer;
+struct ppc64_iframe;
+typedef enum handler_return (*ppc64_timer_callback)(struct ppc64_timer *t, uint64_t now, void *arg);
+
+struct ppc64_timer {
+  struct list_node node;
+  uint64_t expires;       // never fires before this
+  uint64_t latest;        // expires + slack, rounded so nearby timers share a deadline
+  struct timer_wheel *wheel;
+  uint bucket;            // level * TIMER_WHEEL_SLOTS + slot, while queued
+  ppc64_timer_callback callback;
+  void *arg;
+};
+
+#define PPC64_TIMER_INITIAL_VALUE { .node = LIST_INITIAL_CLEARED_VALUE, .wheel = NULL }
+
+struct timer_wheel {
+  spin_lock_t lock;
+  uint64_t clk;           // every bucket due at or before clk has been run
+  uint64_t pending[TIMER_WHEEL_LEVELS];
+  struct list_node slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+
+  // stats
+  uint64_t runs;
+  uint64_t fired;
+  uint64_t cascaded;
+  uint64_t coalesced;     // fired before their own bucket came due
+};
+
+void timer_wheel_init(struct timer_wheel *w, uint64_t now);
+void timer_wheel_add(struct timer_wheel *w, struct ppc64_timer *t, uint64_t expires, uint64_t slack,
+                     ppc64_timer_callback callback, void *arg);
+// returns true if the timer was still pending
+bool timer_wheel_cancel(struct ppc64_timer *t);
+// the earliest tb at which timer_wheel_run() has work to do, false if the wheel is empty
+bool timer_wheel_next(struct timer_wheel *w, uint64_t *deadline);
+// runs every callback whose timer has expired by `now`, callbacks run without the wheel lock held
+enum handler_return timer_wheel_run(struct timer_wheel *w, uint64_t now);
+
+// per-cpu wheels driven by the decrementer, see timer.c
+void ppc64_timer_init(struct ppc64_timer *t);
+// arms `t` on the current cpu, `expires` and `slack` are in timebase ticks
+void ppc64_timer_arm(struct ppc64_timer *t, uint64_t expires, uint64_t slack,
+                     ppc64_timer_callback callback, void *arg);
+bool ppc64_timer_cancel(struct ppc64_timer *t);
+// what the current cpu's decrementer is programmed for, false if nothing is armed
+bool ppc64_timer_next(uint64_t *deadline);
+// what the decrementer interrupted, for the callbacks it runs, NULL outside of one
+const struct ppc64_iframe *ppc64_timer_irq_frame(void);
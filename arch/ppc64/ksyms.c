@@ -0,0 +1,96 @@
+#include <arch/ppc64.h>
+#include <kernel/mutex.h>
+#include <lk/compiler.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// the kernel's text symbols, for the profiler to put names to addresses
+// the image links with this section zeroed, ksyms.sh then writes `nm -n` of the result into it, an
+// `address name` line per symbol sorted by address, the section keeps its size so nothing moves
+// it is parsed into an index on first use, which also turns the newlines into nuls
+
+// not const, so the compiler cannot fold reads of it to the zeroes it is linked with
+char ppc64_ksyms[PPC64_KSYMS_SIZE] __SECTION(".ksyms") __ALIGNED(8);
+
+extern uint8_t _start[], _end[];
+
+struct ksym {
+  uint64_t addr;
+  const char *name;
+};
+
+static mutex_t ksyms_lock = MUTEX_INITIAL_VALUE(ksyms_lock);
+static bool ksyms_parsed;
+static struct ksym *ksyms;
+static uint nksyms;
+
+bool ppc64_kernel_addr(uint64_t addr) {
+  return addr >= (uint64_t)_start && addr < (uint64_t)_end;
+}
+
+static int hex_digit(char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+// a line that does not parse ends the table
+static void ksyms_parse(void) {
+  char *end = memchr(ppc64_ksyms, 0, sizeof(ppc64_ksyms));
+  if (!end || end == ppc64_ksyms) return;
+
+  uint lines = 0;
+  for (char *p = ppc64_ksyms; p < end; p++) {
+    if (*p == '\n') lines++;
+  }
+  ksyms = malloc(lines * sizeof(*ksyms));
+  if (!ksyms) return;
+
+  char *p = ppc64_ksyms;
+  while (nksyms < lines) {
+    uint64_t addr = 0;
+    int d;
+    char *start = p;
+    while ((d = hex_digit(*p)) >= 0) {
+      addr = addr << 4 | d;
+      p++;
+    }
+    if (p == start || *p != ' ') break;
+    char *name = ++p;
+    char *nl = memchr(p, '\n', end - p);
+    if (!nl || nl == name) break;
+    *nl = '\0';
+    p = nl + 1;
+    ksyms[nksyms++] = (struct ksym){ addr, name };
+  }
+}
+
+const char *ppc64_ksym(uint64_t addr, uint64_t *start) {
+  if (!ppc64_kernel_addr(addr)) return NULL;
+
+  if (!__atomic_load_n(&ksyms_parsed, __ATOMIC_ACQUIRE)) {
+    mutex_acquire(&ksyms_lock);
+    if (!ksyms_parsed) {
+      ksyms_parse();
+      __atomic_store_n(&ksyms_parsed, true, __ATOMIC_RELEASE);
+    }
+    mutex_release(&ksyms_lock);
+  }
+
+  // the last symbol at or below addr
+  uint lo = 0, hi = nksyms;
+  while (lo < hi) {
+    uint mid = lo + (hi - lo) / 2;
+    if (ksyms[mid].addr <= addr) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  if (lo == 0) return NULL;
+  if (start) *start = ksyms[lo - 1].addr;
+  return ksyms[lo - 1].name;
+}
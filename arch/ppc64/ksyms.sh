@@ -0,0 +1,33 @@
+#!/bin/sh
+# fills the .ksyms section of a linked kernel with its text symbols, an `address name` line each sorted by
+# address and padded with nuls to the section's size, see ksyms.c
+# usage: ksyms.sh lk.elf stamp, NM, OBJDUMP and OBJCOPY name the target's binutils
+
+set -e
+
+elf=$1
+stamp=$2
+NM=${NM:-nm}
+OBJDUMP=${OBJDUMP:-objdump}
+OBJCOPY=${OBJCOPY:-objcopy}
+
+hex=$($OBJDUMP -h "$elf" | awk '$2 == ".ksyms" { print $3 }')
+if [ -z "$hex" ]; then
+  echo "$elf has no .ksyms section" >&2
+  exit 1
+fi
+size=$(printf '%d' "0x$hex")
+
+$NM -n --defined-only "$elf" | awk 'NF == 3 && ($2 == "T" || $2 == "t" || $2 == "W") { print $1, $3 }' > "$stamp.tmp"
+used=$(wc -c < "$stamp.tmp")
+# at least one nul has to be left to end the table
+if [ "$used" -ge "$size" ]; then
+  echo "symbols need $used bytes, .ksyms has $size, raise PPC64_KSYMS_SIZE" >&2
+  rm -f "$stamp.tmp"
+  exit 1
+fi
+truncate -s "$size" "$stamp.tmp"
+$OBJCOPY --update-section .ksyms="$stamp.tmp" "$elf"
+mv "$stamp.tmp" "$stamp"
+# objcopy has just rewritten the elf, the stamp has to be newer than it or make reruns this every time
+touch "$stamp"
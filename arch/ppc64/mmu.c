@@ -1,33 +1,652 @@
+#include <arch/hpt.h>
 #include <arch/mmu.h>
+#include <arch/ops.h>
+#include <arch/ppc64.h>
+#include <arch/ticks.h>
+#include <kernel/spinlock.h>
+#include <lk/console_cmd.h>
+#include <lk/debug.h>
+#include <lk/err.h>
+#include <lk/init.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if WITH_KERNEL_VM
+#include <kernel/vm.h>
+
+// the kernel aspace starts with the linear map
+STATIC_ASSERT(KERNEL_ASPACE_BASE == PPC64_LINEAR_BASE);
+#endif
+
+// hashed page table engine
+// every mapping lives in a per aspace radix tree of software ptes, the hpt only caches them
+// so a full PTEG pair can evict anything that is not bolted, and the storage fault puts it back
+
+#define RADIX_BITS        9
+#define RADIX_ENTRIES     (1 << RADIX_BITS)
+#define RADIX_TABLE_SIZE  (RADIX_ENTRIES * sizeof(uint64_t))
+#define RADIX_LEVELS      4 // 36 bits of page index, 256TB per aspace
+
+// tables for the initial mappings, which go in before the heap exists
+#define RADIX_BOOT_TABLES 8
+
+// software pte, the leaves of the radix tree
+#define SPTE_PRESENT      0x1ULL
+#define SPTE_HASHED       0x2ULL // the slot hint is set, the hpt copy may have been evicted since
+#define SPTE_SECONDARY    0x4ULL
+#define SPTE_SLOT_SHIFT   3
+#define SPTE_SLOT_MASK    (0x7ULL << SPTE_SLOT_SHIFT)
+#define SPTE_FLAGS_SHIFT  6      // ARCH_MMU_FLAG_* bits 0-4
+#define SPTE_FLAGS_MASK   (0x1fULL << SPTE_FLAGS_SHIFT)
+#define SPTE_BOLTED       0x800ULL
+#define SPTE_PA_MASK      (~0xfffULL)
+
+#define DSISR_NOPTE       0x40000000 // no pte in either PTEG
+#define SRR1_ISI_NOPTE    0x40000000
+
+// user aspaces get contexts from 1 up, hpt_vsid() has room for 16 bits of them
+#define MAX_CTX           0xffff
+
+
+static struct {
+  const struct hpt_ops *ops;
+  uint64_t pteg_mask;
+  uint pteg_shift;
+  uint rr;  // round robin eviction cursor
+  spin_lock_t lock;
+  struct hpt_stats stats;
+} hpt = {
+  .lock = SPIN_LOCK_INITIAL_VALUE,
+};
+
+static arch_aspace_t *kernel_aspace;
+static arch_aspace_t *current_aspace[SMP_MAX_CPUS];
+static uint32_t next_ctx = 1;
+
+// the linear map at PPC64_LINEAR_BASE, and its identity alias at 0 that the kernel image runs from
+static struct {
+  uint64_t size;    // ram covered, in whole large pages
+  uint64_t span;    // size in whole segments
+  bool translated;  // the large pages are in and the mmu is on
+} linear;
+
+static uint64_t radix_boot[RADIX_BOOT_TABLES][RADIX_ENTRIES] __ALIGNED(RADIX_TABLE_SIZE);
+static uint radix_boot_used;
+static uint64_t *radix_free_list;
+
+static uint64_t *radix_alloc(void) {
+  uint64_t *t = NULL;
+  spin_lock_saved_state_t state;
+  spin_lock_irqsave(&hpt.lock, state);
+  if (radix_free_list) {
+    t = radix_free_list;
+    radix_free_list = (uint64_t *)t[0];
+  } else if (radix_boot_used < RADIX_BOOT_TABLES) {
+    t = radix_boot[radix_boot_used++];
+  }
+  spin_unlock_irqrestore(&hpt.lock, state);
+
+  if (!t) t = memalign(RADIX_TABLE_SIZE, RADIX_TABLE_SIZE);
+  if (t) memset(t, 0, RADIX_TABLE_SIZE);
+  return t;
+}
+
+// caller holds hpt.lock
+static void radix_free(uint64_t *t) {
+  t[0] = (uint64_t)radix_free_list;
+  radix_free_list = t;
+}
+
+// the leaf for `va`, allocating the tables above it if `alloc`
+// map and unmap are serialized per aspace by the vmm, the fault path only ever reads
+static uint64_t *radix_leaf(arch_aspace_t *aspace, vaddr_t va, bool alloc) {
+  uint64_t index = (va - aspace->base) >> HPT_PAGE_SHIFT;
+  uint64_t *table = aspace->radix;
+  for (int level = RADIX_LEVELS - 1; level > 0; level--) {
+    uint64_t *entry = &table[(index >> (level * RADIX_BITS)) & (RADIX_ENTRIES - 1)];
+    if (!*entry) {
+      if (!alloc) return NULL;
+      uint64_t *next = radix_alloc();
+      if (!next) return NULL;
+      // zeroed before a faulting cpu can walk into it
+      __asm__ volatile("lwsync" ::: "memory");
+      *entry = (uint64_t)next;
+    }
+    table = (uint64_t *)*entry;
+  }
+  return &table[index & (RADIX_ENTRIES - 1)];
+}
+
+static bool in_aspace(const arch_aspace_t *aspace, vaddr_t va) {
+  return aspace && va >= aspace->base && va - aspace->base < aspace->size;
+}
+
+static uint64_t spte_to_r(uint64_t spte) {
+  uint flags = (spte & SPTE_FLAGS_MASK) >> SPTE_FLAGS_SHIFT;
+  // referenced and changed up front, so the hardware never has to write the table back
+  uint64_t r = (spte & SPTE_PA_MASK & HPTE_R_RPN_MASK) | HPTE_R_R | HPTE_R_C;
+  switch (flags & ARCH_MMU_FLAG_CACHE_MASK) {
+    case ARCH_MMU_FLAG_CACHED:
+      r |= HPTE_R_M;
+      break;
+    default:
+      r |= HPTE_R_I | HPTE_R_G;
+      break;
+  }
+  r |= (flags & ARCH_MMU_FLAG_PERM_RO) ? HPTE_R_PP_RO : HPTE_R_PP_RW;
+  if (flags & ARCH_MMU_FLAG_PERM_NO_EXECUTE) r |= HPTE_R_N;
+  return r;
+}
+
+// puts `spte` into the hpt and records where it went, caller holds hpt.lock
+static status_t hpt_insert(const arch_aspace_t *aspace, vaddr_t ea, uint64_t *spte) {
+  const struct hpt_ops *ops = hpt.ops;
+  uint64_t vsid = hpt_vsid(aspace->ctx, ea >> HPT_SEGMENT_SHIFT);
+  uint64_t hash = hpt_hash(vsid, ea);
+  uint64_t v = hpte_v(vsid, ea);
+  if (*spte & SPTE_BOLTED) v |= HPTE_V_BOLTED;
+  uint64_t r = spte_to_r(*spte);
+  uint64_t primary = (hash & hpt.pteg_mask) * HPT_PTEG_SLOTS;
+  uint64_t secondary = (~hash & hpt.pteg_mask) * HPT_PTEG_SLOTS;
+
+  bool second = false;
+  long ptex = ops->insert(primary, v, r, false);
+  if (ptex < 0) {
+    second = true;
+    ptex = ops->insert(secondary, v | HPTE_V_SECONDARY, r, false);
+  }
+  if (ptex < 0) {
+    // both groups full, take the next non-bolted slot of the 16
+    for (uint tries = 0; tries < 2 * HPT_PTEG_SLOTS && ptex < 0; tries++) {
+      uint victim = hpt.rr++ % (2 * HPT_PTEG_SLOTS);
+      second = victim >= HPT_PTEG_SLOTS;
+      uint64_t slot = (second ? secondary : primary) + victim % HPT_PTEG_SLOTS;
+      if (!ops->evict(slot)) continue;
+      hpt.stats.evictions++;
+      ptex = ops->insert(slot, second ? v | HPTE_V_SECONDARY : v, r, true);
+    }
+    if (ptex < 0) return ERR_NO_MEMORY;
+  }
+
+  hpt.stats.inserts++;
+  if (second) hpt.stats.secondary++;
+  *spte &= ~(SPTE_SECONDARY | SPTE_SLOT_MASK);
+  *spte |= SPTE_HASHED | (second ? SPTE_SECONDARY : 0) | ((ptex % HPT_PTEG_SLOTS) << SPTE_SLOT_SHIFT);
+  return NO_ERROR;
+}
+
+// a bolted 16MB page of the linear map or its alias, the kernel runs out of these so they never leave
+static status_t hpt_insert_large(vaddr_t ea, paddr_t pa) {
+  uint64_t vsid = hpt_vsid(0, ea >> HPT_SEGMENT_SHIFT);
+  uint64_t hash = hpt_hash_shift(vsid, ea, HPT_LARGE_SHIFT);
+  uint64_t v = hpte_v(vsid, ea) | HPTE_V_LARGE | HPTE_V_BOLTED;
+  // LP 0 selects the first large page size
+  uint64_t r = (pa & HPTE_R_RPN_MASK) | HPTE_R_R | HPTE_R_C | HPTE_R_M | HPTE_R_PP_RW;
+
+  long ptex = hpt.ops->insert((hash & hpt.pteg_mask) * HPT_PTEG_SLOTS, v, r, false);
+  if (ptex < 0) ptex = hpt.ops->insert((~hash & hpt.pteg_mask) * HPT_PTEG_SLOTS, v | HPTE_V_SECONDARY, r, false);
+  if (ptex < 0) return ERR_NO_MEMORY;
+  hpt.stats.inserts++;
+  return NO_ERROR;
+}
+
+// the slot the hpt copy of a hashed `spte` went to, and the v and vpn a backend checks it against
+static uint64_t hpt_locate(const arch_aspace_t *aspace, vaddr_t ea, uint64_t spte, uint64_t *v, uint64_t *vpn) {
+  uint64_t vsid = hpt_vsid(aspace->ctx, ea >> HPT_SEGMENT_SHIFT);
+  uint64_t hash = hpt_hash(vsid, ea);
+  *vpn = hpt_vpn(vsid, ea);
+  *v = hpte_v(vsid, ea);
+  if (spte & SPTE_SECONDARY) {
+    hash = ~hash;
+    *v |= HPTE_V_SECONDARY;
+  }
+  return (hash & hpt.pteg_mask) * HPT_PTEG_SLOTS + ((spte & SPTE_SLOT_MASK) >> SPTE_SLOT_SHIFT);
+}
+
+// removes collected under one hold of hpt.lock, so the backend can do them HPT_BATCH at a time
+struct hpt_batch {
+  uint count;
+  uint64_t ptex[HPT_BATCH];
+  uint64_t v[HPT_BATCH];
+  uint64_t vpn[HPT_BATCH];
+};
+
+static void hpt_batch_flush(struct hpt_batch *b) {
+  if (!b->count) return;
+  uint done = 0;
+  if (hpt.ops->remove_batch) {
+    done = hpt.ops->remove_batch(b->ptex, b->v, b->vpn, b->count);
+  } else {
+    for (uint i = 0; i < b->count; i++) {
+      if (hpt.ops->remove(b->ptex[i], b->v[i], b->vpn[i])) done |= 1U << i;
+    }
+  }
+  uint removed = __builtin_popcount(done);
+  hpt.stats.removes += removed;
+  hpt.stats.stale += b->count - removed;
+  b->count = 0;
+}
+
+// queues the hpt copy of `spte` for removal, returns true if that filled the batch and flushed it
+static bool hpt_remove_queue(struct hpt_batch *b, const arch_aspace_t *aspace, vaddr_t ea, uint64_t spte) {
+  if (!(spte & SPTE_HASHED)) return false;
+  b->ptex[b->count] = hpt_locate(aspace, ea, spte, &b->v[b->count], &b->vpn[b->count]);
+  if (++b->count < HPT_BATCH) return false;
+  hpt_batch_flush(b);
+  return true;
+}
+
+// takes the hpt copy of `spte` out, if it is still there, caller holds hpt.lock
+static void hpt_remove(const arch_aspace_t *aspace, vaddr_t ea, uint64_t spte) {
+  struct hpt_batch b = { 0 };
+  hpt_remove_queue(&b, aspace, ea, spte);
+  hpt_batch_flush(&b);
+}
+
+// frees the tree under `table`, taking any hpt copies of its leaves with it, caller holds hpt.lock
+static void radix_destroy(struct hpt_batch *b, const arch_aspace_t *aspace, uint64_t *table, int level,
+                          uint64_t index) {
+  for (uint i = 0; i < RADIX_ENTRIES; i++) {
+    if (!table[i]) continue;
+    uint64_t sub = (index << RADIX_BITS) | i;
+    if (level > 0) {
+      radix_destroy(b, aspace, (uint64_t *)table[i], level - 1, sub);
+    } else if (table[i] & SPTE_PRESENT) {
+      hpt_remove_queue(b, aspace, aspace->base + (sub << HPT_PAGE_SHIFT), table[i]);
+    }
+  }
+  radix_free(table);
+}
+
+// segments of the linear map, or of its alias, hold nothing but large pages
+static bool linear_segment(uint64_t esid) {
+  uint64_t nseg = linear.span >> HPT_SEGMENT_SHIFT;
+  return linear.translated && (esid < nseg || esid - (PPC64_LINEAR_BASE >> HPT_SEGMENT_SHIFT) < nseg);
+}
+
+static arch_aspace_t *aspace_for(vaddr_t ea) {
+  if (in_aspace(kernel_aspace, ea)) return kernel_aspace;
+  arch_aspace_t *aspace = current_aspace[arch_curr_cpu_num()];
+  return in_aspace(aspace, ea) ? aspace : NULL;
+}
+
+// the context and page size segment `ea` is loaded with, false if nothing can be mapped in it
+bool ppc64_mmu_segment(vaddr_t ea, uint32_t *ctx, bool *large) {
+  uint64_t esid = ea >> HPT_SEGMENT_SHIFT;
+  arch_aspace_t *aspace = aspace_for(ea);
+  if (!aspace && !linear_segment(esid)) return false;
+  *ctx = aspace ? aspace->ctx : 0;
+  *large = *ctx == 0 && linear_segment(esid);
+  return true;
+}
+
+// storage faults, true if the mapping was put back and the access can be retried
+bool ppc64_mmu_fault(struct ppc64_iframe *frame) {
+  vaddr_t ea;
+  switch (frame->vector) {
+    case 0x300:
+      if (!(frame->dsisr & DSISR_NOPTE)) return false;
+      ea = frame->dar;
+      break;
+    case 0x400:
+      if (!(frame->srr1 & SRR1_ISI_NOPTE)) return false;
+      ea = frame->srr0;
+      break;
+    default:
+      return false;
+  }
+
+  arch_aspace_t *aspace = aspace_for(ea);
+  if (!aspace) return false;
+
+  uint64_t *leaf = radix_leaf(aspace, ea, false);
+  if (!leaf) return false;
+
+  bool ok = false;
+  spin_lock(&hpt.lock);
+  uint64_t spte = *leaf;
+  if (spte & SPTE_PRESENT) {
+    // another cpu may have beaten us to it, the hint is the only place a copy can be
+    hpt_remove(aspace, ea, spte);
+    ok = hpt_insert(aspace, ea, &spte) == NO_ERROR;
+    *leaf = spte;
+    hpt.stats.faults++;
+  }
+  spin_unlock(&hpt.lock);
+  return ok;
+}
 
 status_t arch_mmu_init_aspace(arch_aspace_t *aspace, vaddr_t base, size_t size, uint flags) {
-  printf("arch_mmu_init_aspace(%p, 0x%x, 0x%x, 0x%x)\n", aspace, base, size, flags);
-  return 0;
+  DEBUG_ASSERT(hpt.ops);
+  aspace->base = base;
+  aspace->size = size;
+  aspace->flags = flags;
+  aspace->radix = radix_alloc();
+  if (!aspace->radix) return ERR_NO_MEMORY;
+
+  if (flags & ARCH_ASPACE_FLAG_KERNEL) {
+    aspace->ctx = 0;
+    kernel_aspace = aspace;
+#if WITH_KERNEL_VM
+    // the vmm assumes these already work, they never leave the hpt
+    for (struct mmu_initial_mapping *m = mmu_initial_mappings; m->size; m++) {
+      // the linear map covers these already, in real mode as well as with the large pages
+      if (m->virt >= PPC64_LINEAR_BASE && m->virt - PPC64_LINEAR_BASE == m->phys && m->phys + m->size <= linear.span)
+        continue;
+      uint count = m->size >> HPT_PAGE_SHIFT;
+      bool device = m->flags & (MMU_INITIAL_MAPPING_FLAG_UNCACHED | MMU_INITIAL_MAPPING_FLAG_DEVICE);
+      uint mmu_flags = device ? ARCH_MMU_FLAG_UNCACHED_DEVICE : 0;
+      for (uint i = 0; i < count; i++) {
+        vaddr_t va = m->virt + ((vaddr_t)i << HPT_PAGE_SHIFT);
+        if (!in_aspace(aspace, va)) continue;
+        uint64_t *leaf = radix_leaf(aspace, va, true);
+        if (!leaf) return ERR_NO_MEMORY;
+        uint64_t spte = ((m->phys + ((paddr_t)i << HPT_PAGE_SHIFT)) & SPTE_PA_MASK) | SPTE_PRESENT | SPTE_BOLTED |
+                        ((uint64_t)mmu_flags << SPTE_FLAGS_SHIFT);
+        spin_lock_saved_state_t state;
+        spin_lock_irqsave(&hpt.lock, state);
+        hpt_insert(aspace, va, &spte);
+        *leaf = spte;
+        spin_unlock_irqrestore(&hpt.lock, state);
+      }
+    }
+#endif
+  } else {
+    spin_lock_saved_state_t state;
+    spin_lock_irqsave(&hpt.lock, state);
+    aspace->ctx = next_ctx <= MAX_CTX ? next_ctx++ : 0;
+    spin_unlock_irqrestore(&hpt.lock, state);
+    if (!aspace->ctx) {
+      spin_lock_irqsave(&hpt.lock, state);
+      radix_free(aspace->radix);
+      spin_unlock_irqrestore(&hpt.lock, state);
+      return ERR_NO_RESOURCES;
+    }
+  }
+  return NO_ERROR;
 }
 
 status_t arch_mmu_destroy_aspace(arch_aspace_t *aspace) {
-  printf("arch_mmu_destroy_aspace(%p)\n", aspace);
-  return 0;
+  spin_lock_saved_state_t state;
+  spin_lock_irqsave(&hpt.lock, state);
+  struct hpt_batch batch = { 0 };
+  radix_destroy(&batch, aspace, aspace->radix, RADIX_LEVELS - 1, 0);
+  hpt_batch_flush(&batch);
+  aspace->radix = NULL;
+  for (uint cpu = 0; cpu < SMP_MAX_CPUS; cpu++) {
+    if (current_aspace[cpu] == aspace) current_aspace[cpu] = NULL;
+  }
+  spin_unlock_irqrestore(&hpt.lock, state);
+  return NO_ERROR;
 }
 
 int arch_mmu_map(arch_aspace_t *aspace, vaddr_t vaddr, paddr_t paddr, uint count, uint flags) {
-  printf("arch_mmu_map(%p, 0x%x, 0x%x, %d, 0x%x)\n", aspace, vaddr, paddr, count, flags);
-  return 0;
+  if ((vaddr | paddr) & (PAGE_SIZE - 1)) return ERR_INVALID_ARGS;
+  if (!count) return NO_ERROR;
+  if (!in_aspace(aspace, vaddr) || !in_aspace(aspace, vaddr + ((vaddr_t)count << HPT_PAGE_SHIFT) - 1))
+    return ERR_OUT_OF_RANGE;
+
+  for (uint i = 0; i < count; i++) {
+    vaddr_t va = vaddr + ((vaddr_t)i << HPT_PAGE_SHIFT);
+    uint64_t *leaf = radix_leaf(aspace, va, true);
+    if (!leaf) return ERR_NO_MEMORY;
+    if (*leaf & SPTE_PRESENT) return ERR_ALREADY_EXISTS;
+
+    uint64_t spte = ((paddr + ((paddr_t)i << HPT_PAGE_SHIFT)) & SPTE_PA_MASK) | SPTE_PRESENT |
+                    ((uint64_t)(flags & 0x1f) << SPTE_FLAGS_SHIFT);
+    spin_lock_saved_state_t state;
+    spin_lock_irqsave(&hpt.lock, state);
+    // if there is no room the storage fault retries later
+    hpt_insert(aspace, va, &spte);
+    *leaf = spte;
+    spin_unlock_irqrestore(&hpt.lock, state);
+  }
+  return NO_ERROR;
 }
 
 int arch_mmu_unmap(arch_aspace_t *aspace, vaddr_t vaddr, uint count) {
-  printf("arch_mmu_unmap(%p, 0x%x, %d)\n", aspace, vaddr, count);
-  return 0;
+  if (vaddr & (PAGE_SIZE - 1)) return ERR_INVALID_ARGS;
+  if (!count) return NO_ERROR;
+  if (!in_aspace(aspace, vaddr)) return ERR_OUT_OF_RANGE;
+
+  // the lock stays held while a batch fills, so no fault can put back a page that is queued
+  struct hpt_batch batch = { 0 };
+  spin_lock_saved_state_t state;
+  spin_lock_irqsave(&hpt.lock, state);
+  for (uint i = 0; i < count; i++) {
+    vaddr_t va = vaddr + ((vaddr_t)i << HPT_PAGE_SHIFT);
+    if (!in_aspace(aspace, va)) break;
+    uint64_t *leaf = radix_leaf(aspace, va, false);
+    if (!leaf || !(*leaf & SPTE_PRESENT)) continue;
+
+    uint64_t spte = *leaf;
+    *leaf = 0;
+    if (hpt_remove_queue(&batch, aspace, va, spte)) {
+      // let interrupts in between batches
+      spin_unlock_irqrestore(&hpt.lock, state);
+      spin_lock_irqsave(&hpt.lock, state);
+    }
+  }
+  hpt_batch_flush(&batch);
+  spin_unlock_irqrestore(&hpt.lock, state);
+  return NO_ERROR;
+}
+
+status_t ppc64_mmu_protect(arch_aspace_t *aspace, vaddr_t vaddr, uint count, uint flags) {
+  const uint perm = ARCH_MMU_FLAG_PERM_USER | ARCH_MMU_FLAG_PERM_RO | ARCH_MMU_FLAG_PERM_NO_EXECUTE;
+  if (vaddr & (PAGE_SIZE - 1)) return ERR_INVALID_ARGS;
+  if (!count) return NO_ERROR;
+  if (!in_aspace(aspace, vaddr) || !in_aspace(aspace, vaddr + ((vaddr_t)count << HPT_PAGE_SHIFT) - 1))
+    return ERR_OUT_OF_RANGE;
+
+  for (uint i = 0; i < count; i++) {
+    vaddr_t ea = vaddr + ((vaddr_t)i << HPT_PAGE_SHIFT);
+    uint64_t *leaf = radix_leaf(aspace, ea, false);
+    if (!leaf || !(*leaf & SPTE_PRESENT)) continue;
+
+    spin_lock_saved_state_t state;
+    spin_lock_irqsave(&hpt.lock, state);
+    uint64_t spte = *leaf;
+    uint old = (spte & SPTE_FLAGS_MASK) >> SPTE_FLAGS_SHIFT;
+    spte = (spte & ~SPTE_FLAGS_MASK) | ((uint64_t)((old & ~perm) | (flags & perm)) << SPTE_FLAGS_SHIFT);
+    if (spte & SPTE_HASHED) {
+      uint64_t v, vpn;
+      uint64_t ptex = hpt_locate(aspace, ea, spte, &v, &vpn);
+      if (hpt.ops->protect && hpt.ops->protect(ptex, v, vpn, spte_to_r(spte))) {
+        hpt.stats.protects++;
+      } else {
+        // the copy is gone or the backend cant edit it, the storage fault brings in the new one
+        hpt_remove(aspace, ea, spte);
+        spte &= ~SPTE_HASHED;
+      }
+    }
+    *leaf = spte;
+    spin_unlock_irqrestore(&hpt.lock, state);
+  }
+  return NO_ERROR;
 }
 
 status_t arch_mmu_query(arch_aspace_t *aspace, vaddr_t vaddr, paddr_t *paddr, uint *flags) {
-  printf("arch_mmu_query(%p, 0x%x, 0x%x, 0x%x)\n", aspace, vaddr, paddr, flags);
-  *paddr = vaddr;
-  *flags = 0;
-  return 0;
+  if (!in_aspace(aspace, vaddr)) return ERR_OUT_OF_RANGE;
+  // the linear map has no software ptes, its identity alias is outside every aspace
+  if (aspace == kernel_aspace && vaddr >= PPC64_LINEAR_BASE) {
+    vaddr_t offset = vaddr - PPC64_LINEAR_BASE;
+    if (offset < linear.size) {
+      if (paddr) *paddr = offset;
+      if (flags) *flags = 0;
+      return NO_ERROR;
+    }
+  }
+  uint64_t *leaf = radix_leaf(aspace, vaddr, false);
+  if (!leaf || !(*leaf & SPTE_PRESENT)) return ERR_NOT_FOUND;
+
+  uint64_t spte = *leaf;
+  if (paddr) *paddr = (spte & SPTE_PA_MASK) | (vaddr & (PAGE_SIZE - 1));
+  if (flags) *flags = (spte & SPTE_FLAGS_MASK) >> SPTE_FLAGS_SHIFT;
+  return NO_ERROR;
 }
 
+// segments come in lazily through the segment miss, so a switch only has to drop the old ones
 void arch_mmu_context_switch(arch_aspace_t *aspace) {
-  printf("arch_mmu_context_switch(%p)\n", aspace);
+  uint cpu = arch_curr_cpu_num();
+  if (current_aspace[cpu] == aspace) return;
+  current_aspace[cpu] = aspace;
+  ppc64_slb_flush();
+}
+
+__WEAK uint64_t platform_ram_size(void) {
+  return MEMBASE + MEMSIZE;
+}
+
+__WEAK bool platform_kernel_translation(void) {
+  return false;
+}
+
+static void translation_on(void) {
+  // the alias keeps every address the kernel holds valid across the switch
+  __asm__ volatile("mtmsrd %0, 0\nisync" : : "r"(mfmsr() | MSR_IR | MSR_DR) : "memory");
+}
+
+static void linear_map_init(void) {
+  const uint64_t large = 1ULL << HPT_LARGE_SHIFT, segment = 1ULL << HPT_SEGMENT_SHIFT;
+  linear.size = (platform_ram_size() + large - 1) & ~(large - 1);
+  linear.span = (linear.size + segment - 1) & ~(segment - 1);
+  if (!platform_kernel_translation()) return;
+
+  for (paddr_t pa = 0; pa < linear.size; pa += large) {
+    if (hpt_insert_large(PPC64_LINEAR_BASE + pa, pa) < 0 || hpt_insert_large(pa, pa) < 0) {
+      printf("linear map: no room for 0x%llx, staying in real mode\n", (uint64_t)pa);
+      return;
+    }
+  }
+
+  // the segment the kernel image runs from goes first, then as much of the rest as fits in SLB_BOLTED
+  extern uint8_t _start;
+  uint64_t image = (uintptr_t)&_start >> HPT_SEGMENT_SHIFT;
+  const uint64_t base = PPC64_LINEAR_BASE >> HPT_SEGMENT_SHIFT;
+  linear.translated = true;
+  ppc64_slb_bolt(image);
+  for (uint64_t seg = 0; seg < (linear.span >> HPT_SEGMENT_SHIFT); seg++) {
+    if (!ppc64_slb_bolt(base + seg)) break;
+    if (seg != image && !ppc64_slb_bolt(seg)) break;
+  }
+}
+
+// SDR1 is per core, secondaries have to point theirs at the table too
+void ppc64_mmu_init_percpu(void) {
+  if (hpt.ops->init_percpu) hpt.ops->init_percpu();
+  ppc64_slb_init_percpu();
+  if (linear.translated) translation_on();
 }
+
+static void ppc64_mmu_init(uint level) {
+  hpt.ops = platform_hpt_ops();
+  hpt.pteg_shift = hpt.ops->init();
+  hpt.pteg_mask = (1ULL << hpt.pteg_shift) - 1;
+  hpt.stats.ptegs = hpt.pteg_mask + 1;
+  linear_map_init();
+  ppc64_slb_init_percpu();
+  if (linear.translated) translation_on();
+  ppc64_boot_mark("mmu, linear map up");
+}
+
+// for ppc64_chain_load, on the last cpu still in the kernel: real mode, and a page table with nothing of ours
+// real mode ignores the top 4 bits of an address, the linear map addresses the caller holds stay good
+void ppc64_mmu_quiesce(void) {
+  __asm__ volatile("mtmsrd %0, 0\nisync" : : "r"(mfmsr() & ~(MSR_IR | MSR_DR)) : "memory");
+  linear.translated = false;
+  if (hpt.ops && hpt.ops->clear) hpt.ops->clear();
+  __asm__ volatile("slbia\nisync" ::: "memory");
+}
+
+void hpt_get_stats(struct hpt_stats *out) {
+  spin_lock_saved_state_t state;
+  spin_lock_irqsave(&hpt.lock, state);
+  *out = hpt.stats;
+  spin_unlock_irqrestore(&hpt.lock, state);
+}
+
+// after platform_early_init, which finds out how big the table is, and before the vmm starts mapping
+LK_INIT_HOOK(ppc64_mmu, ppc64_mmu_init, LK_INIT_LEVEL_PLATFORM_EARLY + 1);
+
+static int cmd_hpt(int argc, const console_cmd_args *argv) {
+  struct hpt_stats s;
+  hpt_get_stats(&s);
+  printf("backend %s, %llu PTEG's\n", hpt.ops->name, s.ptegs);
+  printf("linear map 0x%llx bytes at 0x%llx, %s\n", linear.size, PPC64_LINEAR_BASE,
+         linear.translated ? "16MB pages" : "real mode");
+  printf("inserts %llu (secondary %llu), evictions %llu\n", s.inserts, s.secondary, s.evictions);
+  printf("removes %llu, stale %llu, protects %llu\n", s.removes, s.stale, s.protects);
+  printf("faults %llu\n", s.faults);
+  return 0;
+}
+
+static uint64_t backend_exits(void) {
+  return hpt.ops->exits ? hpt.ops->exits() : 0;
+}
+
+// maps and unmaps `pages` pages of a throwaway aspace, one call per page and then as one range
+static int cmd_mmubench(int argc, const console_cmd_args *argv) {
+  uint pages = argc > 1 ? argv[1].u : 4096;
+  const vaddr_t base = 0x100000000ULL;
+  const paddr_t pa = 0x1000000;
+  arch_aspace_t aspace;
+
+  if (pages == 0) return ERR_INVALID_ARGS;
+  status_t err = arch_mmu_init_aspace(&aspace, base, (size_t)pages << HPT_PAGE_SHIFT, 0);
+  if (err < 0) return err;
+
+  // backend exits before and after each phase
+  uint64_t exits[6];
+
+  uint64_t evictions = hpt.stats.evictions;
+  exits[0] = backend_exits();
+  lk_ticks_t t0 = lk_ticks();
+  for (uint i = 0; i < pages; i++) {
+    arch_mmu_map(&aspace, base + ((vaddr_t)i << HPT_PAGE_SHIFT), pa, 1, 0);
+  }
+  lk_ticks_t t1 = lk_ticks();
+  for (uint i = 0; i < pages; i++) {
+    paddr_t out;
+    arch_mmu_query(&aspace, base + ((vaddr_t)i << HPT_PAGE_SHIFT), &out, NULL);
+  }
+  lk_ticks_t t2 = lk_ticks();
+  exits[1] = backend_exits();
+  for (uint i = 0; i < pages; i++) {
+    arch_mmu_unmap(&aspace, base + ((vaddr_t)i << HPT_PAGE_SHIFT), 1);
+  }
+  lk_ticks_t t3 = lk_ticks();
+  exits[2] = backend_exits();
+  arch_mmu_map(&aspace, base, pa, pages, 0);
+  lk_ticks_t t4 = lk_ticks();
+  exits[3] = backend_exits();
+  ppc64_mmu_protect(&aspace, base, pages, ARCH_MMU_FLAG_PERM_RO);
+  lk_ticks_t t5 = lk_ticks();
+  exits[4] = backend_exits();
+  arch_mmu_unmap(&aspace, base, pages);
+  lk_ticks_t t6 = lk_ticks();
+  exits[5] = backend_exits();
+  evictions = hpt.stats.evictions - evictions;
+
+  arch_mmu_destroy_aspace(&aspace);
+
+  printf("%u pages, %s backend, ns per page\n", pages, hpt.ops->name);
+  printf("map %llu, query %llu, unmap %llu\n", lk_ticks_to_ns(t1 - t0) / pages,
+         lk_ticks_to_ns(t2 - t1) / pages, lk_ticks_to_ns(t3 - t2) / pages);
+  printf("ranged map %llu, protect %llu, unmap %llu\n", lk_ticks_to_ns(t4 - t3) / pages,
+         lk_ticks_to_ns(t5 - t4) / pages, lk_ticks_to_ns(t6 - t5) / pages);
+  printf("%llu evictions\n", evictions);
+  if (hpt.ops->exits) {
+    // 256 pages to the MB
+    printf("exits per MB: map %llu, unmap %llu, ranged map %llu, protect %llu, unmap %llu\n",
+           (exits[1] - exits[0]) * 256 / pages, (exits[2] - exits[1]) * 256 / pages,
+           (exits[3] - exits[2]) * 256 / pages, (exits[4] - exits[3]) * 256 / pages,
+           (exits[5] - exits[4]) * 256 / pages);
+  }
+  return 0;
+}
+
+STATIC_COMMAND_START
+STATIC_COMMAND("hpt", "hashed page table stats", &cmd_hpt)
+STATIC_COMMAND("mmubench", "map/unmap throughput [pages]", &cmd_mmubench)
+STATIC_COMMAND_END(ppc64_mmu);
@@ -0,0 +1,250 @@
+#include <arch/cpu_regs.h>
+#include <arch/mp.h>
+#include <arch/ops.h>
+#include <arch/ppc64.h>
+#include <arch/ticks.h>
+#include <kernel/mp.h>
+#include <kernel/thread.h>
+#include <lk/debug.h>
+#include <lk/err.h>
+#include <lk/main.h>
+#include <assert.h>
+#include <stddef.h>
+#include <stdio.h>
+
+STATIC_ASSERT(sizeof(struct ppc64_percpu) == PERCPU_SIZE);
+STATIC_ASSERT(offsetof(struct ppc64_percpu, current_thread) == PERCPU_CURRENT_THREAD);
+STATIC_ASSERT(offsetof(struct ppc64_percpu, cpu_num) == PERCPU_CPU_NUM);
+STATIC_ASSERT(offsetof(struct ppc64_percpu, hw_id) == PERCPU_HW_ID);
+STATIC_ASSERT(offsetof(struct ppc64_percpu, boot_stack) == PERCPU_BOOT_STACK);
+
+struct ppc64_percpu ppc64_percpu[SMP_MAX_CPUS];
+
+__WEAK uint platform_secondary_cpu_count(void) {
+  return 0;
+}
+
+__WEAK status_t platform_start_secondary_cpu(uint cpu) {
+  return ERR_NOT_SUPPORTED;
+}
+
+__WEAK void platform_send_ipi(uint cpu) {
+  // without a platform doorbell, the target picks the ipi up from arch_idle
+}
+
+__WEAK bool platform_timebase_writable(void) {
+  return false;
+}
+
+// what xell does with the threads it does not boot on, the new image releases them itself
+__WEAK void platform_park_cpu(uint64_t entry) {
+  ppc64_chain_enter(entry + PPC64_SECONDARY_HOLD, 0, 0, 0, 0);
+}
+
+#if WITH_SMP
+
+#define BRINGUP_TIMEOUT_TICKS lk_ms_to_ticks(1000)
+
+static uint8_t secondary_stacks[SMP_MAX_CPUS - 1][ARCH_DEFAULT_STACK_SIZE] __ALIGNED(16);
+
+// timebase handoff between cpu 0 and the cpu currently being started
+// tb_sync_cpu says which cpu the handoff is for, and whoever takes it back to 0 first decides how it
+// ended: the secondary once it has the value, or cpu 0 giving up, so a cpu that turns up late can
+// neither come online nor take a value meant for the next one
+static volatile uint32_t tb_sync_cpu;
+static volatile uint32_t tb_sync_ready;  // the secondary waiting for the value
+static volatile uint32_t tb_sync_given;  // the secondary tb_sync_value is for
+static volatile uint64_t tb_sync_value;
+
+// entry of the image ppc64_chain_load is about to start, for the secondaries leaving through PPC64_IPI_PARK
+static volatile uint64_t park_entry;
+
+static bool tb_sync_wait(volatile uint32_t *flag, uint32_t value) {
+  uint64_t start = tbl_read();
+  while (*flag != value) {
+    if (tbl_read() - start > BRINGUP_TIMEOUT_TICKS) return false;
+  }
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  return true;
+}
+
+static bool tb_sync_give(uint32_t cpu) {
+  bool ok = false;
+  if (tb_sync_wait(&tb_sync_ready, cpu)) {
+    tb_sync_value = tbl_read();
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    tb_sync_given = cpu;
+    ok = tb_sync_wait(&tb_sync_cpu, 0);
+  }
+  // if the secondary got there first after all, it has the value and counts as synced
+  uint32_t expected = cpu;
+  if (!ok) ok = !__atomic_compare_exchange_n(&tb_sync_cpu, &expected, 0, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+  tb_sync_ready = 0;
+  tb_sync_given = 0;
+  tb_sync_value = 0;
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  return ok;
+}
+
+static bool tb_sync_take(uint32_t cpu) {
+  struct ppc64_percpu *p = ppc64_get_percpu();
+
+  if (!tb_sync_wait(&tb_sync_cpu, cpu)) return false;
+  tb_sync_ready = cpu;
+  if (!tb_sync_wait(&tb_sync_given, cpu)) return false;
+  uint64_t value = tb_sync_value;
+  uint64_t now = tbl_read();
+
+  // the value is only ours if cpu 0 has not given up on us in the meantime
+  uint32_t expected = cpu;
+  if (!__atomic_compare_exchange_n(&tb_sync_cpu, &expected, 0, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST))
+    return false;
+
+  p->tb_skew = (int64_t)(now - value);
+  if (platform_timebase_writable()) {
+    // clearing TBL first keeps a carry from bumping TBU in between the two writes
+    __asm__ volatile("mtspr 284, %0\n mtspr 285, %1\n mtspr 284, %2"
+        : : "r"(0), "r"(value >> 32), "r"(value & 0xffffffff));
+    p->tb_skew = 0;
+  }
+  return true;
+}
+
+void ppc64_mp_init(void) {
+  uint count = platform_secondary_cpu_count();
+  if (count > SMP_MAX_CPUS - 1) count = SMP_MAX_CPUS - 1;
+  if (count == 0) return;
+
+  for (uint cpu = 1; cpu <= count; cpu++) {
+    struct ppc64_percpu *p = ppc64_get_percpu_for(cpu);
+    p->cpu_num = cpu;
+    p->boot_stack = (uint64_t)&secondary_stacks[cpu - 1][ARCH_DEFAULT_STACK_SIZE];
+  }
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+  lk_init_secondary_cpus(count);
+
+  for (uint cpu = 1; cpu <= count; cpu++) {
+    struct ppc64_percpu *p = ppc64_get_percpu_for(cpu);
+    tb_sync_cpu = cpu;
+    status_t ret = platform_start_secondary_cpu(cpu);
+    if (ret < 0) {
+      tb_sync_cpu = 0;
+      printf("cpu %u: start failed %d\n", cpu, ret);
+      continue;
+    }
+    if (!tb_sync_give(cpu)) {
+      printf("cpu %u (hw 0x%x): timebase sync timed out\n", cpu, p->hw_id);
+      continue;
+    }
+    uint64_t start = tbl_read();
+    while (!p->online) {
+      if (tbl_read() - start > BRINGUP_TIMEOUT_TICKS) break;
+    }
+    printf("cpu %u (hw 0x%x): %s, tb skew %lld\n", cpu, p->hw_id,
+        p->online ? "online" : "timed out", p->tb_skew);
+  }
+  ppc64_boot_mark("secondary cpus started");
+}
+
+void ppc64_secondary_entry(uint cpu) {
+  DEBUG_ASSERT(ppc64_get_percpu()->cpu_num == cpu);
+
+  if (!tb_sync_take(cpu)) {
+    // cpu 0 has moved on without this one, it stays out of the kernel
+    for (;;) __asm__ volatile("or 1,1,1");
+  }
+  arch_mp_init_percpu();
+  ppc64_get_percpu()->online = 1;
+
+  lk_secondary_cpu_entry();
+
+  // only returns if LK did not expect this cpu
+  for (;;) arch_idle();
+}
+
+// never returns, whatever thread was running here is abandoned along with the rest of the kernel
+static void park(void) {
+  struct ppc64_percpu *p = ppc64_get_percpu();
+  arch_disable_ints();
+  // real mode ignores the top 4 bits, so the linear map addresses stay good
+  __asm__ volatile("mtmsrd %0, 0\nisync" : : "r"(mfmsr() & ~(MSR_IR | MSR_DR)) : "memory");
+  uint64_t entry = park_entry;
+  __atomic_store_n(&p->online, 0, __ATOMIC_RELEASE);
+  platform_park_cpu(entry);
+}
+
+bool ppc64_mp_park_secondaries(uint64_t entry) {
+  park_entry = entry;
+  mp_cpu_mask_t mask = 0;
+  for (uint cpu = 1; cpu < SMP_MAX_CPUS; cpu++) {
+    if (ppc64_percpu[cpu].online) mask |= 1U << cpu;
+  }
+  arch_mp_send_ipi(mask, (mp_ipi_t)PPC64_IPI_PARK);
+
+  // without a platform doorbell a busy cpu only notices from arch_idle
+  bool parked = true;
+  uint64_t start = tbl_read();
+  for (uint cpu = 1; cpu < SMP_MAX_CPUS; cpu++) {
+    while (ppc64_percpu[cpu].online) {
+      if (tbl_read() - start > BRINGUP_TIMEOUT_TICKS) {
+        printf("cpu %u: did not park\n", cpu);
+        parked = false;
+        break;
+      }
+    }
+  }
+  return parked;
+}
+
+enum handler_return ppc64_mp_handle_ipi(void) {
+  struct ppc64_percpu *p = ppc64_get_percpu();
+  if (!p->ipi_pending) return INT_NO_RESCHEDULE;
+
+  uint32_t pending = __atomic_exchange_n(&p->ipi_pending, 0, __ATOMIC_ACQ_REL);
+  if (pending & (1U << PPC64_IPI_PARK)) park();
+  enum handler_return ret = INT_NO_RESCHEDULE;
+  if (pending & (1U << MP_IPI_GENERIC)) {
+    ret |= mp_mbx_generic_irq();
+  }
+  if (pending & (1U << MP_IPI_RESCHEDULE)) {
+    ret |= mp_mbx_reschedule_irq();
+  }
+  return ret;
+}
+
+status_t arch_mp_send_ipi(mp_cpu_mask_t target, mp_ipi_t ipi) {
+  target &= (1U << SMP_MAX_CPUS) - 1;
+  for (uint cpu = 0; cpu < SMP_MAX_CPUS; cpu++) {
+    if (!(target & (1U << cpu))) continue;
+    __atomic_fetch_or(&ppc64_percpu[cpu].ipi_pending, 1U << ipi, __ATOMIC_RELEASE);
+    platform_send_ipi(cpu);
+  }
+  return NO_ERROR;
+}
+
+void arch_mp_init_percpu(void) {
+  ppc64_timer_init_percpu();
+  ppc64_exceptions_init_percpu();
+  ppc64_fpu_init_percpu();
+  ppc64_mmu_init_percpu();
+}
+
+#else
+
+void ppc64_mp_init(void) {
+}
+
+enum handler_return ppc64_mp_handle_ipi(void) {
+  return INT_NO_RESCHEDULE;
+}
+
+bool ppc64_mp_park_secondaries(uint64_t entry) {
+  return true;
+}
+
+void ppc64_secondary_entry(uint cpu) {
+  for (;;) arch_idle();
+}
+
+#endif
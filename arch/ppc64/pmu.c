@@ -0,0 +1,361 @@
+#include <arch/cpu_regs.h>
+#include <arch/ops.h>
+#include <arch/pmu.h>
+#include <arch/ppc64.h>
+#include <arch/ticks.h>
+#include <kernel/spinlock.h>
+#include <kernel/thread.h>
+#include <lib/console.h>
+#include <lk/console_cmd.h>
+#include <lk/debug.h>
+#include <lk/err.h>
+#include <stdio.h>
+#include <string.h>
+
+STATIC_ASSERT(sizeof(((struct arch_thread *)0)->pmu_counts) == sizeof(struct pmu_counts));
+
+#define MMCR0_FC     0x80000000ULL // freeze all counters
+#define MMCR0_PMXE   0x04000000ULL // performance monitor exception enable, the exception clears it
+#define MMCR0_PMC1CE 0x00008000ULL // pmc1 going negative raises the exception
+#define MMCR0_PMCJCE 0x00004000ULL // so does pmc2 and up
+#define MMCR0_PMAO   0x00000080ULL // isa 2.07, the exception happened, has to be cleared to get another
+
+// the pmcs are 32 bits and only folded into the 64 bit counts at a switch or a read, a thread that runs
+// for a few seconds would wrap them, so a counter reaching 2^31 interrupts and is folded in from 0xf00
+#define MMCR0_OVERFLOW (MMCR0_PMXE | MMCR0_PMC1CE | MMCR0_PMCJCE)
+
+enum pmu_layout {
+  PMU_LAYOUT_NONE,
+  PMU_LAYOUT_970,     // pmc1-8, selects split over mmcr0 and mmcr1
+  PMU_LAYOUT_ISA207,  // power8 and later, pmc5/6 fixed, pmc1-4 selects in mmcr1
+};
+
+// pmc 0 means the core cannot count the event
+struct pmu_event_sel {
+  uint8_t pmc;
+  uint8_t sel;
+};
+
+struct pmu_model {
+  uint16_t pvr_version;
+  const char *name;
+  enum pmu_layout layout;
+  struct pmu_event_sel events[PMU_NUM_EVENTS];
+};
+
+// direct events, 1 = instructions completed, 7 = cycles
+// the 970's cache and translation miss events are left out on purpose, they come through the event
+// bus and need the unit muxes and byte lanes of mmcr1 set per event, so perf only reports the two
+#define PPC970_EVENTS { \
+  [PMU_CYCLES] = { 1, 0x07 }, \
+  [PMU_INSTRUCTIONS] = { 2, 0x01 }, \
+}
+
+// pmc1-4 take the low byte of the event code, which must be one for that pmc
+// PM_IERAT_RELOAD 0x100f6, PM_DATA_FROM_L2MISS 0x200fe, PM_DTLB_MISS 0x300fc, PM_LD_MISS_L1 0x400f0
+#define ISA207_EVENTS { \
+  [PMU_CYCLES] = { 6, 0 }, \
+  [PMU_INSTRUCTIONS] = { 5, 0 }, \
+  [PMU_L1D_MISS] = { 4, 0xf0 }, \
+  [PMU_L2_MISS] = { 2, 0xfe }, \
+  [PMU_ERAT_MISS] = { 1, 0xf6 }, \
+  [PMU_TLB_MISS] = { 3, 0xfc }, \
+}
+
+static const struct pmu_model pmu_models[] = {
+  { 0x0039, "ppc970", PMU_LAYOUT_970, PPC970_EVENTS },
+  { 0x003c, "ppc970fx", PMU_LAYOUT_970, PPC970_EVENTS },
+  { 0x0044, "ppc970mp", PMU_LAYOUT_970, PPC970_EVENTS },
+  { 0x0045, "ppc970gx", PMU_LAYOUT_970, PPC970_EVENTS },
+  { 0x004b, "power8e", PMU_LAYOUT_ISA207, ISA207_EVENTS },
+  { 0x004c, "power8nvl", PMU_LAYOUT_ISA207, ISA207_EVENTS },
+  { 0x004d, "power8", PMU_LAYOUT_ISA207, ISA207_EVENTS },
+  { 0x004e, "power9", PMU_LAYOUT_ISA207, ISA207_EVENTS },
+  { 0x0080, "power10", PMU_LAYOUT_ISA207, ISA207_EVENTS },
+  // the cell ppu and xenon keep their counters in the mmio pervasive unit, not in sprs,
+  // so only the timebase derived cycle count is available there
+  { 0x0070, "cell ppu", PMU_LAYOUT_NONE, {} },
+  { 0x0071, "xenon", PMU_LAYOUT_NONE, {} },
+};
+
+static const struct pmu_model pmu_unknown = { 0, "unknown", PMU_LAYOUT_NONE, {} };
+
+static const char *pmu_event_names[PMU_NUM_EVENTS] = {
+  [PMU_CYCLES] = "cycles",
+  [PMU_INSTRUCTIONS] = "instructions",
+  [PMU_L1D_MISS] = "l1d_miss",
+  [PMU_L2_MISS] = "l2_miss",
+  [PMU_ERAT_MISS] = "erat_miss",
+  [PMU_TLB_MISS] = "tlb_miss",
+};
+
+static const struct pmu_model *pmu_model = &pmu_unknown;
+static spin_lock_t pmu_lock = SPIN_LOCK_INITIAL_VALUE;
+static uint32_t pmu_events;
+static uint32_t pmu_gen;
+bool ppc64_pmu_active;
+uint32_t ppc64_cycles_per_tb = 1;
+
+static uint64_t pmc_read(uint pmc) {
+  switch (pmc) {
+    case 1: return pmc1_read();
+    case 2: return pmc2_read();
+    case 3: return pmc3_read();
+    case 4: return pmc4_read();
+    case 5: return pmc5_read();
+    case 6: return pmc6_read();
+  }
+  return 0;
+}
+
+static void pmc_write(uint pmc, uint64_t value) {
+  switch (pmc) {
+    case 1: pmc1_write(value); break;
+    case 2: pmc2_write(value); break;
+    case 3: pmc3_write(value); break;
+    case 4: pmc4_write(value); break;
+    case 5: pmc5_write(value); break;
+    case 6: pmc6_write(value); break;
+  }
+}
+
+static bool event_in_hw(enum pmu_event e) {
+  return pmu_model->events[e].pmc != 0;
+}
+
+// programs this cpu for `events`, with every counter starting from zero
+static void pmu_program(uint32_t events) {
+  ppc64_get_percpu()->pmu_tb_start = lk_ticks();
+  if (pmu_model->layout == PMU_LAYOUT_NONE) return;
+
+  mmcr0_write(MMCR0_FC);
+  for (uint pmc = 1; pmc <= 6; pmc++) pmc_write(pmc, 0);
+
+  uint64_t mmcr0 = 0, mmcr1 = 0;
+  for (uint e = 0; e < PMU_NUM_EVENTS; e++) {
+    if (!(events & PMU_EVENT_BIT(e)) || !event_in_hw(e)) continue;
+    const struct pmu_event_sel *s = &pmu_model->events[e];
+    switch (pmu_model->layout) {
+      case PMU_LAYOUT_970:
+        if (s->pmc == 1) mmcr0 |= (uint64_t)s->sel << 8;
+        else if (s->pmc == 2) mmcr0 |= (uint64_t)s->sel << 1;
+        else mmcr1 |= (uint64_t)s->sel << (27 - (s->pmc - 3) * 5);
+        break;
+      case PMU_LAYOUT_ISA207:
+        if (s->pmc <= 4) mmcr1 |= (uint64_t)s->sel << (24 - (s->pmc - 1) * 8);
+        break;
+      case PMU_LAYOUT_NONE:
+        break;
+    }
+  }
+
+  mmcra_write(0);
+  mmcr1_write(mmcr1);
+  mmcr0_write(events ? mmcr0 | MMCR0_OVERFLOW : MMCR0_FC);
+}
+
+// moves what this cpu counted since the last call into `counts`
+static void pmu_accumulate(struct pmu_counts *counts) {
+  struct ppc64_percpu *p = ppc64_get_percpu();
+  uint64_t now = lk_ticks();
+
+  for (uint e = 0; e < PMU_NUM_EVENTS; e++) {
+    if (!(pmu_events & PMU_EVENT_BIT(e))) continue;
+    if (event_in_hw(e)) {
+      uint pmc = pmu_model->events[e].pmc;
+      counts->count[e] += (uint32_t)pmc_read(pmc);
+      pmc_write(pmc, 0);
+    } else if (e == PMU_CYCLES) {
+      counts->count[e] += (now - p->pmu_tb_start) * ppc64_cycles_per_tb;
+    }
+  }
+  p->pmu_tb_start = now;
+}
+
+static struct pmu_counts *thread_counts(thread_t *t) {
+  return (struct pmu_counts *)t->arch.pmu_counts;
+}
+
+void ppc64_pmu_context_switch(thread_t *oldthread, thread_t *newthread) {
+  struct ppc64_percpu *p = ppc64_get_percpu();
+  if (p->pmu_gen != pmu_gen) {
+    // first switch on this cpu since the configuration changed, nothing counted yet is valid
+    p->pmu_gen = pmu_gen;
+    pmu_program(pmu_events);
+    return;
+  }
+  pmu_accumulate(thread_counts(oldthread));
+}
+
+// 0xf00, some counter reached 2^31
+enum handler_return ppc64_pmu_irq(struct ppc64_iframe *frame) {
+  if (!ppc64_pmu_active || ppc64_get_percpu()->pmu_gen != pmu_gen) {
+    // counting for a configuration that is gone, stop until the next switch programs the current one
+    mmcr0_write(MMCR0_FC);
+    return INT_NO_RESCHEDULE;
+  }
+  pmu_accumulate(thread_counts(get_current_thread()));
+  mmcr0_write((mmcr0_read() | MMCR0_PMXE) & ~MMCR0_PMAO);
+  return INT_NO_RESCHEDULE;
+}
+
+uint32_t pmu_available_events(void) {
+  uint32_t events = PMU_EVENT_BIT(PMU_CYCLES);
+  for (uint e = 0; e < PMU_NUM_EVENTS; e++) {
+    if (event_in_hw(e)) events |= PMU_EVENT_BIT(e);
+  }
+  return events;
+}
+
+uint32_t pmu_enabled_events(void) {
+  return pmu_events;
+}
+
+const char *pmu_model_name(void) {
+  return pmu_model->name;
+}
+
+const char *pmu_event_name(enum pmu_event e) {
+  return e < PMU_NUM_EVENTS ? pmu_event_names[e] : "?";
+}
+
+status_t pmu_enable(uint32_t events) {
+  events &= pmu_available_events();
+  if (!events) return ERR_NOT_SUPPORTED;
+
+  spin_lock_saved_state_t state;
+  spin_lock_irqsave(&pmu_lock, state);
+  // bank what the current thread counted under the old configuration
+  if (ppc64_pmu_active && ppc64_get_percpu()->pmu_gen == pmu_gen) {
+    pmu_accumulate(thread_counts(get_current_thread()));
+  }
+  pmu_events = events;
+  pmu_gen++;
+  ppc64_get_percpu()->pmu_gen = pmu_gen;
+  pmu_program(events);
+  ppc64_pmu_active = true;
+  spin_unlock_irqrestore(&pmu_lock, state);
+  return NO_ERROR;
+}
+
+void pmu_disable(void) {
+  spin_lock_saved_state_t state;
+  spin_lock_irqsave(&pmu_lock, state);
+  if (ppc64_pmu_active && ppc64_get_percpu()->pmu_gen == pmu_gen) {
+    pmu_accumulate(thread_counts(get_current_thread()));
+  }
+  ppc64_pmu_active = false;
+  pmu_events = 0;
+  pmu_gen++;
+  // other cpus keep counting until their next enable, nothing reads them meanwhile
+  pmu_program(0);
+  spin_unlock_irqrestore(&pmu_lock, state);
+}
+
+void pmu_read_thread(thread_t *t, struct pmu_counts *out) {
+  spin_lock_saved_state_t state;
+  arch_interrupt_save(&state, SPIN_LOCK_FLAG_INTERRUPTS);
+  if (t == get_current_thread() && ppc64_pmu_active && ppc64_get_percpu()->pmu_gen == pmu_gen) {
+    pmu_accumulate(thread_counts(t));
+  }
+  *out = *thread_counts(t);
+  arch_interrupt_restore(state, SPIN_LOCK_FLAG_INTERRUPTS);
+}
+
+// core cycles per timebase tick, measured with the cycle counter where the core has one
+static void pmu_calibrate(void) {
+  if (!event_in_hw(PMU_CYCLES)) return;
+
+  uint pmc = pmu_model->events[PMU_CYCLES].pmc;
+  pmu_program(PMU_EVENT_BIT(PMU_CYCLES));
+  uint64_t ticks = lk_us_to_ticks(1000);
+  uint64_t start = lk_ticks();
+  while (lk_ticks() - start < ticks);
+  uint64_t cycles = (uint32_t)pmc_read(pmc);
+  pmu_program(0);
+
+  // qemu does not count cycles on every cpu model, keep the default then
+  uint64_t ratio = (cycles + ticks / 2) / ticks;
+  if (ratio) ppc64_cycles_per_tb = ratio;
+}
+
+void ppc64_pmu_init(void) {
+  uint16_t version = pvr_read() >> 16;
+  for (uint i = 0; i < countof(pmu_models); i++) {
+    if (pmu_models[i].pvr_version == version) {
+      pmu_model = &pmu_models[i];
+      break;
+    }
+  }
+  pmu_calibrate();
+}
+
+static void print_count(const char *name, uint64_t value, uint64_t instructions, bool have_instructions) {
+  printf("%14llu  %s", value, name);
+  if (have_instructions && instructions) {
+    uint64_t per_k = value * 1000000 / instructions;
+    printf("  (%llu.%03llu per 1k instructions)", per_k / 1000, per_k % 1000);
+  }
+  printf("\n");
+}
+
+static int cmd_perf(int argc, const console_cmd_args *argv) {
+  if (argc < 2) {
+    printf("usage: %s <command> [args...]\n", argv[0].str);
+    printf("runs a console command under the performance counters (%s)\n", pmu_model_name());
+    return -1;
+  }
+
+  char line[256];
+  size_t len = 0;
+  line[0] = 0;
+  for (int i = 1; i < argc; i++) {
+    len += snprintf(line + len, sizeof(line) - len, "%s%s", i > 1 ? " " : "", argv[i].str);
+    if (len >= sizeof(line)) {
+      printf("command line too long\n");
+      return ERR_TOO_BIG;
+    }
+  }
+
+  bool was_active = ppc64_pmu_active;
+  uint32_t old_events = pmu_events;
+  status_t err = pmu_enable(pmu_available_events());
+  if (err < 0) {
+    printf("pmu unavailable: %d\n", err);
+    return err;
+  }
+
+  thread_t *self = get_current_thread();
+  struct pmu_counts before, after;
+  pmu_read_thread(self, &before);
+  lk_ticks_t start = lk_ticks();
+  int ret = console_run_script_locked(line);
+  lk_ticks_t end = lk_ticks();
+  pmu_read_thread(self, &after);
+
+  if (was_active) pmu_enable(old_events);
+  else pmu_disable();
+
+  uint32_t events = pmu_available_events();
+  uint64_t delta[PMU_NUM_EVENTS];
+  for (uint e = 0; e < PMU_NUM_EVENTS; e++) delta[e] = after.count[e] - before.count[e];
+  bool have_instructions = events & PMU_EVENT_BIT(PMU_INSTRUCTIONS);
+
+  printf("\nperf: '%s' returned %d, on %s\n", line, ret, pmu_model_name());
+  printf("%14llu  us elapsed\n", lk_ticks_to_us(end - start));
+  for (uint e = 0; e < PMU_NUM_EVENTS; e++) {
+    if (!(events & PMU_EVENT_BIT(e))) continue;
+    bool derived = e == PMU_CYCLES && !event_in_hw(e);
+    print_count(derived ? "cycles (from timebase)" : pmu_event_name(e), delta[e],
+                delta[PMU_INSTRUCTIONS], have_instructions && e >= PMU_L1D_MISS);
+  }
+  if (have_instructions && delta[PMU_CYCLES]) {
+    uint64_t ipc = delta[PMU_INSTRUCTIONS] * 1000 / delta[PMU_CYCLES];
+    printf("%10llu.%03llu  instructions per cycle\n", ipc / 1000, ipc % 1000);
+  }
+  return ret;
+}
+
+STATIC_COMMAND_START
+STATIC_COMMAND("perf", "run a command under the performance counters", &cmd_perf)
+STATIC_COMMAND_END(ppc64_pmu);
@@ -0,0 +1,401 @@
+#include <arch/ops.h>
+#include <arch/ppc64.h>
+#include <arch/ticks.h>
+#include <arch/timer_wheel.h>
+#include <kernel/spinlock.h>
+#include <kernel/thread.h>
+#include <lk/console_cmd.h>
+#include <lk/debug.h>
+#include <lk/err.h>
+#include <lk/macros.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// statistical profiler, a timer on every cpu's wheel samples whatever its decrementer interrupted, srr0
+// and the back chain above the interrupted r1, into a buffer per cpu that fills up and then stops
+// the decrementer cannot interrupt code running with EE off, time spent like that shows up where
+// interrupts come back on, spin_unlock_irqrestore and the like
+// a sample also keeps lr, a leaf has not stored it in its caller's frame, so the back chain skips from
+// the leaf straight to its caller's caller, lr fills that in when the symbols show it is not stale
+
+#define PROFILE_DEPTH       16    // srr0 and the return addresses above it
+#define PROFILE_DEFAULT_HZ  997   // off the round numbers, so it does not beat with periodic timers
+#define PROFILE_MAX_HZ      20000
+#define PROFILE_DEFAULT_SAMPLES 8192
+#define PROFILE_DEFAULT_ROWS    30
+
+struct profile_sample {
+  uint64_t lr;
+  uint32_t depth;                 // entries in pc
+  uint32_t pad;
+  uint64_t pc[PROFILE_DEPTH];     // srr0, then the back chain, innermost first
+};
+
+struct profile_cpu {
+  struct ppc64_timer timer;
+  uint64_t next;                  // timebase of the next sample
+  struct profile_sample *samples;
+  uint capacity;
+  uint count;
+  uint64_t dropped;               // ticks with the buffer full
+} __ALIGNED(CACHE_LINE);
+
+static struct {
+  spin_lock_t lock;               // running, and the timers
+  bool running;
+  uint hz;
+  uint64_t period;
+  struct profile_cpu cpu[SMP_MAX_CPUS];
+} profile = {
+  .lock = SPIN_LOCK_INITIAL_VALUE,
+};
+
+extern uint8_t __bss_end[], __stack_bottom[];
+
+static inline bool cpu_online(uint cpu) {
+  return cpu == 0 || ppc64_get_percpu_for(cpu)->online;
+}
+
+uint ppc64_backchain(uint64_t sp, uint64_t lo, uint64_t hi, uint64_t *pcs, uint max) {
+  uint n = 0;
+  while (n < max) {
+    if (sp < lo || sp + 8 > hi || (sp & 15)) break;
+    uint64_t next = *(const uint64_t *)sp;
+    // frames only ever go up the stack, anything else is the top of the chain or garbage
+    // the caller's frame header holds the return address at +16
+    if (next <= sp || next + 24 > hi || (next & 15)) break;
+    uint64_t lr = ((const uint64_t *)next)[2];
+    if (!ppc64_kernel_addr(lr)) break;
+    pcs[n++] = lr;
+    sp = next;
+  }
+  return n;
+}
+
+// the stack the interrupted code ran on, the current thread's, or for the idle threads the one their cpu
+// came up on, false if sp is on neither, in the middle of a context switch for one
+static bool stack_bounds(uint64_t sp, uint64_t *lo, uint64_t *hi) {
+  thread_t *t = get_current_thread();
+  if (t && t->stack) {
+    *lo = (uint64_t)t->stack;
+    *hi = *lo + t->stack_size;
+  } else if (arch_curr_cpu_num() == 0) {
+    *lo = (uint64_t)__bss_end;
+    *hi = (uint64_t)__stack_bottom;
+  } else {
+    *hi = ppc64_get_percpu()->boot_stack;
+    *lo = *hi - ARCH_DEFAULT_STACK_SIZE;
+  }
+  return sp >= *lo && sp < *hi;
+}
+
+static void record(struct profile_cpu *pc, const struct ppc64_iframe *frame) {
+  if (pc->count == pc->capacity) {
+    pc->dropped++;
+    return;
+  }
+  struct profile_sample *s = &pc->samples[pc->count];
+  s->lr = frame->lr;
+  s->pc[0] = frame->srr0;
+  s->depth = 1;
+  uint64_t sp = frame->gpr[1], lo, hi;
+  if (stack_bounds(sp, &lo, &hi)) s->depth += ppc64_backchain(sp, lo, hi, &s->pc[1], PROFILE_DEPTH - 1);
+  // a dump running meanwhile only reads samples below count
+  __atomic_store_n(&pc->count, pc->count + 1, __ATOMIC_RELEASE);
+}
+
+static enum handler_return profile_tick(struct ppc64_timer *t, uint64_t now, void *arg) {
+  struct profile_cpu *pc = arg;
+  const struct ppc64_iframe *frame = ppc64_timer_irq_frame();
+
+  spin_lock(&profile.lock);
+  if (profile.running) {
+    if (frame) record(pc, frame);
+    // keeps to the period, one late tick does not push the rest out
+    pc->next += profile.period;
+    if ((int64_t)(pc->next - now) <= 0) pc->next = now + profile.period;
+    ppc64_timer_arm(t, pc->next, 0, profile_tick, pc);
+  }
+  spin_unlock(&profile.lock);
+  return INT_NO_RESCHEDULE;
+}
+
+// runs pinned to the cpu it arms the timer of, timers go on the wheel of the cpu that arms them
+static int profile_arm(void *arg) {
+  struct profile_cpu *pc = arg;
+  DEBUG_ASSERT(pc == &profile.cpu[arch_curr_cpu_num()]);
+  spin_lock_saved_state_t state;
+  spin_lock_irqsave(&profile.lock, state);
+  if (profile.running) {
+    pc->next = lk_ticks() + profile.period;
+    ppc64_timer_arm(&pc->timer, pc->next, 0, profile_tick, pc);
+  }
+  spin_unlock_irqrestore(&profile.lock, state);
+  return 0;
+}
+
+status_t ppc64_profile_start(uint hz, uint samples) {
+  if (hz == 0 || hz > PROFILE_MAX_HZ || samples == 0) return ERR_INVALID_ARGS;
+  if (profile.running) return ERR_BUSY;
+
+  // buffers stay around after a stop for the dumps, they are only replaced here
+  for (uint cpu = 0; cpu < SMP_MAX_CPUS; cpu++) {
+    struct profile_cpu *pc = &profile.cpu[cpu];
+    pc->count = 0;
+    pc->dropped = 0;
+    if (!cpu_online(cpu)) continue;
+    if (pc->capacity != samples) {
+      free(pc->samples);
+      pc->samples = malloc(samples * sizeof(struct profile_sample));
+      pc->capacity = pc->samples ? samples : 0;
+      if (!pc->samples) return ERR_NO_MEMORY;
+    }
+    ppc64_timer_init(&pc->timer);
+  }
+
+  spin_lock_saved_state_t state;
+  spin_lock_irqsave(&profile.lock, state);
+  profile.hz = hz;
+  profile.period = lk_ticks_freq() / hz;
+  profile.running = true;
+  spin_unlock_irqrestore(&profile.lock, state);
+
+  for (uint cpu = 0; cpu < SMP_MAX_CPUS; cpu++) {
+    if (!cpu_online(cpu)) continue;
+    thread_t *t = thread_create("profile arm", profile_arm, &profile.cpu[cpu], HIGH_PRIORITY,
+                                DEFAULT_STACK_SIZE);
+    if (!t) {
+      ppc64_profile_stop();
+      return ERR_NO_MEMORY;
+    }
+    thread_set_pinned_cpu(t, cpu);
+    thread_resume(t);
+    thread_join(t, NULL, INFINITE_TIME);
+  }
+  return NO_ERROR;
+}
+
+// a tick already past its check of running records nothing more once this has the lock
+void ppc64_profile_stop(void) {
+  spin_lock_saved_state_t state;
+  spin_lock_irqsave(&profile.lock, state);
+  profile.running = false;
+  for (uint cpu = 0; cpu < SMP_MAX_CPUS; cpu++) ppc64_timer_cancel(&profile.cpu[cpu].timer);
+  spin_unlock_irqrestore(&profile.lock, state);
+}
+
+uint ppc64_profile_count(uint cpu) {
+  return cpu < SMP_MAX_CPUS ? __atomic_load_n(&profile.cpu[cpu].count, __ATOMIC_ACQUIRE) : 0;
+}
+
+// a sample reduced to the functions on its stack, identical stacks are merged for the dumps
+struct profile_stack {
+  uint32_t depth;
+  uint32_t count;
+  uint64_t key[PROFILE_DEPTH + 1];  // start of each function innermost first, the address itself without symbols
+};
+
+static uint64_t func_key(uint64_t addr, bool *known) {
+  uint64_t start;
+  if (ppc64_ksym(addr, &start)) {
+    *known = true;
+    return start;
+  }
+  *known = false;
+  return addr;
+}
+
+static void resolve(const struct profile_sample *s, struct profile_stack *st) {
+  bool known;
+  uint n = 0;
+  st->key[n++] = func_key(s->pc[0], &known);
+  bool leaf_known = known;
+
+  // lr is the caller of a leaf, or of a function still in its prologue, when it is neither the next
+  // return address on the chain nor back into the interrupted function, which it is once that made
+  // a call of its own, without symbols the two cannot be told apart and it is left out
+  uint64_t lr = func_key(s->lr, &known);
+  if (leaf_known && known && lr != st->key[0] && (s->depth < 2 || s->lr != s->pc[1])) st->key[n++] = lr;
+
+  for (uint i = 1; i < s->depth; i++) st->key[n++] = func_key(s->pc[i], &known);
+  st->depth = n;
+  st->count = 1;
+}
+
+static int compare_stacks(const void *a, const void *b) {
+  const struct profile_stack *x = a, *y = b;
+  uint n = MIN(x->depth, y->depth);
+  for (uint i = 0; i < n; i++) {
+    if (x->key[i] != y->key[i]) return x->key[i] < y->key[i] ? -1 : 1;
+  }
+  return (int)x->depth - (int)y->depth;
+}
+
+// every sample taken so far, merged, NULL if there are none or no memory for them
+static struct profile_stack *collect(uint *nstacks, uint *nsamples) {
+  uint total = 0;
+  for (uint cpu = 0; cpu < SMP_MAX_CPUS; cpu++) total += ppc64_profile_count(cpu);
+  if (total == 0) return NULL;
+  struct profile_stack *stacks = malloc(total * sizeof(*stacks));
+  if (!stacks) return NULL;
+
+  uint n = 0;
+  for (uint cpu = 0; cpu < SMP_MAX_CPUS && n < total; cpu++) {
+    const struct profile_cpu *pc = &profile.cpu[cpu];
+    uint count = MIN(ppc64_profile_count(cpu), total - n);
+    for (uint i = 0; i < count; i++) resolve(&pc->samples[i], &stacks[n++]);
+  }
+
+  qsort(stacks, n, sizeof(*stacks), compare_stacks);
+  uint unique = 0;
+  for (uint i = 0; i < n; i++) {
+    if (unique && compare_stacks(&stacks[unique - 1], &stacks[i]) == 0) {
+      stacks[unique - 1].count++;
+    } else {
+      stacks[unique++] = stacks[i];
+    }
+  }
+  *nstacks = unique;
+  *nsamples = n;
+  return stacks;
+}
+
+static void print_func(uint64_t key) {
+  const char *name = ppc64_ksym(key, NULL);
+  if (name) {
+    printf("%s", name);
+  } else {
+    printf("0x%llx", key);
+  }
+}
+
+struct profile_func {
+  uint64_t key;
+  uint32_t self;
+  uint32_t total;
+};
+
+static int compare_func_keys(const void *a, const void *b) {
+  const struct profile_func *x = a, *y = b;
+  return x->key < y->key ? -1 : x->key > y->key;
+}
+
+static int compare_func_counts(const void *a, const void *b) {
+  const struct profile_func *x = a, *y = b;
+  if (x->self != y->self) return x->self < y->self ? 1 : -1;
+  return x->total < y->total ? 1 : x->total > y->total ? -1 : 0;
+}
+
+// self is the samples a function was interrupted in, total those it was anywhere on the stack in
+static void dump_flat(uint rows) {
+  uint nstacks, nsamples;
+  struct profile_stack *stacks = collect(&nstacks, &nsamples);
+  if (!stacks) {
+    printf("no samples\n");
+    return;
+  }
+
+  uint nfuncs = 0;
+  for (uint i = 0; i < nstacks; i++) nfuncs += stacks[i].depth;
+  struct profile_func *funcs = malloc(nfuncs * sizeof(*funcs));
+  if (!funcs) {
+    free(stacks);
+    printf("out of memory\n");
+    return;
+  }
+
+  nfuncs = 0;
+  for (uint i = 0; i < nstacks; i++) {
+    const struct profile_stack *st = &stacks[i];
+    for (uint j = 0; j < st->depth; j++) {
+      // a recursive function counts once per stack towards its total
+      bool seen = false;
+      for (uint k = 0; k < j && !seen; k++) seen = st->key[k] == st->key[j];
+      if (seen) continue;
+      funcs[nfuncs++] = (struct profile_func){ st->key[j], j == 0 ? st->count : 0, st->count };
+    }
+  }
+  free(stacks);
+
+  qsort(funcs, nfuncs, sizeof(*funcs), compare_func_keys);
+  uint unique = 0;
+  for (uint i = 0; i < nfuncs; i++) {
+    if (unique && funcs[unique - 1].key == funcs[i].key) {
+      funcs[unique - 1].self += funcs[i].self;
+      funcs[unique - 1].total += funcs[i].total;
+    } else {
+      funcs[unique++] = funcs[i];
+    }
+  }
+  qsort(funcs, unique, sizeof(*funcs), compare_func_counts);
+
+  printf("%u samples at %u Hz, %s\n", nsamples, profile.hz, ppc64_ksym((uint64_t)&dump_flat, NULL) ?
+         "symbolized" : "no symbol table, run ksyms.sh on the image");
+  printf(" self%%     self  total%%    total  function\n");
+  for (uint i = 0; i < unique && i < rows; i++) {
+    const struct profile_func *f = &funcs[i];
+    printf("%4llu.%llu%% %8u  %4llu.%llu%% %8u  ", f->self * 100ULL / nsamples, f->self * 1000ULL / nsamples % 10,
+           f->self, f->total * 100ULL / nsamples, f->total * 1000ULL / nsamples % 10, f->total);
+    print_func(f->key);
+    printf("\n");
+  }
+  free(funcs);
+}
+
+// one `outermost;...;innermost count` line per distinct stack, what flamegraph.pl and the like take
+static void dump_folded(void) {
+  uint nstacks, nsamples;
+  struct profile_stack *stacks = collect(&nstacks, &nsamples);
+  if (!stacks) return;
+  for (uint i = 0; i < nstacks; i++) {
+    const struct profile_stack *st = &stacks[i];
+    for (uint j = st->depth; j-- > 0;) {
+      print_func(st->key[j]);
+      if (j) printf(";");
+    }
+    printf(" %u\n", st->count);
+  }
+  free(stacks);
+}
+
+static void dump_status(void) {
+  printf("%s, %u Hz\n", profile.running ? "running" : "stopped", profile.hz);
+  printf("cpu  samples     of          dropped\n");
+  for (uint cpu = 0; cpu < SMP_MAX_CPUS; cpu++) {
+    const struct profile_cpu *pc = &profile.cpu[cpu];
+    if (!pc->capacity) continue;
+    printf("%3u  %-10u  %-10u  %llu\n", cpu, ppc64_profile_count(cpu), pc->capacity, pc->dropped);
+  }
+}
+
+static int cmd_profile(int argc, const console_cmd_args *argv) {
+  if (argc < 2) {
+    dump_status();
+    return 0;
+  }
+  if (!strcmp(argv[1].str, "start")) {
+    uint hz = argc > 2 ? argv[2].u : PROFILE_DEFAULT_HZ;
+    uint samples = argc > 3 ? argv[3].u : PROFILE_DEFAULT_SAMPLES;
+    status_t ret = ppc64_profile_start(hz, samples);
+    if (ret == ERR_BUSY) printf("already running\n");
+    if (ret == ERR_INVALID_ARGS) printf("hz between 1 and %u, samples at least 1\n", PROFILE_MAX_HZ);
+    return ret;
+  } else if (!strcmp(argv[1].str, "stop")) {
+    ppc64_profile_stop();
+    dump_status();
+  } else if (!strcmp(argv[1].str, "flat")) {
+    dump_flat(argc > 2 ? argv[2].u : PROFILE_DEFAULT_ROWS);
+  } else if (!strcmp(argv[1].str, "folded")) {
+    dump_folded();
+  } else {
+    printf("usage: profile [start [hz] [samples per cpu] | stop | flat [rows] | folded]\n");
+    return ERR_INVALID_ARGS;
+  }
+  return 0;
+}
+
+STATIC_COMMAND_START
+STATIC_COMMAND("profile", "sampling profiler, flat and folded stack dumps", &cmd_profile)
+STATIC_COMMAND_END(ppc64_profile);
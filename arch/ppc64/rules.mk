@@ -12,16 +12,48 @@ ARCH_COMPILEFLAGS += -mcpu=powerpc64
 #OBJDUMP := vc4-elf-objdump
 
 MODULE_SRCS += $(LOCAL_DIR)/boot.S $(LOCAL_DIR)/arch.c $(LOCAL_DIR)/thread.c $(LOCAL_DIR)/timer.c
+MODULE_SRCS += $(LOCAL_DIR)/boottime.c
+MODULE_SRCS += $(LOCAL_DIR)/cache.c
+MODULE_SRCS += $(LOCAL_DIR)/timer_wheel.c
+MODULE_SRCS += $(LOCAL_DIR)/mp.c
+MODULE_SRCS += $(LOCAL_DIR)/idle.c
+MODULE_SRCS += $(LOCAL_DIR)/exceptions.c
+MODULE_SRCS += $(LOCAL_DIR)/pmu.c
+MODULE_SRCS += $(LOCAL_DIR)/fpu.c $(LOCAL_DIR)/fpu.S
+MODULE_SRCS += $(LOCAL_DIR)/ksyms.c
+MODULE_SRCS += $(LOCAL_DIR)/profile.c
 
 MODULE_SRCS += $(LOCAL_DIR)/mmu.c
+MODULE_SRCS += $(LOCAL_DIR)/slb.c
+MODULE_SRCS += $(LOCAL_DIR)/hpt_direct.c
+MODULE_SRCS += $(LOCAL_DIR)/hpt_hcall.c
 
 GLOBAL_DEFINES += PLATFORM_HAS_DYNAMIC_TIMER=1 ARCH_HAS_MMU=1 IS_64BIT=1
 
+ifeq (true,$(call TOBOOL,$(WITH_SMP)))
+  GLOBAL_DEFINES += WITH_SMP=1 SMP_MAX_CPUS=$(SMP_MAX_CPUS)
+else
+  GLOBAL_DEFINES += SMP_MAX_CPUS=1
+endif
+
 ARCH_OPTFLAGS := -O1
 
+# the profiler's symbol table, linked in zeroed and filled in from the linked image by ksyms.sh
+PPC64_KSYMS_SIZE ?= 0x40000
+GLOBAL_DEFINES += PPC64_KSYMS_SIZE=$(PPC64_KSYMS_SIZE)
+PPC64_KSYMS_SCRIPT := $(LOCAL_DIR)/ksyms.sh
+
+EXTRA_BUILDDEPS += $(OUTELF).ksyms
+GENERATED += $(OUTELF).ksyms
+$(OUTBIN): $(OUTELF).ksyms
+$(OUTELF).ksyms: $(OUTELF) $(PPC64_KSYMS_SCRIPT)
+	@echo filling in the symbol table: $<
+	$(NOECHO)NM=$(NM) OBJDUMP=$(OBJDUMP) OBJCOPY=$(OBJCOPY) sh $(PPC64_KSYMS_SCRIPT) $< $@
+
 ifeq (true,$(call TOBOOL,$(WITH_KERNEL_VM)))
-  KERNEL_ASPACE_BASE := 0x1000000
-  KERNEL_ASPACE_SIZE := 0x1000000
+  # the linear map, PPC64_LINEAR_BASE in arch/hpt.h
+  KERNEL_ASPACE_BASE := 0xc000000000000000
+  KERNEL_ASPACE_SIZE := 0x0000010000000000
 
   GLOBAL_DEFINES += ARCH_HAS_MMU=1 KERNEL_ASPACE_BASE=$(KERNEL_ASPACE_BASE) KERNEL_ASPACE_SIZE=$(KERNEL_ASPACE_SIZE)
 endif
@@ -0,0 +1,119 @@
+#include <arch/cpu_regs.h>
+#include <arch/hpt.h>
+#include <arch/ops.h>
+#include <arch/ppc64.h>
+#include <kernel/thread.h>
+#include <lk/console_cmd.h>
+#include <lk/debug.h>
+#include <stdio.h>
+#include <string.h>
+
+// segment lookaside buffer manager
+// entries below SLB_BOLTED hold kernel segments, they are loaded once per cpu and never replaced
+// everything else comes in on a segment miss and takes the next replaceable entry, round robin
+
+static uint64_t bolted[SLB_BOLTED];
+static uint nbolted;
+
+struct slb_percpu {
+  uint next;                      // round robin cursor, 0 is entry SLB_BOLTED
+  uint64_t loaded[SLB_ENTRIES];   // esid + 1 of what each replaceable entry holds, 0 if empty
+  uint64_t misses;
+  uint64_t flushes;
+} __ALIGNED(CACHE_LINE);
+
+static struct slb_percpu slb_cpu[SMP_MAX_CPUS];
+
+static void slb_load(uint index, uint32_t ctx, bool large, uint64_t esid) {
+  slbmte(hpt_vsid(ctx, esid), 1, 1, 0, large, 0, esid, 1, index);
+}
+
+bool ppc64_slb_bolt(uint64_t esid) {
+  if (nbolted == SLB_BOLTED) return false;
+  bolted[nbolted++] = esid;
+  return true;
+}
+
+// bolted segments are kernel ones, the mmu knows which of them use large pages
+void ppc64_slb_init_percpu(void) {
+  // slbia leaves entry 0 alone, the first bolted segment overwrites whatever firmware left in it
+  __asm__ volatile("slbia" ::: "memory");
+  for (uint i = 0; i < nbolted; i++) {
+    uint32_t ctx;
+    bool large;
+    bool ok = ppc64_mmu_segment(bolted[i] << HPT_SEGMENT_SHIFT, &ctx, &large);
+    DEBUG_ASSERT(ok && ctx == 0);
+    slb_load(i, ctx, large, bolted[i]);
+  }
+  __asm__ volatile("isync" ::: "memory");
+  memset(slb_cpu[arch_curr_cpu_num()].loaded, 0, sizeof(slb_cpu[0].loaded));
+}
+
+// 0x380 and 0x480, reached through the fast exception path with only the volatile registers saved
+bool ppc64_slb_miss(struct ppc64_iframe *frame) {
+  vaddr_t ea = frame->vector == 0x380 ? frame->dar : frame->srr0;
+  uint32_t ctx;
+  bool large;
+  if (!ppc64_mmu_segment(ea, &ctx, &large)) return false;
+
+  struct slb_percpu *s = &slb_cpu[arch_curr_cpu_num()];
+  uint index = SLB_BOLTED + s->next;
+  if (++s->next == SLB_ENTRIES - SLB_BOLTED) s->next = 0;
+
+  // slbmte over a valid entry leaves the old segment's translations in the erat
+  if (s->loaded[index]) {
+    __asm__ volatile("slbie %0" : : "r"((s->loaded[index] - 1) << HPT_SEGMENT_SHIFT) : "memory");
+  }
+  uint64_t esid = ea >> HPT_SEGMENT_SHIFT;
+  slb_load(index, ctx, large, esid);
+  __asm__ volatile("isync" ::: "memory");
+  s->loaded[index] = esid + 1;
+
+  s->misses++;
+  thread_t *t = get_current_thread();
+  if (t) t->arch.slb_misses++;
+  return true;
+}
+
+// drops every replaceable entry, the bolted kernel segments hold the stack and the code doing this
+void ppc64_slb_flush(void) {
+  struct slb_percpu *s = &slb_cpu[arch_curr_cpu_num()];
+  for (uint i = SLB_BOLTED; i < SLB_ENTRIES; i++) {
+    if (!s->loaded[i]) continue;
+    __asm__ volatile("slbie %0" : : "r"((s->loaded[i] - 1) << HPT_SEGMENT_SHIFT) : "memory");
+    s->loaded[i] = 0;
+  }
+  __asm__ volatile("isync" ::: "memory");
+  s->flushes++;
+}
+
+static int cmd_slb(int argc, const console_cmd_args *argv) {
+  if (argc > 1 && !strcmp(argv[1].str, "reset")) {
+    for (uint cpu = 0; cpu < SMP_MAX_CPUS; cpu++) {
+      slb_cpu[cpu].misses = 0;
+      slb_cpu[cpu].flushes = 0;
+    }
+    return 0;
+  }
+
+  printf("cpu  misses      flushes\n");
+  for (uint cpu = 0; cpu < SMP_MAX_CPUS; cpu++) {
+    if (!slb_cpu[cpu].misses && !slb_cpu[cpu].flushes) continue;
+    printf("%-4u %-11llu %llu\n", cpu, slb_cpu[cpu].misses, slb_cpu[cpu].flushes);
+  }
+
+  printf("cpu %u, %u bolted\n", arch_curr_cpu_num(), nbolted);
+  for (uint i = 0; i < SLB_ENTRIES; i++) {
+    uint64_t esid, vsid;
+    __asm__ volatile("slbmfee %0, %1" : "=r"(esid) : "r"((uint64_t)i));
+    __asm__ volatile("slbmfev %0, %1" : "=r"(vsid) : "r"((uint64_t)i));
+    if (!(esid & (1ULL << 27))) continue;
+    printf("%2u esid 0x%09llx vsid 0x%010llx%s%s\n", i, esid >> HPT_SEGMENT_SHIFT, vsid >> 12,
+           vsid & (1ULL << 8) ? " large" : "", i < SLB_BOLTED ? " bolted" : "");
+  }
+  return 0;
+}
+
+STATIC_COMMAND_START
+STATIC_COMMAND("slb", "slb entries and miss counts [reset]", &cmd_slb)
+STATIC_COMMAND_END(slb);
@@ -1,4 +1,7 @@
+#include <arch/pmu.h>
+#include <arch/ppc64.h>
 #include <kernel/thread.h>
+#include <lk/debug.h>
 #include <string.h>
 
 static void initial_thread_func(void) __NO_RETURN;
@@ -15,14 +18,21 @@ void arch_thread_initialize(thread_t *t) {
   memset(&t->arch, 0, sizeof(struct arch_thread));
   t->arch.lr = (uint64_t)&initial_thread_func;
   t->arch.sp = (uint64_t)((t->stack + t->stack_size) - 32);
+  // VSCR[NJ], non-java mode, what compiled vmx code expects
+  t->arch.vmx.vscr[3] = 0x10000;
+  DEBUG_ASSERT(((uintptr_t)&t->arch.vmx & 15) == 0);
   //printf("&lr %p\n", &t->arch.lr);
 }
 
 void arch_dump_thread(thread_t *t) {
+  dprintf(INFO, "\tarch: slb misses %llu, fp loads %llu, vmx loads %llu\n", t->arch.slb_misses,
+          t->arch.fp_traps, t->arch.vmx_traps);
 }
 
 void ppc64_context_switch(struct arch_thread *oldsp, struct arch_thread *newsp);
 
 void arch_context_switch(thread_t *oldthread, thread_t *newthread) {
+  if (ppc64_pmu_active) ppc64_pmu_context_switch(oldthread, newthread);
+  ppc64_fpu_context_switch(oldthread);
   ppc64_context_switch(&oldthread->arch, &newthread->arch);
 }
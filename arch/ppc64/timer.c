@@ -1,20 +1,171 @@
 #include <platform/timer.h>
 #include <arch/cpu_regs.h>
+#include <arch/ops.h>
+#include <arch/ppc64.h>
+#include <arch/ticks.h>
+#include <arch/timer_wheel.h>
+#include <lk/console_cmd.h>
+#include <lk/debug.h>
 #include <lk/err.h>
 #include <stdio.h>
 
+// what xenon runs at, platforms with a device tree replace it in platform_early_init
+#define DEFAULT_TB_FREQ 50000000ULL
+
+// the decrementer interrupts when it goes negative, so this is as far out as it can be programmed
+#define DEC_MAX 0x7fffffff
+
+// lets LK timers that land within this window of each other share one decrementer interrupt
+#define PLATFORM_TIMER_SLACK_US 50
+
+struct platform_timer {
+  struct ppc64_timer timer;
+  platform_timer_callback callback;
+  void *arg;
+};
+
+static struct timer_wheel timer_wheels[SMP_MAX_CPUS];
+static struct platform_timer platform_timers[SMP_MAX_CPUS];
+static uint64_t dec_irqs[SMP_MAX_CPUS];
+static const struct ppc64_iframe *dec_frames[SMP_MAX_CPUS];
+
+uint64_t ppc64_tb_freq;
+struct tb_scale ppc64_tb_to_ns, ppc64_tb_to_us, ppc64_tb_to_ms;
+struct tb_scale ppc64_us_to_tb;
+
+// current_time() and current_time_hires() count from here, the platform replacing the default frequency
+// moves it up to that moment, so the clock carries on instead of jumping
+static uint64_t epoch_tb, epoch_us, epoch_ms;
+
+struct tb_scale tb_scale_make(uint64_t num, uint64_t den) {
+  struct tb_scale s;
+  s.whole = num / den;
+  s.frac = (uint64_t)(((unsigned __int128)(num % den) << 64) / den);
+  return s;
+}
+
+// before the secondary cpus start, nothing else reads the scales or the epoch while they change
+void ppc64_timebase_init(uint64_t freq) {
+  if (ppc64_tb_freq) {
+    uint64_t now = lk_ticks();
+    epoch_us += lk_ticks_to_us(now - epoch_tb);
+    epoch_ms += lk_ticks_to_ms(now - epoch_tb);
+    epoch_tb = now;
+  }
+  ppc64_tb_to_ns = tb_scale_make(1000000000, freq);
+  ppc64_tb_to_us = tb_scale_make(1000000, freq);
+  ppc64_tb_to_ms = tb_scale_make(1000, freq);
+  ppc64_us_to_tb = tb_scale_make(freq, 1000000);
+  ppc64_tb_freq = freq;
+}
+
 lk_bigtime_t current_time_hires(void) {
-  return tbl_read()/50;
+  return epoch_us + lk_ticks_to_us(lk_ticks() - epoch_tb);
 }
 
 lk_time_t current_time(void) {
-  return tbl_read()/50/1000;
+  return epoch_ms + lk_ticks_to_ms(lk_ticks() - epoch_tb);
+}
+
+// tickless, the decrementer only ever fires for the earliest deadline on the wheel
+static void program_decrementer(struct timer_wheel *w) {
+  uint64_t deadline;
+  if (!timer_wheel_next(w, &deadline)) {
+    dec_write(DEC_MAX);
+    return;
+  }
+  int64_t delta = (int64_t)(deadline - lk_ticks());
+  if (delta < 1) delta = 1;
+  if (delta > DEC_MAX) delta = DEC_MAX;
+  dec_write(delta);
+}
+
+void ppc64_timer_init_percpu(void) {
+  uint cpu = arch_curr_cpu_num();
+  if (cpu == 0) ppc64_timebase_init(DEFAULT_TB_FREQ);
+  dec_write(DEC_MAX);
+  timer_wheel_init(&timer_wheels[cpu], lk_ticks());
+  ppc64_timer_init(&platform_timers[cpu].timer);
+}
+
+void ppc64_timer_init(struct ppc64_timer *t) {
+  *t = (struct ppc64_timer)PPC64_TIMER_INITIAL_VALUE;
+}
+
+void ppc64_timer_arm(struct ppc64_timer *t, uint64_t expires, uint64_t slack,
+                     ppc64_timer_callback callback, void *arg) {
+  spin_lock_saved_state_t state;
+  arch_interrupt_save(&state, SPIN_LOCK_FLAG_INTERRUPTS);
+  struct timer_wheel *w = &timer_wheels[arch_curr_cpu_num()];
+  timer_wheel_add(w, t, expires, slack, callback, arg);
+  program_decrementer(w);
+  arch_interrupt_restore(state, SPIN_LOCK_FLAG_INTERRUPTS);
+}
+
+// a timer on another cpu's wheel leaves that decrementer armed, it just finds nothing to run
+bool ppc64_timer_cancel(struct ppc64_timer *t) {
+  return timer_wheel_cancel(t);
+}
+
+// with interrupts disabled, so the answer still holds when the caller acts on it
+bool ppc64_timer_next(uint64_t *deadline) {
+  DEBUG_ASSERT(arch_ints_disabled());
+  return timer_wheel_next(&timer_wheels[arch_curr_cpu_num()], deadline);
+}
+
+static enum handler_return platform_timer_fire(struct ppc64_timer *t, uint64_t now, void *arg) {
+  struct platform_timer *pt = arg;
+  return pt->callback(pt->arg, current_time());
 }
 
 status_t platform_set_oneshot_timer (platform_timer_callback callback, void *arg, lk_time_t interval) {
-  printf("setting timer for %d ms\n", interval);
+  struct platform_timer *pt = &platform_timers[arch_curr_cpu_num()];
+  pt->callback = callback;
+  pt->arg = arg;
+  uint64_t expires = lk_ticks() + lk_ms_to_ticks(interval);
+  ppc64_timer_arm(&pt->timer, expires, lk_us_to_ticks(PLATFORM_TIMER_SLACK_US), platform_timer_fire, pt);
   return NO_ERROR;
 }
 
 void platform_stop_timer(void) {
+  ppc64_timer_cancel(&platform_timers[arch_curr_cpu_num()].timer);
 }
+
+enum handler_return ppc64_decrementer_irq(struct ppc64_iframe *frame) {
+  uint cpu = arch_curr_cpu_num();
+  struct timer_wheel *w = &timer_wheels[cpu];
+  dec_irqs[cpu]++;
+
+  // push the decrementer out first, it stays negative and would interrupt again as soon as EE is back on
+  dec_write(DEC_MAX);
+  dec_frames[cpu] = frame;
+  enum handler_return ret = timer_wheel_run(w, lk_ticks());
+  dec_frames[cpu] = NULL;
+  program_decrementer(w);
+  return ret;
+}
+
+const struct ppc64_iframe *ppc64_timer_irq_frame(void) {
+  return dec_frames[arch_curr_cpu_num()];
+}
+
+// only matters to a hypervisor running guests, keep it quiet
+enum handler_return ppc64_hdecrementer_irq(struct ppc64_iframe *frame) {
+  hdec_write(DEC_MAX);
+  return INT_NO_RESCHEDULE;
+}
+
+static int cmd_timers(int argc, const console_cmd_args *argv) {
+  printf("timebase %llu Hz\n", ppc64_tb_freq);
+  printf("cpu  dec_irqs    runs        fired       cascaded    coalesced\n");
+  for (uint cpu = 0; cpu < SMP_MAX_CPUS; cpu++) {
+    const struct timer_wheel *w = &timer_wheels[cpu];
+    if (!w->runs && !dec_irqs[cpu]) continue;
+    printf("%3u  %-10llu  %-10llu  %-10llu  %-10llu  %llu\n", cpu, dec_irqs[cpu], w->runs, w->fired, w->cascaded, w->coalesced);
+  }
+  return 0;
+}
+
+STATIC_COMMAND_START
+STATIC_COMMAND("timers", "decrementer and timer wheel stats", &cmd_timers)
+STATIC_COMMAND_END(ppc64_timer);
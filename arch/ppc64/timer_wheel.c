@@ -0,0 +1,174 @@
+#include <arch/timer_wheel.h>
+#include <kernel/spinlock.h>
+
+// cascading wheel, a timer sits in the lowest level whose 64 slots still reach its deadline
+// level 0 buckets are due once their whole granule has passed, so nothing in them fires early
+// higher level buckets are due at the start of their granule, and get re-filed into lower levels
+
+static inline uint level_shift(uint level) {
+  return TIMER_WHEEL_SHIFT0 + level * TIMER_WHEEL_SLOT_BITS;
+}
+
+static inline uint64_t bucket_deadline(uint level, uint64_t granule) {
+  if (level == 0) return ((granule + 1) << TIMER_WHEEL_SHIFT0) - 1;
+  return granule << level_shift(level);
+}
+
+// pick the instant in [expires, expires + slack] with the most trailing zero bits,
+// timers armed with slack then line up on the same boundaries and share an interrupt
+static uint64_t apply_slack(uint64_t expires, uint64_t slack) {
+  uint64_t latest = expires + slack;
+  if (slack == 0 || latest < expires) return expires;
+  uint bit = 63 - __builtin_clzll(expires ^ latest);
+  return latest & ~((1ULL << bit) - 1);
+}
+
+static void wheel_insert(struct timer_wheel *w, struct ppc64_timer *t) {
+  uint64_t when = t->latest > w->clk ? t->latest : w->clk;
+  uint level;
+  uint64_t granule;
+  for (level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+    granule = when >> level_shift(level);
+    if (granule - (w->clk >> level_shift(level)) < TIMER_WHEEL_SLOTS) break;
+  }
+  if (level == TIMER_WHEEL_LEVELS) {
+    // beyond the top level, park in its furthest slot and re-file from there
+    level = TIMER_WHEEL_LEVELS - 1;
+    granule = (w->clk >> level_shift(level)) + TIMER_WHEEL_SLOTS - 1;
+  }
+
+  uint slot = granule & (TIMER_WHEEL_SLOTS - 1);
+  t->bucket = level * TIMER_WHEEL_SLOTS + slot;
+  list_add_tail(&w->slots[level][slot], &t->node);
+  w->pending[level] |= 1ULL << slot;
+}
+
+static void wheel_remove(struct timer_wheel *w, struct ppc64_timer *t) {
+  uint level = t->bucket / TIMER_WHEEL_SLOTS;
+  uint slot = t->bucket % TIMER_WHEEL_SLOTS;
+  list_delete(&t->node);
+  if (list_is_empty(&w->slots[level][slot])) {
+    w->pending[level] &= ~(1ULL << slot);
+  }
+}
+
+// earliest due bucket, relative to w->clk
+static bool wheel_first(struct timer_wheel *w, uint *level_out, uint *slot_out, uint64_t *deadline_out) {
+  bool found = false;
+  for (uint level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+    uint64_t bits = w->pending[level];
+    if (!bits) continue;
+    uint64_t base = w->clk >> level_shift(level);
+    uint cur = base & (TIMER_WHEEL_SLOTS - 1);
+    uint64_t rotated = cur ? (bits >> cur) | (bits << (TIMER_WHEEL_SLOTS - cur)) : bits;
+    uint offset = __builtin_ctzll(rotated);
+    uint64_t deadline = bucket_deadline(level, base + offset);
+    if (!found || deadline < *deadline_out) {
+      found = true;
+      *level_out = level;
+      *slot_out = (cur + offset) & (TIMER_WHEEL_SLOTS - 1);
+      *deadline_out = deadline;
+    }
+  }
+  return found;
+}
+
+void timer_wheel_init(struct timer_wheel *w, uint64_t now) {
+  spin_lock_init(&w->lock);
+  w->clk = now;
+  for (uint level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+    w->pending[level] = 0;
+    for (uint slot = 0; slot < TIMER_WHEEL_SLOTS; slot++) {
+      list_initialize(&w->slots[level][slot]);
+    }
+  }
+  w->runs = w->fired = w->cascaded = w->coalesced = 0;
+}
+
+void timer_wheel_add(struct timer_wheel *w, struct ppc64_timer *t, uint64_t expires, uint64_t slack,
+                     ppc64_timer_callback callback, void *arg) {
+  timer_wheel_cancel(t);
+
+  spin_lock_saved_state_t state;
+  spin_lock_irqsave(&w->lock, state);
+  t->expires = expires;
+  t->latest = apply_slack(expires, slack);
+  t->callback = callback;
+  t->arg = arg;
+  t->wheel = w;
+  wheel_insert(w, t);
+  spin_unlock_irqrestore(&w->lock, state);
+}
+
+bool timer_wheel_cancel(struct ppc64_timer *t) {
+  struct timer_wheel *w = t->wheel;
+  if (!w) return false;
+
+  bool pending = false;
+  spin_lock_saved_state_t state;
+  spin_lock_irqsave(&w->lock, state);
+  if (t->wheel == w && list_in_list(&t->node)) {
+    wheel_remove(w, t);
+    pending = true;
+  }
+  t->wheel = NULL;
+  spin_unlock_irqrestore(&w->lock, state);
+  return pending;
+}
+
+bool timer_wheel_next(struct timer_wheel *w, uint64_t *deadline) {
+  uint level, slot;
+  spin_lock_saved_state_t state;
+  spin_lock_irqsave(&w->lock, state);
+  bool found = wheel_first(w, &level, &slot, deadline);
+  spin_unlock_irqrestore(&w->lock, state);
+  return found;
+}
+
+enum handler_return timer_wheel_run(struct timer_wheel *w, uint64_t now) {
+  struct list_node expired = LIST_INITIAL_VALUE(expired);
+  enum handler_return ret = INT_NO_RESCHEDULE;
+
+  spin_lock_saved_state_t state;
+  spin_lock_irqsave(&w->lock, state);
+  w->runs++;
+
+  uint level, slot;
+  uint64_t deadline;
+  while (wheel_first(w, &level, &slot, &deadline) && deadline <= now) {
+    // buckets are taken in deadline order, so clk only moves forward
+    if (deadline > w->clk) w->clk = deadline;
+
+    struct list_node *head = &w->slots[level][slot];
+    w->pending[level] &= ~(1ULL << slot);
+    struct ppc64_timer *t;
+    while ((t = list_remove_head_type(head, struct ppc64_timer, node))) {
+      if (t->expires <= now) {
+        if (t->latest > now) w->coalesced++;
+        list_add_tail(&expired, &t->node);
+      } else {
+        // lands in a lower level, since its granule in this one has started
+        w->cascaded++;
+        wheel_insert(w, t);
+      }
+    }
+  }
+  if (now > w->clk) w->clk = now;
+
+  for (;;) {
+    struct ppc64_timer *t = list_remove_head_type(&expired, struct ppc64_timer, node);
+    if (!t) break;
+    t->wheel = NULL;
+    w->fired++;
+    ppc64_timer_callback callback = t->callback;
+    void *arg = t->arg;
+
+    // the callback may re-arm its timer on this wheel
+    spin_unlock_irqrestore(&w->lock, state);
+    if (callback(t, now, arg) == INT_RESCHEDULE) ret = INT_RESCHEDULE;
+    spin_lock_irqsave(&w->lock, state);
+  }
+  spin_unlock_irqrestore(&w->lock, state);
+
+  return ret;
+}
@@ -0,0 +1,11 @@
+# included by lk's lib/libc/string/rules.mk, found through the overlay's include path
+LOCAL_DIR := $(GET_LOCAL_DIR)
+
+ASM_STRING_OPS := bzero memcpy memmove memset
+
+MODULE_SRCS += \
+	$(LOCAL_DIR)/string.c \
+	$(LOCAL_DIR)/vmx.S
+
+# filter out the C implementation
+C_STRING_OPS := $(filter-out $(ASM_STRING_OPS),$(C_STRING_OPS))
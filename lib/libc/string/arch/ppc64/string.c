@@ -0,0 +1,246 @@
+#include <arch/defines.h>
+#include <arch/ppc64.h>
+#include <arch/ticks.h>
+#include <lk/console_cmd.h>
+#include <lk/macros.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// memcpy, memmove, memset and bzero for ppc64, picked by size and alignment
+//   below SMALL_MAX bytes, byte and doubleword moves
+//   up to VMX_MIN, unrolled doubleword loops, a misaligned source is spliced from aligned loads
+//   from VMX_MIN, 64 byte vmx loops with dcbt/dcbtst running ahead, see vmx.S
+//   clears of DCBZ_MIN and up zero every whole block with dcbz, which never reads it in, the block
+//   size is measured by clear_bss()
+// vmx is only used from threads with interrupts on, the first use loads that thread's vector state
+// lazily (arch/ppc64/fpu.c), an interrupt handler must not touch it
+// dcbz faults on caching-inhibited memory, device memory must not be cleared with these
+
+#define SMALL_MAX 16
+#define VMX_MIN   256
+#define DCBZ_MIN  512
+
+typedef uint64_t __attribute__((may_alias)) word_t;
+
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define SPLICE(a, b, sh) (((a) << (sh)) | ((b) >> (64 - (sh))))
+#else
+#define SPLICE(a, b, sh) (((a) >> (sh)) | ((b) << (64 - (sh))))
+#endif
+
+// vmx.S
+void ppc64_vmx_copy(void *dst, const void *src, size_t len);
+void ppc64_vmx_fill(void *dst, const void *pattern, size_t len);
+void ppc64_dcbz_clear(void *dst, size_t blocks, size_t size);
+
+static inline bool vmx_usable(void) {
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  return mfmsr() & MSR_EE;
+#else
+  return false; // the lvsl/vperm splice in vmx.S assumes big endian
+#endif
+}
+
+// d is doubleword aligned, n a multiple of 8
+// safe for overlap with d below s, every load happens before the store that could clobber it
+static void copy_words(uint8_t *d, const uint8_t *s, size_t n) {
+  word_t *dw = (word_t *)d;
+  uint sh = ((uintptr_t)s & 7) * 8;
+  if (!sh) {
+    const word_t *sw = (const word_t *)s;
+    for (; n >= 32; n -= 32, dw += 4, sw += 4) {
+      uint64_t a = sw[0], b = sw[1], c = sw[2], e = sw[3];
+      dw[0] = a;
+      dw[1] = b;
+      dw[2] = c;
+      dw[3] = e;
+    }
+    for (; n; n -= 8) *dw++ = *sw++;
+    return;
+  }
+
+  // aligned loads only, each of them holds at least one byte of the source
+  const word_t *sw = (const word_t *)((uintptr_t)s & ~7);
+  uint64_t a = *sw++;
+  for (; n; n -= 8) {
+    uint64_t b = *sw++;
+    *dw++ = SPLICE(a, b, sh);
+    a = b;
+  }
+}
+
+static void copy_fwd(uint8_t *d, const uint8_t *s, size_t n) {
+  if (n < SMALL_MAX) {
+    if (!(((uintptr_t)d | (uintptr_t)s) & 7) && n >= 8) {
+      *(word_t *)d = *(const word_t *)s;
+      d += 8;
+      s += 8;
+      n -= 8;
+    }
+    while (n--) *d++ = *s++;
+    return;
+  }
+
+  while ((uintptr_t)d & 7) {
+    *d++ = *s++;
+    n--;
+  }
+  if (n >= VMX_MIN && vmx_usable()) {
+    if ((uintptr_t)d & 8) {
+      copy_words(d, s, 8);
+      d += 8;
+      s += 8;
+      n -= 8;
+    }
+    size_t bulk = n & ~(size_t)63;
+    ppc64_vmx_copy(d, s, bulk);
+    d += bulk;
+    s += bulk;
+    n -= bulk;
+  }
+  size_t words = n & ~(size_t)7;
+  copy_words(d, s, words);
+  d += words;
+  s += words;
+  n -= words;
+  while (n--) *d++ = *s++;
+}
+
+// d is above s and overlaps it
+static void copy_bwd(uint8_t *d, const uint8_t *s, size_t n) {
+  d += n;
+  s += n;
+  if (!(((uintptr_t)d ^ (uintptr_t)s) & 7)) {
+    while (n && ((uintptr_t)d & 7)) {
+      *--d = *--s;
+      n--;
+    }
+    for (; n >= 8; n -= 8) {
+      d -= 8;
+      s -= 8;
+      *(word_t *)d = *(const word_t *)s;
+    }
+  }
+  while (n--) *--d = *--s;
+}
+
+void *memcpy(void *dest, const void *src, size_t count) {
+  copy_fwd(dest, src, count);
+  return dest;
+}
+
+void *memmove(void *dest, const void *src, size_t count) {
+  // forward is safe whenever dest does not start inside the source
+  if ((uintptr_t)dest - (uintptr_t)src >= count) {
+    copy_fwd(dest, src, count);
+  } else if (dest != src) {
+    copy_bwd(dest, src, count);
+  }
+  return dest;
+}
+
+void *memset(void *s, int c, size_t count) {
+  uint8_t *d = s;
+  size_t n = count;
+  uint64_t pattern = (uint8_t)c * 0x0101010101010101ULL;
+  if (n < SMALL_MAX) {
+    while (n--) *d++ = c;
+    return s;
+  }
+
+  while ((uintptr_t)d & 7) {
+    *d++ = c;
+    n--;
+  }
+  if (!pattern && ppc64_dcbz_size && n >= DCBZ_MIN) {
+    while ((uintptr_t)d & (ppc64_dcbz_size - 1)) {
+      *(word_t *)d = 0;
+      d += 8;
+      n -= 8;
+    }
+    size_t blocks = n / ppc64_dcbz_size;
+    ppc64_dcbz_clear(d, blocks, ppc64_dcbz_size);
+    d += blocks * ppc64_dcbz_size;
+    n -= blocks * ppc64_dcbz_size;
+  } else if (n >= VMX_MIN && vmx_usable()) {
+    if ((uintptr_t)d & 8) {
+      *(word_t *)d = pattern;
+      d += 8;
+      n -= 8;
+    }
+    uint64_t v[2] __ALIGNED(16) = { pattern, pattern };
+    size_t bulk = n & ~(size_t)63;
+    ppc64_vmx_fill(d, v, bulk);
+    d += bulk;
+    n -= bulk;
+  }
+  for (; n >= 32; n -= 32, d += 32) {
+    word_t *dw = (word_t *)d;
+    dw[0] = pattern;
+    dw[1] = pattern;
+    dw[2] = pattern;
+    dw[3] = pattern;
+  }
+  for (; n >= 8; n -= 8, d += 8) *(word_t *)d = pattern;
+  while (n--) *d++ = c;
+  return s;
+}
+
+void bzero(void *s, size_t count) {
+  memset(s, 0, count);
+}
+
+static uint64_t mb_per_s(size_t bytes, uint iterations, uint64_t ticks) {
+  if (!ticks) return 0;
+  return (uint64_t)bytes * iterations * lk_ticks_freq() / ticks / (1024 * 1024);
+}
+
+static int cmd_membench(int argc, const console_cmd_args *argv) {
+  static const size_t sizes[] = { 15, 64, 200, 1024, 4096, 65536, 1024 * 1024, 4 * 1024 * 1024 };
+  size_t max = argc > 1 ? argv[1].u * 1024 : 4 * 1024 * 1024;
+
+  uint8_t *buf = malloc(2 * max + 64);
+  if (!buf) {
+    printf("no memory for 2x %zu bytes\n", max);
+    return -1;
+  }
+  printf("dcbz %zu bytes, cache line %u\n", ppc64_dcbz_size, CACHE_LINE);
+  printf("size      memcpy  memcpy+1  memmove  memset  bzero   (MB/s)\n");
+  for (uint i = 0; i < countof(sizes) && sizes[i] <= max; i++) {
+    size_t n = sizes[i];
+    // about 16MB per measurement, at least 4 rounds
+    uint iterations = MAX(4, (16 * 1024 * 1024) / n);
+    uint8_t *dst = buf;
+    uint8_t *src = buf + max + 32;
+    uint64_t t[5];
+
+    uint64_t start = lk_ticks();
+    for (uint it = 0; it < iterations; it++) memcpy(dst, src, n);
+    t[0] = lk_ticks() - start;
+    start = lk_ticks();
+    for (uint it = 0; it < iterations; it++) memcpy(dst, src + 1, n);
+    t[1] = lk_ticks() - start;
+    start = lk_ticks();
+    for (uint it = 0; it < iterations; it++) memmove(dst + 1, dst, n);
+    t[2] = lk_ticks() - start;
+    start = lk_ticks();
+    for (uint it = 0; it < iterations; it++) memset(dst, 0x5a, n);
+    t[3] = lk_ticks() - start;
+    start = lk_ticks();
+    for (uint it = 0; it < iterations; it++) bzero(dst, n);
+    t[4] = lk_ticks() - start;
+
+    printf("%-9zu %-7llu %-9llu %-8llu %-7llu %llu\n", n, mb_per_s(n, iterations, t[0]),
+           mb_per_s(n, iterations, t[1]), mb_per_s(n, iterations, t[2]),
+           mb_per_s(n, iterations, t[3]), mb_per_s(n, iterations, t[4]));
+  }
+  free(buf);
+  return 0;
+}
+
+STATIC_COMMAND_START
+STATIC_COMMAND("membench", "memcpy/memmove/memset/bzero bandwidth [max kb]", &cmd_membench)
+STATIC_COMMAND_END(ppc64_string);
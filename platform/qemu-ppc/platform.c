@@ -1,14 +1,31 @@
 #include <app.h>
 #include <arch/cpu_regs.h>
+#include <arch/hpt.h>
+#include <arch/ops.h>
+#include <arch/ppc64.h>
+#include <arch/ticks.h>
+#include <kernel/event.h>
+#include <kernel/spinlock.h>
+#include <kernel/thread.h>
+#include <kernel/timer.h>
 #include <lib/cbuf.h>
+#include <lib/console.h>
 #include <lib/io.h>
+#include <libfdt.h>
 #include <lk/console_cmd.h>
+#include <lk/err.h>
+#include <lk/macros.h>
+#include <lk/main.h>
 #include <lk/reg.h>
+#include <platform.h>
 #include <platform/debug.h>
+#include <platform/interrupts.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <arch/hypercalls.h>
+#include "rtas.h"
+#include "xics.h"
 
 //#define UART_DR 0x3f8
 #define UART_DR (0xe0000000ULL + 0x4500ULL + 0)
@@ -16,13 +33,14 @@
 #if WITH_KERNEL_VM
 #include <kernel/vm.h>
 
+// all of ram at the linear map, the size is fixed up from /memory once the fdt has been read
 struct mmu_initial_mapping mmu_initial_mappings[] = {
   {
-    .phys = 16<<20,
-    .virt = 16<<20,
-    .size = 2<<20,
+    .phys = 0,
+    .virt = KERNEL_ASPACE_BASE,
+    .size = MEMBASE + MEMSIZE,
     .flags = 0,
-    .name = "memory",
+    .name = "physmap",
   },
   { 0 }
 };
@@ -36,17 +54,210 @@ static pmm_arena_t arena = {
 #endif
 
 static int cmd_p(int argc, const console_cmd_args *argv);
-static int cmd_x(int argc, const console_cmd_args *argv);
+static int cmd_conbench(int argc, const console_cmd_args *argv);
+static int cmd_vty(int argc, const console_cmd_args *argv);
 
 STATIC_COMMAND_START
 STATIC_COMMAND("p", "", &cmd_p)
-STATIC_COMMAND("x", "", &cmd_x)
+STATIC_COMMAND("conbench", "console bytes/s, buffered and one hcall per byte [bytes]", &cmd_conbench)
+STATIC_COMMAND("vty", "hypervisor console input stats", &cmd_vty)
 STATIC_COMMAND_END(platform);
 
+static uint cpu_count = 1;
+
+// the boot cpu becomes cpu 0, every other thread of every /cpus node follows in order
+static void scan_cpus(const void *fdt) {
+  uint32_t boot_id = fdt_boot_cpuid_phys(fdt);
+  ppc64_get_percpu_for(0)->hw_id = boot_id;
+
+  int cpus = fdt_path_offset(fdt, "/cpus");
+  if (cpus < 0) return;
+  int node;
+  fdt_for_each_subnode(node, fdt, cpus) {
+    const char *type = fdt_getprop(fdt, node, "device_type", NULL);
+    if (!type || strcmp(type, "cpu")) continue;
+    int len;
+    const fdt32_t *servers = fdt_getprop(fdt, node, "ibm,ppc-interrupt-server#s", &len);
+    if (!servers) continue;
+    for (int i = 0; i < len / (int)sizeof(*servers); i++) {
+      uint32_t id = fdt32_to_cpu(servers[i]);
+      if (id == boot_id) continue;
+      if (cpu_count == SMP_MAX_CPUS) return;
+      ppc64_get_percpu_for(cpu_count++)->hw_id = id;
+    }
+  }
+}
+
+// qemu pseries runs the timebase at 512MHz, but the device tree is authoritative
+static void scan_timebase(const void *fdt) {
+  int cpus = fdt_path_offset(fdt, "/cpus");
+  if (cpus < 0) return;
+  int node;
+  fdt_for_each_subnode(node, fdt, cpus) {
+    int len;
+    const fdt32_t *freq = fdt_getprop(fdt, node, "timebase-frequency", &len);
+    if (!freq) continue;
+    uint64_t hz = fdt32_to_cpu(freq[0]);
+    if (len == 2 * sizeof(*freq)) hz = (hz << 32) | fdt32_to_cpu(freq[1]);
+    if (hz) ppc64_timebase_init(hz);
+    return;
+  }
+}
+
+// log2 of the hash table size the hypervisor gave us, the second cell of ibm,pft-size
+static void scan_pft_size(const void *fdt) {
+  int cpus = fdt_path_offset(fdt, "/cpus");
+  if (cpus < 0) return;
+  int node;
+  fdt_for_each_subnode(node, fdt, cpus) {
+    int len;
+    const fdt32_t *pft = fdt_getprop(fdt, node, "ibm,pft-size", &len);
+    if (!pft || len != 2 * sizeof(*pft)) continue;
+    hpt_hcall_pft_shift = fdt32_to_cpu(pft[1]);
+    return;
+  }
+}
+
+// dcbst/dcbf/icbi work on blocks, the pvr table in cache.c only covers known cores
+static void scan_cache_blocks(const void *fdt) {
+  int cpus = fdt_path_offset(fdt, "/cpus");
+  if (cpus < 0) return;
+  int node;
+  fdt_for_each_subnode(node, fdt, cpus) {
+    int dlen, ilen;
+    const fdt32_t *d = fdt_getprop(fdt, node, "d-cache-block-size", &dlen);
+    const fdt32_t *i = fdt_getprop(fdt, node, "i-cache-block-size", &ilen);
+    if (!d || !i || dlen != sizeof(*d) || ilen != sizeof(*i)) continue;
+    ppc64_cache_set_block_size(fdt32_to_cpu(*d), fdt32_to_cpu(*i));
+    return;
+  }
+}
+
+static uint64_t ram_size = MEMBASE + MEMSIZE;
+
+// the end of the highest range in /memory@0, 2 address and 2 size cells on pseries
+static void scan_memory(const void *fdt) {
+  int node = fdt_path_offset(fdt, "/memory@0");
+  if (node < 0) return;
+  int len;
+  const fdt32_t *reg = fdt_getprop(fdt, node, "reg", &len);
+  if (!reg) return;
+  uint64_t end = 0;
+  for (int i = 0; i + 4 <= len / (int)sizeof(*reg); i += 4) {
+    uint64_t base = ((uint64_t)fdt32_to_cpu(reg[i]) << 32) | fdt32_to_cpu(reg[i + 1]);
+    uint64_t size = ((uint64_t)fdt32_to_cpu(reg[i + 2]) << 32) | fdt32_to_cpu(reg[i + 3]);
+    if (base + size > end) end = base + size;
+  }
+  if (end) ram_size = end;
+}
+
+static bool large_pages;
+
+// 16MB pages need the cpu and the hypervisor to agree (cap-hpt-max-page-size), qemu lists only what both allow
+// the property is a run of { base shift, slb encoding, count, count * { page shift, LP encoding } }
+static void scan_page_sizes(const void *fdt) {
+  int cpus = fdt_path_offset(fdt, "/cpus");
+  if (cpus < 0) return;
+  int node;
+  fdt_for_each_subnode(node, fdt, cpus) {
+    int len;
+    const fdt32_t *sizes = fdt_getprop(fdt, node, "ibm,segment-page-sizes", &len);
+    if (!sizes) continue;
+    int cells = len / (int)sizeof(*sizes);
+    for (int i = 0; i + 3 <= cells;) {
+      uint32_t base = fdt32_to_cpu(sizes[i]);
+      uint32_t count = fdt32_to_cpu(sizes[i + 2]);
+      i += 3;
+      for (uint32_t j = 0; j < count && i + 2 <= cells; j++, i += 2) {
+        // mmu.c only builds LP 0 large ptes
+        if (base == HPT_LARGE_SHIFT && fdt32_to_cpu(sizes[i]) == HPT_LARGE_SHIFT && fdt32_to_cpu(sizes[i + 1]) == 0)
+          large_pages = true;
+      }
+    }
+    return;
+  }
+}
+
+// console input, the vty interrupt wakes the rx thread when the device tree has one, polling backs off otherwise
+// input only moves into console_input_cbuf while a whole H_GET_TERM_CHAR worth fits, the rest waits in the
+// hypervisor, which stops reading the host side once its own buffer is full
+#define CON_IN_CHUNK        16
+#define CON_POLL_MIN_MS     1
+#define CON_POLL_MAX_MS     64
+
+static struct {
+  spin_lock_t lock;   // one reader of the vterm at a time, so bytes reach the cbuf in order
+  uint64_t unit;      // vterm number, the reg of the vty node
+  uint32_t irq;       // xics source, 0 to poll
+  event_t ready;
+  uint64_t irqs;
+  uint64_t polls;
+  uint64_t stalls;    // times the cbuf was too full to take more
+  bool running;       // the rx thread is up, readers can sleep on the cbuf
+} con_in = { .lock = SPIN_LOCK_INITIAL_VALUE, .ready = EVENT_INITIAL_VALUE(con_in.ready, false, EVENT_FLAG_AUTOUNSIGNAL) };
+
+static void scan_vty(const void *fdt) {
+  int node = fdt_node_offset_by_compatible(fdt, -1, "hvterm1");
+  if (node < 0) return;
+  int len;
+  const fdt32_t *reg = fdt_getprop(fdt, node, "reg", &len);
+  if (reg && len >= (int)sizeof(*reg)) con_in.unit = fdt32_to_cpu(reg[0]);
+  const fdt32_t *irq = fdt_getprop(fdt, node, "interrupts", &len);
+  if (irq && len >= (int)sizeof(*irq)) con_in.irq = fdt32_to_cpu(irq[0]);
+}
+
 void platform_early_init(void) {
+  const void *fdt = (const void *)lk_boot_args[0];
+  if (fdt_check_header(fdt) == 0) {
+    scan_timebase(fdt);
+    scan_pft_size(fdt);
+    scan_cache_blocks(fdt);
+    scan_memory(fdt);
+    scan_page_sizes(fdt);
+    rtas_init(fdt);
+    scan_cpus(fdt);
+    scan_vty(fdt);
+    ppc64_boot_mark("fdt scanned");
+  }
+#if WITH_KERNEL_VM
+  // whole segments, the vmm must not hand out 4K pages next to the linear map's 16MB ones
+  mmu_initial_mappings[0].size = (ram_size + (1ULL << HPT_SEGMENT_SHIFT) - 1) & ~((1ULL << HPT_SEGMENT_SHIFT) - 1);
+#endif
   pmm_add_arena(&arena);
 }
 
+uint64_t platform_ram_size(void) {
+  return ram_size;
+}
+
+// without 16MB pages the linear map would cost a 4K pte per page, real mode covers it for free
+bool platform_kernel_translation(void) {
+  return large_pages;
+}
+
+uint platform_secondary_cpu_count(void) {
+  return cpu_count - 1;
+}
+
+status_t platform_start_secondary_cpu(uint cpu) {
+  // the new thread starts in real mode at the given address, with r3 = the last argument
+  int ret = rtas_call("start-cpu", 3, 1, NULL, ppc64_get_percpu_for(cpu)->hw_id,
+                      (uint32_t)(uintptr_t)&ppc64_secondary_start, cpu);
+  return ret == 0 ? NO_ERROR : ERR_GENERIC;
+}
+
+// the next kernel starts its secondaries with start-cpu, which only takes stopped ones
+void platform_park_cpu(uint64_t entry) {
+  xics_quiesce_percpu();
+  rtas_call("stop-self", 0, 1, NULL);
+  for (;;);
+}
+
+// the hypervisor owns the page table, every update goes through H_ENTER/H_REMOVE
+const struct hpt_ops *platform_hpt_ops(void) {
+  return &hpt_hcall_ops;
+}
+
 static int cmd_p(int argc, const console_cmd_args *argv) {
   puts("hello");
 #define printreg(name) printf(#name ": 0x%016llx\n", name ## _read())
@@ -65,116 +276,274 @@ static int cmd_p(int argc, const console_cmd_args *argv) {
   return 0;
 }
 
-typedef struct {
-  uint64_t pte0, pte1;
-} pte_t;
-
-typedef struct {
-  pte_t e[8];
-} pteg_t;
-
-static void map_page(uint64_t vpn, uint64_t physical) {
-  uint64_t avpn = vpn >> 11;
-  uint64_t pte0 = (avpn << 7) | 1;
-  uint64_t pte1 = physical | 0x10 | 2;
-  uint64_t hash = vpn; // TODO, masking
-#if 0
-  pteg_t *p = page_table;
-  p[hash].e[0].pte0 = pte0;
-  p[hash].e[0].pte1 = pte1;
-#else
-  puts("hentering");
-  uint64_t ret = h_enter(0, (0&7) | (hash << 3), pte0, pte1);
-  printf("ret 0x%llx\n", ret);
-#endif
-  printf("PTE[0x%llx] = 0x%llx 0x%llx\n", hash, pte0, pte1);
-}
+// H_PUT_TERM_CHAR takes up to 16 bytes in r5/r6, so output collects here and goes out in as few calls as possible
+// flushed on newline, when full, before waiting for input and on halt, the lock keeps the bytes of all cpus in order
+// once halting every byte goes straight out without the lock, the cpu that panicked may have died holding it
+// once timers work a partial line, a prompt or an echoed key, also goes out CON_OUT_DELAY_MS after its first byte
+#define CON_OUT_SIZE      16
+#define CON_OUT_DELAY_MS  2
 
-#if 0
-void mmu_setup(void) {
-  void *page_table = memalign(256<<10, 256<<10);
-  memset(page_table, 0, 256<<10);
-  printf("%p\n", page_table);
-  sdr1_write(page_table);
-}
-#else
-void mmu_setup(void) {
+static struct {
+  spin_lock_t lock;
+  uint len;
+  char buf[CON_OUT_SIZE];
+  uint64_t calls;
+  timer_t timer;
+  bool timer_ready;   // from platform_init on
+  bool timer_armed;
+  bool halting;       // from platform_halt on
+} con_out = { .lock = SPIN_LOCK_INITIAL_VALUE, .timer = TIMER_INITIAL_VALUE(con_out.timer) };
+
+static void con_put(const char *buf, uint len) {
+  // big endian, the first byte goes in the top of r5
+  uint64_t packed[2] = { 0, 0 };
+  memcpy(packed, buf, len);
+  do_hypercall4(H_PUT_TERM_CHAR, 0, len, packed[0], packed[1]);
+  con_out.calls++;
 }
-#endif
 
-extern uint8_t _start, _end;
+// caller holds con_out.lock
+static void con_flush_locked(void) {
+  if (!con_out.len) return;
+  con_put(con_out.buf, con_out.len);
+  con_out.len = 0;
+}
 
-static int cmd_x(int argc, const console_cmd_args *argv) {
-  mmu_setup();
+static void con_flush(void) {
+  if (con_out.halting) return;
+  spin_lock_saved_state_t state;
+  spin_lock_irqsave(&con_out.lock, state);
+  con_flush_locked();
+  spin_unlock_irqrestore(&con_out.lock, state);
+}
 
-  uint64_t virt_start = (uint64_t)&_start;
-  uint64_t virt_end = ROUNDUP((uint64_t)&_end, 4096);
-  uint64_t phys_start = 16 << 20;
+static enum handler_return con_flush_timer(timer_t *t, lk_time_t now, void *arg) {
+  spin_lock(&con_out.lock);
+  con_out.timer_armed = false;
+  con_flush_locked();
+  spin_unlock(&con_out.lock);
+  return INT_NO_RESCHEDULE;
+}
 
-  virt_end += 1<<20; // since activating late, the heap has grown
+void platform_dputc(char c) {
+  //*REG8(UART_DR) = c;
+  if (con_out.halting) {
+    con_put(&c, 1);
+    return;
+  }
+  spin_lock_saved_state_t state;
+  spin_lock_irqsave(&con_out.lock, state);
+  con_out.buf[con_out.len++] = c;
+  if (c == '\n' || con_out.len == CON_OUT_SIZE) {
+    con_flush_locked();
+  } else if (con_out.timer_ready && !con_out.timer_armed) {
+    con_out.timer_armed = true;
+    timer_set_oneshot(&con_out.timer, CON_OUT_DELAY_MS, con_flush_timer, NULL);
+  }
+  spin_unlock_irqrestore(&con_out.lock, state);
+}
 
-  printf("mapping 0x%llx to 0x%llx->0x%llx\n", phys_start, virt_start, virt_end);
-  printf("vpn range 0x%llx -> 0x%llx\n", virt_start>>12, virt_end >> 12);
+void platform_halt(platform_halt_action suggested_action, platform_halt_reason reason) {
+  // whatever is left goes out regardless, then output and input stop taking their locks
+  con_flush_locked();
+  con_out.halting = true;
+  switch (suggested_action) {
+  case HALT_ACTION_HALT:
+    break;
+  case HALT_ACTION_REBOOT:
+    rtas_call("system-reboot", 0, 1, NULL);
+    break;
+  case HALT_ACTION_SHUTDOWN:
+    rtas_call("power-off", 2, 1, NULL, -1, -1);
+    break;
+  }
 
-  for (uint64_t vpn = virt_start >> 12; vpn < (virt_end>>12); vpn++) {
-    map_page(vpn, vpn << 12);
+  // from here on what lk's generic halt does, with a plain spin in place of arch_idle
+#if ENABLE_PANIC_SHELL
+  if (reason == HALT_REASON_SW_PANIC) {
+    dprintf(ALWAYS, "CRASH: starting debug shell, reason '%s'\n", platform_halt_reason_string(reason));
+    arch_disable_ints();
+    panic_shell_start();
   }
+#endif
+  dprintf(ALWAYS, "HALT: spinning forever, reason '%s'\n", platform_halt_reason_string(reason));
+  arch_disable_ints();
+  for (;;);
+}
 
-  slbmte(0, 1, 1, 0, 0, 0, 0, 1, 0);
+static void conbench_line(char *line, uint len) {
+  for (uint i = 0; i < len - 1; i++) line[i] = 'a' + i % 26;
+  line[len - 1] = '\n';
+}
+
+static int cmd_conbench(int argc, const console_cmd_args *argv) {
+  uint bytes = argc > 1 ? argv[1].u : 4096;
+  char line[64];
+  conbench_line(line, sizeof(line));
+  if (bytes < sizeof(line)) return ERR_INVALID_ARGS;
+  uint lines = bytes / sizeof(line);
 
-  msr_write(1ULL<<63 | 1ULL<<4 | 1ULL<<5);
+  con_flush();
+  uint64_t calls = con_out.calls;
+  lk_ticks_t t0 = lk_ticks();
+  for (uint i = 0; i < lines; i++) {
+    for (uint j = 0; j < sizeof(line); j++) platform_dputc(line[j]);
+  }
+  lk_ticks_t t1 = lk_ticks();
+  uint64_t buffered_calls = con_out.calls - calls;
 
-  //while (true) {
-  //}
+  // what platform_dputc used to do
+  spin_lock_saved_state_t state;
+  spin_lock_irqsave(&con_out.lock, state);
+  calls = con_out.calls;
+  lk_ticks_t t2 = lk_ticks();
+  for (uint i = 0; i < lines; i++) {
+    for (uint j = 0; j < sizeof(line); j++) con_put(&line[j], 1);
+  }
+  lk_ticks_t t3 = lk_ticks();
+  uint64_t unbuffered_calls = con_out.calls - calls;
+  spin_unlock_irqrestore(&con_out.lock, state);
 
-  //sdr1_write(0);
-  //free(page_table);
+  bytes = lines * sizeof(line);
+  uint64_t ns_buffered = lk_ticks_to_ns(t1 - t0) + 1;
+  uint64_t ns_unbuffered = lk_ticks_to_ns(t3 - t2) + 1;
+  printf("%u bytes\n", bytes);
+  printf("buffered   %llu bytes/s, %llu hcalls\n", bytes * 1000000000ULL / ns_buffered, buffered_calls);
+  printf("unbuffered %llu bytes/s, %llu hcalls\n", bytes * 1000000000ULL / ns_unbuffered, unbuffered_calls);
   return 0;
 }
 
-void platform_dputc(char c) {
-  //*REG8(UART_DR) = c;
-  do_hypercall4(H_PUT_TERM_CHAR, 0, 1, ((uint64_t)c) << (64-8), 0);
+// moves whatever the hypervisor has into the cbuf, returns the bytes moved
+// `full` is set if it stopped because the cbuf had no room for another chunk
+static size_t con_drain(bool *full) {
+  size_t moved = 0;
+  *full = false;
+  // the panic shell polls with interrupts off, and a dead cpu may hold the lock
+  bool locked = !con_out.halting;
+  spin_lock_saved_state_t state;
+  if (locked) spin_lock_irqsave(&con_in.lock, state);
+  for (;;) {
+    if (cbuf_space_avail(&console_input_cbuf) < CON_IN_CHUNK) {
+      *full = true;
+      break;
+    }
+    uint64_t ret[8];
+    if (do_hypercall_ret(H_GET_TERM_CHAR, ret, con_in.unit, 0, 0, 0, 0, 0, 0, 0) != H_SUCCESS) break;
+    uint64_t len = ret[0];
+    if (len == 0) break;
+    // big endian, r5 then r6 are the bytes in order
+    char buf[CON_IN_CHUNK];
+    memcpy(buf, &ret[1], 8);
+    memcpy(buf + 8, &ret[2], 8);
+    cbuf_write(&console_input_cbuf, buf, MIN(len, sizeof(buf)), false);
+    moved += len;
+  }
+  con_in.polls++;
+  if (locked) spin_unlock_irqrestore(&con_in.lock, state);
+  return moved;
+}
+
+static enum handler_return con_irq(void *arg) {
+  con_in.irqs++;
+  event_signal(&con_in.ready, false);
+  return INT_RESCHEDULE;
 }
 
 int platform_dgetc(char *c, bool wait) {
-  while (true) {
-    uint64_t len, part0, part1, status;
-    asm volatile ("mr %%r3, %4\n mr %%r4, %5 \n sc 1\n mr %0, %%r3\n mr %1, %%r4\n mr %2, %%r5\n mr %3, %%r6" : "=r"(status), "=r"(len), "=r"(part0), "=r"(part1) : "r"(H_GET_TERM_CHAR), "r"(0));
-    if (len == 0) continue;
-    char buffer[17];
-    memcpy(buffer, &part0, 8);
-    memcpy(buffer+8, &part1, 8);
-    buffer[16] = 0;
-    printf("len %lld %llx %llx '%s'\n", len, part0, part1, buffer);
-  }
-  *c = 0;
-  return 0;
+  // a prompt without a newline must be visible before we sit waiting for the answer
+  con_flush();
+  for (;;) {
+    if (cbuf_read_char(&console_input_cbuf, c, false) == 1) return 0;
+    if (con_in.running && !con_out.halting) {
+      if (!wait) return -1;
+      return cbuf_read_char(&console_input_cbuf, c, true) == 1 ? 0 : -1;
+    }
+    // no thread yet, or halted, straight from the hypervisor
+    bool full;
+    if (con_drain(&full) == 0 && !wait) return -1;
+  }
 }
 
-void hyper_serial_rx_loop(const struct app_descriptor *, void *) {
-  while (true) {
-    uint64_t len, part0, part1, status;
-    asm volatile ("mr %%r3, %4\n mr %%r4, %5 \n sc 1\n mr %0, %%r3\n mr %1, %%r4\n mr %2, %%r5\n mr %3, %%r6" : "=r"(status), "=r"(len), "=r"(part0), "=r"(part1) : "r"(H_GET_TERM_CHAR), "r"(0));
-    if (len == 0) {
-      thread_yield();
+static void hyper_serial_rx_loop(const struct app_descriptor *app, void *args) {
+  con_in.running = true;
+  uint backoff = CON_POLL_MIN_MS;
+  for (;;) {
+    bool full;
+    size_t moved = con_drain(&full);
+    if (full) {
+      // flow control, nothing tells us when the reader makes room, so check back shortly
+      con_in.stalls++;
+      thread_sleep(CON_POLL_MIN_MS);
+      continue;
+    }
+    if (con_in.irq) {
+      event_wait(&con_in.ready);
       continue;
     }
-    char buffer[17];
-    memcpy(buffer, &part0, 8);
-    memcpy(buffer+8, &part1, 8);
-    buffer[16] = 0;
-    //printf("status %lld, len %lld %llx %llx '%s'\n", status, len, part0, part1, buffer);
-    while (cbuf_space_avail(&console_input_cbuf) < len) puts("spinning for space");
-    cbuf_write(&console_input_cbuf, buffer, len, true);
+    // no interrupt, poll at 1ms while typing and back off to CON_POLL_MAX_MS when idle
+    backoff = moved ? CON_POLL_MIN_MS : MIN(backoff * 2, CON_POLL_MAX_MS);
+    thread_sleep(backoff);
+  }
+}
+
+static int cmd_vty(int argc, const console_cmd_args *argv) {
+  printf("vterm 0x%llx, %s\n", con_in.unit, con_in.irq ? "interrupt driven" : "polled");
+  printf("irqs %llu, polls %llu, stalls %llu, %zu bytes waiting\n", con_in.irqs, con_in.polls, con_in.stalls,
+         cbuf_space_used(&console_input_cbuf));
+  return 0;
+}
+
+void platform_init(void) {
+  con_out.timer_ready = true;
+
+  if (!con_in.irq) return;
+  register_int_handler(con_in.irq, &con_irq, NULL);
+  if (unmask_interrupt(con_in.irq) < 0 || do_hypercall4(H_VIO_SIGNAL, con_in.unit, 1, 0, 0) != H_SUCCESS) {
+    printf("vty: no interrupt, polling\n");
+    mask_interrupt(con_in.irq);
+    con_in.irq = 0;
   }
 }
 
-// TODO, H_CEDE for arch_idle?
-// also, bit 45/18, MSR_POW, can trigger sleep
-// SPR_HID0 can contain a deepnap/doze/nap flag
-// see check_pow_970
+// before a chain load, the next kernel finds the vty quiet and everything printed so far on the console
+void platform_quiesce(void) {
+  if (con_in.irq) {
+    do_hypercall4(H_VIO_SIGNAL, con_in.unit, 0, 0, 0);
+    mask_interrupt(con_in.irq);
+  }
+  con_out.timer_ready = false;
+  con_flush();
+  xics_quiesce_percpu();
+}
 
+void platform_irq_init_percpu(void) {
+  xics_init_percpu();
+}
+
+enum handler_return platform_irq(struct ppc64_iframe *frame) {
+  return xics_irq(frame);
+}
+
+void platform_send_ipi(uint cpu) {
+  xics_send_ipi(ppc64_get_percpu_for(cpu)->hw_id);
+}
+
+// gives the vcpu back to qemu until an interrupt is pending for it, the decrementer and xics ipis
+// included, which is why ipis here go through H_IPI instead of being polled for
+// HID0 nap/doze and MSR_POW are the hypervisor's to use, a pseries guest only gets H_CEDE
+static void cede_enter(void) {
+  // returns with MSR[EE] set, the interrupt that ended it is taken straight away
+  do_hypercall4(H_CEDE, 0, 0, 0, 0);
+}
+
+static const struct ppc64_idle_state idle_states[] = {
+  { .name = "cede", .enter = cede_enter, .latency_us = 100 },
+};
+
+const struct ppc64_idle_state *platform_idle_states(uint *count) {
+  *count = countof(idle_states);
+  return idle_states;
+}
 
 APP_START(platform_rx)
   .entry = hyper_serial_rx_loop,
@@ -0,0 +1,61 @@
+#include <arch/hypercalls.h>
+#include <kernel/spinlock.h>
+#include <libfdt.h>
+#include <lk/compiler.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include "rtas.h"
+
+struct rtas_args {
+  uint32_t token;
+  uint32_t nargs;
+  uint32_t nret;
+  uint32_t args[16];
+} __ALIGNED(16);
+
+static const void *rtas_fdt;
+static int rtas_node = -1;
+static struct rtas_args rtas_args;
+static spin_lock_t rtas_lock = SPIN_LOCK_INITIAL_VALUE;
+
+void rtas_init(const void *fdt) {
+  if (fdt_check_header(fdt) != 0) return;
+  rtas_fdt = fdt;
+  rtas_node = fdt_path_offset(fdt, "/rtas");
+  if (rtas_node < 0) printf("rtas: no /rtas node in the device tree\n");
+}
+
+int32_t rtas_token(const char *service) {
+  if (rtas_node < 0) return -1;
+  int len;
+  const fdt32_t *prop = fdt_getprop(rtas_fdt, rtas_node, service, &len);
+  if (!prop || len != sizeof(*prop)) return -1;
+  return fdt32_to_cpu(*prop);
+}
+
+int rtas_call(const char *service, int nargs, int nret, uint32_t *ret, ...) {
+  int32_t token = rtas_token(service);
+  if (token < 0 || nargs + nret > (int)countof(rtas_args.args)) return -1;
+
+  spin_lock_saved_state_t state;
+  spin_lock_irqsave(&rtas_lock, state);
+
+  rtas_args.token = token;
+  rtas_args.nargs = nargs;
+  rtas_args.nret = nret;
+  va_list ap;
+  va_start(ap, ret);
+  for (int i = 0; i < nargs; i++) rtas_args.args[i] = va_arg(ap, uint32_t);
+  va_end(ap);
+  for (int i = 0; i < nret; i++) rtas_args.args[nargs + i] = 0;
+
+  do_hypercall4(KVMPPC_H_RTAS, (uint64_t)&rtas_args, 0, 0, 0);
+
+  int status = nret ? (int32_t)rtas_args.args[nargs] : 0;
+  for (int i = 1; i < nret; i++) {
+    if (ret) ret[i - 1] = rtas_args.args[nargs + i];
+  }
+
+  spin_unlock_irqrestore(&rtas_lock, state);
+  return status;
+}
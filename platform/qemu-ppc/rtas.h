@@ -0,0 +1,9 @@
+#pragma once
+
+#include <stdint.h>
+
+// returns the token for an rtas service, or -1 if the device tree lacks it
+int32_t rtas_token(const char *service);
+// returns the rtas status (ret[0]), or -1 if the service does not exist
+int rtas_call(const char *service, int nargs, int nret, uint32_t *ret, ...);
+void rtas_init(const void *fdt);
@@ -5,12 +5,17 @@ MODULE := $(LOCAL_DIR)
 MEMBASE := 0x10000000
 MEMSIZE := 0x10000000
 
-GLOBAL_DEFINES += SMP_MAX_CPUS=6
+WITH_SMP := 1
+SMP_MAX_CPUS := 6
 GLOBAL_DEFINES += MEMBASE=$(MEMBASE) MEMSIZE=$(MEMSIZE)
 GLOBAL_DEFINES += CONSOLE_HAS_INPUT_BUFFER=1
 
 LINKER_SCRIPT += $(LOCAL_DIR)/stage1.ld
 
 MODULE_SRCS += $(LOCAL_DIR)/platform.c
+MODULE_SRCS += $(LOCAL_DIR)/rtas.c
+MODULE_SRCS += $(LOCAL_DIR)/xics.c
+
+MODULE_DEPS += lib/fdt
 
 include make/module.mk
@@ -0,0 +1,91 @@
+#include <arch/hypercalls.h>
+#include <arch/ppc64.h>
+#include <kernel/spinlock.h>
+#include <lk/err.h>
+#include <platform/interrupts.h>
+#include <stdio.h>
+#include "rtas.h"
+#include "xics.h"
+
+#define XICS_SRC_NONE   0
+#define XICS_SRC_IPI    2
+#define XICS_PRIO_IPI   4
+#define XICS_PRIO_DEV   5
+#define XICS_PRIO_OFF   0xff
+#define XICS_HANDLERS   8
+
+static struct {
+  uint32_t vector;
+  int_handler handler;
+  void *arg;
+} handlers[XICS_HANDLERS];
+
+static spin_lock_t handlers_lock = SPIN_LOCK_INITIAL_VALUE;
+
+// let every priority through, the sources decide what actually fires
+void xics_init_percpu(void) {
+  do_hypercall4(H_CPPR, XICS_PRIO_OFF, 0, 0, 0);
+}
+
+void xics_quiesce_percpu(void) {
+  do_hypercall4(H_CPPR, 0, 0, 0, 0);
+}
+
+void register_int_handler(unsigned int vector, int_handler handler, void *arg) {
+  spin_lock_saved_state_t state;
+  spin_lock_irqsave(&handlers_lock, state);
+  for (uint i = 0; i < XICS_HANDLERS; i++) {
+    if (handlers[i].handler && handlers[i].vector != vector) continue;
+    handlers[i].vector = vector;
+    handlers[i].arg = arg;
+    handlers[i].handler = handler;
+    break;
+  }
+  spin_unlock_irqrestore(&handlers_lock, state);
+}
+
+// every device interrupt goes to the boot cpu
+status_t unmask_interrupt(unsigned int vector) {
+  if (rtas_call("ibm,set-xive", 3, 1, NULL, vector, ppc64_get_percpu_for(0)->hw_id, XICS_PRIO_DEV) != 0)
+    return ERR_GENERIC;
+  return rtas_call("ibm,int-on", 1, 1, NULL, vector) == 0 ? NO_ERROR : ERR_GENERIC;
+}
+
+status_t mask_interrupt(unsigned int vector) {
+  return rtas_call("ibm,int-off", 1, 1, NULL, vector) == 0 ? NO_ERROR : ERR_GENERIC;
+}
+
+void xics_send_ipi(uint32_t server) {
+  do_hypercall4(H_IPI, server, XICS_PRIO_IPI, 0, 0);
+}
+
+static enum handler_return dispatch(uint32_t vector) {
+  for (uint i = 0; i < XICS_HANDLERS; i++) {
+    if (handlers[i].handler && handlers[i].vector == vector) return handlers[i].handler(handlers[i].arg);
+  }
+  printf("xics: no handler for source 0x%x\n", vector);
+  mask_interrupt(vector);
+  return INT_NO_RESCHEDULE;
+}
+
+// 0x500, takes everything pending before returning
+enum handler_return xics_irq(struct ppc64_iframe *frame) {
+  enum handler_return ret = INT_NO_RESCHEDULE;
+  for (;;) {
+    uint64_t out[8];
+    if (do_hypercall_ret(H_XIRR, out, 0, 0, 0, 0, 0, 0, 0, 0) != H_SUCCESS) break;
+    uint32_t xirr = out[0];
+    uint32_t source = xirr & 0xffffff;
+    if (source == XICS_SRC_NONE) break;
+
+    if (source == XICS_SRC_IPI) {
+      // clear the mfrr before looking at the mailbox, so a new ipi raises it again
+      do_hypercall4(H_IPI, ppc64_get_percpu()->hw_id, XICS_PRIO_OFF, 0, 0);
+      ret |= ppc64_mp_handle_ipi();
+    } else {
+      ret |= dispatch(source);
+    }
+    do_hypercall4(H_EOI, xirr, 0, 0, 0);
+  }
+  return ret;
+}
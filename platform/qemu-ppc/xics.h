@@ -0,0 +1,12 @@
+#pragma once
+
+#include <arch/ppc64.h>
+#include <stdint.h>
+
+// the PAPR interrupt controller, the presentation side through hypercalls and the sources through rtas
+// implements platform/interrupts.h, vectors are xics source numbers
+void xics_init_percpu(void);
+// nothing is presented to this cpu any more, before it leaves the kernel
+void xics_quiesce_percpu(void);
+enum handler_return xics_irq(struct ppc64_iframe *frame);
+void xics_send_ipi(uint32_t server);
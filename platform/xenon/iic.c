@@ -0,0 +1,124 @@
+#include <arch/ppc64.h>
+#include <kernel/spinlock.h>
+#include <lk/err.h>
+#include <lk/macros.h>
+#include <lk/reg.h>
+#include <platform/interrupts.h>
+#include <stdio.h>
+#include "iic.h"
+
+// each hardware thread has its own block, big endian 64 bit registers
+#define IIC_BASE          ((0x80000200ULL << 32) | 0x00050000ULL)
+#define IIC_THREAD(t)     (IIC_BASE + (t) * 0x1000)
+#define IIC_WHOAMI        0x00  // the thread's own bit
+#define IIC_PRIORITY      0x08  // only priorities below this one are taken
+#define IIC_IPI           0x10  // target thread mask << 16 | priority
+#define IIC_ACK           0x50  // reading takes the most urgent pending interrupt, IIC_PRIO_NONE if there is none
+#define IIC_EOI           0x68
+#define IIC_EOI_PRIORITY  0x70
+
+// the pci bridge routes each device's interrupt to a priority, one little endian word per slot
+#define BRIDGE_BASE       ((0x80000200ULL << 32) | 0xea000000ULL)
+#define BRIDGE_ROUTE(s)   (BRIDGE_BASE + 0x10 + (s) * 0x10)
+#define BRIDGE_ROUTE_ON   0x00800180
+#define BRIDGE_SLOTS      16
+
+// what each bridge slot carries, 0 for the empty ones
+static const uint8_t bridge_prio[BRIDGE_SLOTS] = {
+  IIC_PRIO_CLOCK, IIC_PRIO_SATA_CDROM, IIC_PRIO_SATA_HDD, IIC_PRIO_SMM,
+  IIC_PRIO_OHCI_0, IIC_PRIO_EHCI_0, IIC_PRIO_OHCI_1, IIC_PRIO_EHCI_1,
+  0, 0, IIC_PRIO_ENET, IIC_PRIO_XMA,
+  IIC_PRIO_AUDIO, IIC_PRIO_SFCX, 0, 0,
+};
+
+#define IIC_HANDLERS 8
+
+static struct {
+  uint32_t vector;
+  int_handler handler;
+  void *arg;
+} handlers[IIC_HANDLERS];
+
+static spin_lock_t handlers_lock = SPIN_LOCK_INITIAL_VALUE;
+
+static inline uint64_t iic_base(void) {
+  return IIC_THREAD(ppc64_get_percpu()->hw_id);
+}
+
+// takes everything, after dropping whatever xell left pending
+void iic_init_percpu(void) {
+  uint64_t base = iic_base();
+  uint32_t thread = ppc64_get_percpu()->hw_id;
+  *REG64(base + IIC_EOI_PRIORITY) = IIC_PRIO_NONE;
+  *REG64(base + IIC_PRIORITY) = 0;
+  *REG64(base + IIC_WHOAMI) = 1ULL << thread;
+  while (*REG64(base + IIC_ACK) != IIC_PRIO_NONE);
+  *REG64(base + IIC_EOI) = 0;
+}
+
+void iic_quiesce_percpu(void) {
+  *REG64(iic_base() + IIC_PRIORITY) = IIC_PRIO_NONE;
+}
+
+void register_int_handler(unsigned int vector, int_handler handler, void *arg) {
+  spin_lock_saved_state_t state;
+  spin_lock_irqsave(&handlers_lock, state);
+  for (uint i = 0; i < IIC_HANDLERS; i++) {
+    if (handlers[i].handler && handlers[i].vector != vector) continue;
+    handlers[i].vector = vector;
+    handlers[i].arg = arg;
+    handlers[i].handler = handler;
+    break;
+  }
+  spin_unlock_irqrestore(&handlers_lock, state);
+}
+
+static status_t route(unsigned int vector, uint32_t value) {
+  for (uint s = 0; s < BRIDGE_SLOTS; s++) {
+    if (!vector || bridge_prio[s] != vector) continue;
+    *REG32(BRIDGE_ROUTE(s)) = __builtin_bswap32(value);
+    return NO_ERROR;
+  }
+  return ERR_INVALID_ARGS;
+}
+
+// every device interrupt goes to thread 0
+status_t unmask_interrupt(unsigned int vector) {
+  return route(vector, BRIDGE_ROUTE_ON | (vector >> 2));
+}
+
+status_t mask_interrupt(unsigned int vector) {
+  return route(vector, 0);
+}
+
+void iic_send_ipi(uint32_t thread) {
+  *REG64(iic_base() + IIC_IPI) = (0x10000ULL << thread) | IIC_PRIO_IPI;
+}
+
+static enum handler_return dispatch(uint32_t vector) {
+  for (uint i = 0; i < IIC_HANDLERS; i++) {
+    if (handlers[i].handler && handlers[i].vector == vector) return handlers[i].handler(handlers[i].arg);
+  }
+  printf("iic: no handler for priority 0x%x\n", vector);
+  mask_interrupt(vector);
+  return INT_NO_RESCHEDULE;
+}
+
+// 0x500, takes everything pending before returning
+enum handler_return iic_irq(struct ppc64_iframe *frame) {
+  uint64_t base = iic_base();
+  enum handler_return ret = INT_NO_RESCHEDULE;
+  for (;;) {
+    uint32_t prio = *REG64(base + IIC_ACK) & 0x7f;
+    if (prio == IIC_PRIO_NONE) break;
+    if (prio == IIC_PRIO_IPI) {
+      ret |= ppc64_mp_handle_ipi();
+    } else {
+      ret |= dispatch(prio);
+    }
+    *REG64(base + IIC_EOI) = 0;
+    // the read back makes sure the eoi has landed before the next ack
+    (void)*REG64(base + IIC_PRIORITY);
+  }
+  return ret;
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <arch/ppc64.h>
+#include <stdint.h>
+
+// the xenon interrupt controller, a block of registers per hardware thread
+// implements platform/interrupts.h, vectors are the priorities below, one per source, lower is more urgent
+#define IIC_PRIO_IPI        0x08
+#define IIC_PRIO_SMM        0x14
+#define IIC_PRIO_SFCX       0x18
+#define IIC_PRIO_SATA_HDD   0x20
+#define IIC_PRIO_SATA_CDROM 0x24
+#define IIC_PRIO_OHCI_0     0x2c
+#define IIC_PRIO_EHCI_0     0x30
+#define IIC_PRIO_OHCI_1     0x34
+#define IIC_PRIO_EHCI_1     0x38
+#define IIC_PRIO_XMA        0x40
+#define IIC_PRIO_AUDIO      0x44
+#define IIC_PRIO_ENET       0x4c
+#define IIC_PRIO_CLOCK      0x74
+#define IIC_PRIO_NONE       0x7c
+
+void iic_init_percpu(void);
+// nothing is presented to this thread any more, before it leaves the kernel
+void iic_quiesce_percpu(void);
+enum handler_return iic_irq(struct ppc64_iframe *frame);
+void iic_send_ipi(uint32_t thread);
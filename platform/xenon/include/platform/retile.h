@@ -0,0 +1,62 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+// the gpu scans out 32x32 pixel tiles, in the pixel order of retile_offset()
+// either a linear ARGB8888 shadow is drawn into and the dirty parts of it are converted on flush,
+// or retile_put/fill/copy draw into the tiles directly
+
+#define RETILE_TILE       32
+#define RETILE_MAX_WIDTH  1920
+#define RETILE_RECTS      8
+
+struct retile_rect {
+  uint16_t x0, y0, x1, y1; // x1/y1 exclusive
+};
+
+struct retile_fb {
+  const uint32_t *src;        // linear ARGB8888, width * height, 16 byte aligned, NULL to draw directly
+  uint32_t *dst;              // tiled, retile_dst_words() big, 16 byte aligned
+  uint width, height;         // width a multiple of 4, up to RETILE_MAX_WIDTH
+  uint pitch;                 // width rounded up to whole tiles
+  bool vmx;                   // use the vperm loop, only from a thread with interrupts on
+
+  // word offset of each 4 pixel group of a row inside its tile row, without and with the y & 8 swap
+  uint32_t group_offset[2][RETILE_MAX_WIDTH / 4];
+
+  struct retile_rect dirty[RETILE_RECTS];
+  uint ndirty;
+
+  uint64_t flushes;
+  uint64_t groups;            // 4 pixel groups converted
+};
+
+static inline uint retile_pitch(uint width) {
+  return (width + RETILE_TILE - 1) & ~(RETILE_TILE - 1);
+}
+
+// words of tiled memory for a width x height frame, the last tile row and column are always whole
+static inline uint retile_dst_words(uint width, uint height) {
+  return retile_pitch(width) * retile_pitch(height);
+}
+
+// where pixel x,y goes, in words from the start of the tiled frame
+uint retile_offset(uint pitch, uint x, uint y);
+// ARGB8888 to the gpu's byte order, blue in the top byte and the low byte unused
+static inline uint32_t retile_pixel(uint32_t argb) {
+  return __builtin_bswap32(argb) & 0xffffff00;
+}
+
+int retile_init(struct retile_fb *fb, const uint32_t *src, uint32_t *dst, uint width, uint height);
+// adds a changed rectangle, clipped to the frame and widened to whole 4 pixel groups
+void retile_damage(struct retile_fb *fb, uint x0, uint y0, uint x1, uint y1);
+// converts everything damaged since the last flush, returns the number of 4 pixel groups done
+uint retile_flush(struct retile_fb *fb);
+
+// direct drawing, colors are ARGB8888 and the caller has already clipped to the frame
+void retile_put(struct retile_fb *fb, uint x, uint y, uint32_t argb);
+void retile_fill(struct retile_fb *fb, uint x, uint y, uint w, uint h, uint32_t argb);
+// moves the w x h block at x,y to x2,y2, the two may overlap
+void retile_copy(struct retile_fb *fb, uint x, uint y, uint w, uint h, uint x2, uint y2);
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+// the smc mailbox protocol, a queue of requests sent one at a time and completed by the reply that
+// echoes their command byte, with the 0x83 bulk messages the smc pushes on its own handed to whoever
+// registered for their type
+// the mailbox itself is behind struct smc_mailbox, the driver in platform.c or a simulated one
+
+#define SMC_MSG_SIZE       16
+#define SMC_BULK           0x83
+#define SMC_BULK_HANDLERS  8
+
+// msg[1] of the bulk messages
+#define SMC_BULK_POWER      0x11
+#define SMC_BULK_POWER_ALT  0x20
+#define SMC_BULK_IR         0x23 // msg[2..3] the remote's key
+#define SMC_BULK_TRAY_FIRST 0x60 // dvd tray state
+#define SMC_BULK_TRAY_LAST  0x65
+
+// request status
+#define SMC_PENDING   1
+#define SMC_OK        0
+#define SMC_TIMED_OUT -1
+
+struct smc_mailbox {
+  bool (*can_send)(void *ctx);
+  void (*send)(void *ctx, const uint8_t *msg);
+  bool (*receive)(void *ctx, uint8_t *msg);  // false with nothing waiting
+  void *ctx;
+};
+
+struct smc_request;
+typedef void (*smc_done_fn)(struct smc_request *req);
+typedef void (*smc_bulk_fn)(const uint8_t *msg, void *arg);
+
+struct smc_request {
+  uint8_t msg[SMC_MSG_SIZE];
+  uint8_t reply[SMC_MSG_SIZE];
+  bool want_reply;            // false completes it as soon as it is sent
+  uint32_t timeout;           // ms from submission, 0 waits forever
+  int status;
+  smc_done_fn done;           // runs from smc_submit/smc_service, must not call back into them
+  void *arg;
+
+  // owned by the queue
+  struct smc_request *next;
+  uint32_t deadline;
+};
+
+struct smc_bulk_handler {
+  uint8_t first, last;
+  smc_bulk_fn fn;
+  void *arg;
+};
+
+struct smc {
+  const struct smc_mailbox *mbox;
+  struct smc_request *head, *tail;  // head is on the wire once sent is set
+  bool sent;
+
+  struct smc_bulk_handler bulk[SMC_BULK_HANDLERS];
+  uint nbulk;
+
+  uint64_t requests;
+  uint64_t replies;
+  uint64_t timeouts;
+  uint64_t bulk_msgs;
+  uint64_t unhandled;         // bulk messages nobody registered for
+  uint64_t stray;             // replies that matched no request
+};
+
+void smc_init(struct smc *smc, const struct smc_mailbox *mbox);
+
+// the newest handler covering msg[1] gets the message, so a later registration overrides an earlier one
+int smc_register_bulk(struct smc *smc, uint8_t first, uint8_t last, smc_bulk_fn fn, void *arg);
+
+// queues the request and sends it if the mailbox is free, `now` in ms
+void smc_submit(struct smc *smc, struct smc_request *req, uint32_t now);
+
+// drains the mailbox, times requests out and sends the next one, for the irq or a poll
+// returns the number of requests completed
+uint smc_service(struct smc *smc, uint32_t now);
+
+static inline bool smc_busy(const struct smc *smc) {
+  return smc->head;
+}
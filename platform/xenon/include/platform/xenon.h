@@ -0,0 +1,35 @@
+#pragma once
+
+#include <sys/types.h>
+
+// the uart, see uart.c
+void init_uart(void);
+
+// writes out what the uart ring still holds, ignoring its lock, for the halt path
+void xenon_uart_flush(void);
+
+// the screen, see platform.c and retile.c
+
+#ifdef WITH_LIB_GFX
+#include <lib/gfx.h>
+
+// draws straight into the tiled framebuffer, no flush needed, NULL with XENON_FB_SHADOW set
+gfx_surface *xenon_fb_surface(void);
+#endif
+
+// with XENON_FB_SHADOW, for drawing into the shadow that knows which columns it changed
+void xenon_fb_damage(uint x0, uint y0, uint x1, uint y1);
+void xenon_fb_flush(void);
+
+// the smc, see platform.c and smc.c
+#include <platform/smc.h>
+
+// sends msg and, with reply set, waits for the answer, blocking the calling thread
+// ERR_TIMED_OUT if the smc did not take it or answer within timeout ms, 0 to wait forever
+status_t xenon_smc_transact(const uint8_t *msg, uint8_t *reply, uint32_t timeout);
+
+// queues req without waiting, req->done runs from the smc interrupt once it completes
+void xenon_smc_submit(struct smc_request *req);
+
+// handlers run from the smc interrupt, a later registration overrides the default printing ones
+int xenon_smc_register_bulk(uint8_t first, uint8_t last, smc_bulk_fn fn, void *arg);
@@ -1,22 +1,36 @@
 #include <arch/cpu_regs.h>
+#include <arch/hpt.h>
+#include <arch/ppc64.h>
+#include <arch/ticks.h>
 #include <dev/display.h>
+#include <kernel/event.h>
+#include <kernel/spinlock.h>
+#include <kernel/timer.h>
 #include <lk/console_cmd.h>
 #include <lk/debug.h>
 #include <lk/err.h>
+#include <lk/macros.h>
 #include <lk/reg.h>
 #include <platform.h>
 #include <arch/ops.h>
 #include <platform/debug.h>
+#include <platform/interrupts.h>
+#include <platform/retile.h>
+#include <platform/smc.h>
+#include <platform/xenon.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include "iic.h"
 
 #ifdef WITH_LIB_GFX
 #include <lib/gfx.h>
 #endif
+#ifdef WITH_LIB_GFXCONSOLE
+#include <lib/gfxconsole.h>
+#endif
 
-#define UART_BASE ((0x80000200ULL << 32) | 0xEA001010ULL)
 #define SMC_BASE ((0x80000200ULL << 32) | 0xEA001080ULL)
 
 #define IO_BSWAP_READ(s, x) __builtin_bswap ## s(*REG ## s((x)))
@@ -24,25 +38,39 @@
 
 static int cmd_p(int argc, const console_cmd_args *argv);
 static int cmd_smc(int argc, const console_cmd_args *argv);
-static int cmd_x(int argc, const console_cmd_args *argv);
 static int cmd_f(int argc, const console_cmd_args *argv);
+#ifdef WITH_LIB_GFX
+static int cmd_retile(int argc, const console_cmd_args *argv);
+#endif
+static void smc_driver_init(void);
+static void smc_driver_start(void);
+static void smc_driver_stop(void);
 
 STATIC_COMMAND_START
 STATIC_COMMAND("p", "", &cmd_p)
-STATIC_COMMAND("smc", "Sends a message to the SMC", &cmd_smc)
-STATIC_COMMAND("x", "", &cmd_x)
+STATIC_COMMAND("smc", "Sends a message to the SMC, or shows its counters", &cmd_smc)
 STATIC_COMMAND("f", "", &cmd_f)
+#ifdef WITH_LIB_GFX
+STATIC_COMMAND("retile", "framebuffer drawing stats and per frame timing [frames]", &cmd_retile)
+#endif
 STATIC_COMMAND_END(platform);
 
-void init_uart(void) {
-  // Set UART to 115400, 8, N, 1
-  *REG32(UART_BASE+0x0C) = 0xE6010000;
-}
-
+// the linear shadow of the screen, only with XENON_FB_SHADOW
 uint32_t *framebuffer = NULL;
 
+// the timebase ticks at the 3.2GHz core clock / 64
+#define XENON_TB_FREQ 50000000
+#define XENON_CYCLES_PER_TB 64
+
+// LPCR[TL], tlb misses go to software instead of the hardware table walk
+#define LPCR_TL 0x400
+
 void platform_early_init(void) {
+  ppc64_timebase_init(XENON_TB_FREQ);
+  ppc64_cycles_per_tb = XENON_CYCLES_PER_TB;
+  lpcr_write(lpcr_read() & ~LPCR_TL);
   init_uart();
+  smc_driver_init();
   printf("fb %p\n", framebuffer);
 }
 
@@ -55,132 +83,295 @@ void platform_init(void) {
   //cmd_gfx(2, args);
   uint64_t x = pir_read();
   printf("PIR 0x%llx\n", x);
+  smc_driver_start();
+#if defined(WITH_LIB_GFXCONSOLE) && !XENON_FB_SHADOW
+  // gfxconsole's own hook looks for a linear display_framebuffer, which direct mode does not have
+  gfx_surface *surface = xenon_fb_surface();
+  if (surface) gfxconsole_start(surface);
+#endif
 }
 
-void platform_dputc(char c) {
-  while (!((*REG32(UART_BASE+0x08)) & (1<<25)));
-  *REG32(UART_BASE+0x04) = (c << 24) & 0xFF000000;
+// xell parks the other 5 hardware threads at _start+0x60, they use their PIR as the cpu number
+extern volatile uint64_t ppc64_secondary_release;
+
+uint platform_secondary_cpu_count(void) {
+  for (uint cpu = 0; cpu < SMP_MAX_CPUS; cpu++) {
+    ppc64_get_percpu_for(cpu)->hw_id = cpu;
+  }
+  return SMP_MAX_CPUS - 1;
+}
+
+status_t platform_start_secondary_cpu(uint cpu) {
+  // releasing one thread releases all of them, each waits its turn in ppc64_secondary_entry
+  ppc64_secondary_release = 1;
+  __asm__ volatile("sync");
+  return NO_ERROR;
 }
 
-void smc_send_message(const uint8_t *msg) {
-  /*
-  while (!(read32(SMC_BASE + 0x84) & 4));
-	write32(SMC_BASE + 0x84, 4);
-	write32n(SMC_BASE + 0x80, *(uint32_t*)(msg + 0));
-	write32n(SMC_BASE + 0x80, *(uint32_t*)(msg + 4));
-	write32n(SMC_BASE + 0x80, *(uint32_t*)(msg + 8));
-	write32n(SMC_BASE + 0x80, *(uint32_t*)(msg + 12));
-	write32(SMC_BASE + 0x84, 0);
-  */
+// with LPCR[LPES0] clear, external interrupts are taken in hypervisor state, through HSRR0/HSRR1
+#define LPCR_LPES0 0x8
 
-  // Wait for the SMC to tell us that it's ready to send a message
-	while (!(IO_BSWAP_READ(32, SMC_BASE+0x04) & 4));
-	IO_BSWAP_WRITE(32, SMC_BASE+0x04, 4);
-  *REG32(SMC_BASE) = *(uint32_t*)(msg + 0);
-  printf("msg0: 0x%lX\n", *(uint32_t*)(msg + 0));
-  *REG32(SMC_BASE) = *(uint32_t*)(msg + 4);
-  printf("msg4: 0x%lX\n", *(uint32_t*)(msg + 4));
-  *REG32(SMC_BASE) = *(uint32_t*)(msg + 8);
-  printf("msg8: 0x%lX\n", *(uint32_t*)(msg + 8));
-  *REG32(SMC_BASE) = *(uint32_t*)(msg + 12);
-  printf("msg12: 0x%lX\n", *(uint32_t*)(msg + 12));
-	IO_BSWAP_WRITE(32, SMC_BASE+0x04, 0);
+bool platform_external_irq_hv(void) {
+  return (mfmsr() & MSR_HV) && !(lpcr_read() & LPCR_LPES0);
 }
 
+void platform_irq_init_percpu(void) {
+  iic_init_percpu();
+}
+
+enum handler_return platform_irq(struct ppc64_iframe *frame) {
+  return iic_irq(frame);
+}
+
+void platform_send_ipi(uint cpu) {
+  iic_send_ipi(ppc64_get_percpu_for(cpu)->hw_id);
+}
+
+// before a chain load, the next kernel finds the smc and the interrupt controller quiet
+void platform_quiesce(void) {
+  smc_driver_stop();
+  iic_quiesce_percpu();
+}
+
+// the cores are cell's ppe, which has no HID0 doze or nap, its idle state is pausing the thread:
+// clearing the thread's own enable bit in CTRL stops it issuing until an interrupt enabled in TSCR
+// arrives, the thread then restarts through system reset, see ppc64_irq_handler
+// TSCR is shared by the two threads of a core, each adds its own decrementer bit
+#define CTRL_CT             0xc0000000  // which thread is running
+#define CTRL_CT0            0x80000000
+#define CTRL_TE0            0x00800000  // thread enable, TE1 is the next bit down
+#define CTRL_RUNLATCH       0x1
+#define TSCR_DEC_ENABLE_0   0x400000    // DEC_ENABLE_1 is the next bit down
+#define TSCR_EE_ENABLE      0x100000
+#define TSCR_EE_BOOST       0x080000
+
+static void pause_enter(void) {
+  uint64_t ctrl = uctrl_read();
+  uint thread = (ctrl & CTRL_CT) == CTRL_CT0 ? 0 : 1;
+  tscr_write(tscr_read() | TSCR_EE_ENABLE | TSCR_EE_BOOST | (TSCR_DEC_ENABLE_0 >> thread));
+  __asm__ volatile("or 1,1,1");
+  // stops here with EE still off, the wakeup is handled through 0x100 before this returns
+  ctrl_write(ctrl & ~(CTRL_RUNLATCH | (CTRL_TE0 >> thread)));
+  __asm__ volatile("or 2,2,2");
+  arch_enable_ints();
+}
+
+static const struct ppc64_idle_state idle_states[] = {
+  { .name = "pause", .enter = pause_enter, .latency_us = 20 },
+};
+
+const struct ppc64_idle_state *platform_idle_states(uint *count) {
+  *count = countof(idle_states);
+  return idle_states;
+}
+
+// what xell does with the threads it does not boot on, minus their interrupts
+void platform_park_cpu(uint64_t entry) {
+  iic_quiesce_percpu();
+  ppc64_chain_enter(entry + PPC64_SECONDARY_HOLD, 0, 0, 0, 0);
+}
+
+// we run without a hypervisor under us, so the page table is ours to write
+const struct hpt_ops *platform_hpt_ops(void) {
+  return &hpt_direct_ops;
+}
+
+// the kernel stays in real mode, the uart and framebuffer are addressed physically
+// and the linear map would need cache inhibited windows for them first
+uint64_t platform_ram_size(void) {
+  return 512 << 20;
+}
+
+// the smc mailbox, requests go out through the tx side, replies and bulk messages come in on the rx side
+// the smc interrupt runs smc_service() whenever a message arrives, while a request is outstanding a
+// timer also runs it every SMC_POLL_MS, to send the next one once the mailbox is free and to time them out
+#define SMC_POLL_MS 10
+#define SMC_TIMEOUT_MS 1000
+
+// the smc's interrupt status, written back to acknowledge
+#define SMC_IRQ_STATUS  ((0x80000200ULL << 32) | 0xEA001050ULL)
+#define SMC_IRQ_ACK     ((0x80000200ULL << 32) | 0xEA001058ULL)
+
+static bool mbox_can_send(void *ctx) {
+  return IO_BSWAP_READ(32, SMC_BASE+0x04) & 4;
+}
+
+static void mbox_send(void *ctx, const uint8_t *msg) {
+  IO_BSWAP_WRITE(32, SMC_BASE+0x04, 4);
+  for (int i = 0; i < 4; ++i)
+    *REG32(SMC_BASE) = *(const uint32_t*)(msg + (i * 4));
+  IO_BSWAP_WRITE(32, SMC_BASE+0x04, 0);
+}
 
-status_t smc_recieve_message(uint8_t *msg) {
+static bool mbox_receive(void *ctx, uint8_t *msg) {
   // Can we get a message? If so, get it
-	if (IO_BSWAP_READ(32, SMC_BASE+0x14) & 4) {
-    IO_BSWAP_WRITE(32, SMC_BASE+0x14, 4);
-		for (int i = 0; i < 4; ++i)
-			*(uint32_t*)(msg + (i * 4)) = *REG32(SMC_BASE+0x10);
-    IO_BSWAP_WRITE(32, SMC_BASE+0x14, 0);
-    return NO_ERROR;
+  if (!(IO_BSWAP_READ(32, SMC_BASE+0x14) & 4)) return false;
+  IO_BSWAP_WRITE(32, SMC_BASE+0x14, 4);
+  for (int i = 0; i < 4; ++i)
+    *(uint32_t*)(msg + (i * 4)) = *REG32(SMC_BASE+0x10);
+  IO_BSWAP_WRITE(32, SMC_BASE+0x14, 0);
+  return true;
+}
+
+static const struct smc_mailbox smc_mbox = {
+  .can_send = mbox_can_send,
+  .send = mbox_send,
+  .receive = mbox_receive,
+};
+
+static struct smc smc;
+static spin_lock_t smc_lock = SPIN_LOCK_INITIAL_VALUE;
+static timer_t smc_timer = TIMER_INITIAL_VALUE(smc_timer);
+static bool smc_started;      // timers and the interrupt work, from platform_init on
+static bool smc_timer_armed;
+
+// what used to be printed inline, until something else registers for them
+static void smc_power(const uint8_t *msg, void *arg) {
+  printf("SMC power message\n");
+}
+
+static void smc_ir(const uint8_t *msg, void *arg) {
+  printf("IR RX [%02x %02x]\n", msg[2], msg[3]);
+}
+
+static void smc_tray(const uint8_t *msg, void *arg) {
+  printf("DVD cover state: %02x\n", msg[1]);
+}
+
+static void smc_driver_init(void) {
+  smc_init(&smc, &smc_mbox);
+  smc_register_bulk(&smc, SMC_BULK_POWER, SMC_BULK_POWER, smc_power, NULL);
+  smc_register_bulk(&smc, SMC_BULK_POWER_ALT, SMC_BULK_POWER_ALT, smc_power, NULL);
+  smc_register_bulk(&smc, SMC_BULK_IR, SMC_BULK_IR, smc_ir, NULL);
+  smc_register_bulk(&smc, SMC_BULK_TRAY_FIRST, SMC_BULK_TRAY_LAST, smc_tray, NULL);
+}
+
+static enum handler_return smc_tick(timer_t *t, lk_time_t now, void *arg);
+
+// caller holds smc_lock
+static void smc_arm_locked(void) {
+  if (!smc_started || smc_timer_armed || !smc_busy(&smc)) return;
+  smc_timer_armed = true;
+  timer_set_oneshot(&smc_timer, SMC_POLL_MS, smc_tick, NULL);
+}
+
+static enum handler_return smc_run(void) {
+  spin_lock(&smc_lock);
+  uint completed = smc_service(&smc, current_time());
+  smc_arm_locked();
+  spin_unlock(&smc_lock);
+  return completed ? INT_RESCHEDULE : INT_NO_RESCHEDULE;
+}
+
+static enum handler_return smc_tick(timer_t *t, lk_time_t now, void *arg) {
+  spin_lock(&smc_lock);
+  smc_timer_armed = false;
+  spin_unlock(&smc_lock);
+  return smc_run();
+}
+
+static enum handler_return smc_irq(void *arg) {
+  // smc_service looks at the mailbox itself, so every cause is acknowledged at once
+  IO_BSWAP_WRITE(32, SMC_IRQ_ACK, IO_BSWAP_READ(32, SMC_IRQ_STATUS));
+  return smc_run();
+}
+
+// requests queued before this go out now, their replies come in through the interrupt
+static void smc_driver_start(void) {
+  register_int_handler(IIC_PRIO_SMM, smc_irq, NULL);
+  unmask_interrupt(IIC_PRIO_SMM);
+  spin_lock_saved_state_t state;
+  spin_lock_irqsave(&smc_lock, state);
+  smc_started = true;
+  smc_service(&smc, current_time());
+  smc_arm_locked();
+  spin_unlock_irqrestore(&smc_lock, state);
+}
+
+static void smc_driver_stop(void) {
+  mask_interrupt(IIC_PRIO_SMM);
+  spin_lock_saved_state_t state;
+  spin_lock_irqsave(&smc_lock, state);
+  smc_started = false;
+  if (smc_timer_armed) {
+    timer_cancel(&smc_timer);
+    smc_timer_armed = false;
   }
-  return ERR_NO_MSG;
-}
-
-void smc_handle_bulk(unsigned char *msg) {
-	switch (msg[1]) {
-	case 0x11:
-	case 0x20:
-		printf("SMC power message\n");
-		break;
-	case 0x23:
-		printf("IR RX [%02x %02x]\n", msg[2], msg[3]);
-		break;
-	case 0x60 ... 0x65:
-		
-		printf("DVD cover state: %02x\n", msg[1]);
-		break;
-	default:
-		printf("unknown SMC bulk msg: %02x\n", msg[1]);
-		break;
-	}
-}
-
-status_t smc_recieve_response(uint8_t *msg) {
-	while (1) {
-		if (smc_recieve_message(msg))
-			continue;
-		if (msg[0] == 0x83) {
-			smc_handle_bulk(msg);
-			continue;
-		}
-		return NO_ERROR;
-	}
-  return ERR_NO_MSG;
+  spin_unlock_irqrestore(&smc_lock, state);
+}
+
+int xenon_smc_register_bulk(uint8_t first, uint8_t last, smc_bulk_fn fn, void *arg) {
+  spin_lock_saved_state_t state;
+  spin_lock_irqsave(&smc_lock, state);
+  int ret = smc_register_bulk(&smc, first, last, fn, arg);
+  spin_unlock_irqrestore(&smc_lock, state);
+  return ret;
+}
+
+void xenon_smc_submit(struct smc_request *req) {
+  spin_lock_saved_state_t state;
+  spin_lock_irqsave(&smc_lock, state);
+  smc_submit(&smc, req, current_time());
+  smc_arm_locked();
+  spin_unlock_irqrestore(&smc_lock, state);
+}
+
+static void smc_wake(struct smc_request *req) {
+  event_signal(req->arg, false);
+}
+
+status_t xenon_smc_transact(const uint8_t *msg, uint8_t *reply, uint32_t timeout) {
+  event_t done;
+  event_init(&done, false, 0);
+  struct smc_request req = {
+    .want_reply = reply != NULL,
+    .timeout = timeout,
+    .done = smc_wake,
+    .arg = &done,
+  };
+  memcpy(req.msg, msg, SMC_MSG_SIZE);
+
+  xenon_smc_submit(&req);
+  event_wait(&done);
+  event_destroy(&done);
+
+  if (req.status == SMC_TIMED_OUT) return ERR_TIMED_OUT;
+  if (reply) memcpy(reply, req.reply, SMC_MSG_SIZE);
+  return NO_ERROR;
+}
+
+// for the halt path, interrupts may be off and a dead cpu may hold the lock, straight to the mailbox
+static void smc_send_polled(const uint8_t *msg) {
+  while (!mbox_can_send(NULL));
+  mbox_send(NULL, msg);
 }
 
 void platform_halt(platform_halt_action suggested_action, platform_halt_reason reason) {
+  // whatever is still in the uart ring goes out before a reset cuts it off
+  xenon_uart_flush();
   switch (suggested_action) {
   case HALT_ACTION_HALT:
     break;
   case HALT_ACTION_REBOOT: {
     uint8_t buf[16] = { 0x82, 0x04, 0x12, 0x00 };
-    smc_send_message(buf);
+    smc_send_polled(buf);
   } break;
   case HALT_ACTION_SHUTDOWN: {
     uint8_t buf[16] = { 0x82, 0x01 };
-    smc_send_message(buf);
+    smc_send_polled(buf);
   } break;
   }
 
   const char *reason_string = platform_halt_reason_string(reason);
   dprintf(ALWAYS, "HALT: spinning forever, reason '%s'\n", reason_string);
+  xenon_uart_flush();
   arch_disable_ints();
-  for (;;)
-      arch_idle();
-}
-
-uint32_t kbhit(void) {
-  uint32_t status;
-  do {
-    status = *REG32(UART_BASE+0x08);
-  } while (status & ~0x03000000);
-
-  return !!(status & (1<<24));
-}
-
-int platform_dgetc(char *c, bool wait) {
-  while (!kbhit());
-  *c = (*REG32(UART_BASE)) >> 24;
-  return -0;
+  for (;;);
 }
 
 #ifdef WITH_LIB_GFX
 
-
-#define WIDTH 1280
-#define HEIGHT 720
-
-uint32_t fix_color(uint32_t in) {
-  uint8_t r = (in >> 16) & 0xff;
-  uint8_t g = (in >> 8) & 0xff;
-  uint8_t b = (in >> 0) & 0xff;
-  return (r << 8) | (g << 16) | (b << 24);
-}
-
+// the mode xell set up, read back from the gpu
 struct ati_info {
   uint32_t unknown1[4];
   uint32_t base;
@@ -189,26 +380,35 @@ struct ati_info {
   uint32_t height;
 } __attribute__ ((__packed__));
 
+// used when the gpu reports nothing retile.c can handle
+#define DEFAULT_WIDTH 1280
+#define DEFAULT_HEIGHT 720
+
+// what the gpu scans out, in 32x32 tiles, see retile.c
+#define TILED_FB ((uint32_t *)((1ULL << 63) | 0x1e000000))
+
+static struct retile_fb retile;
+static bool retile_ready;
+static uint64_t retile_ticks;
+
 void fb_init(void) {
-  uint32_t size = WIDTH * HEIGHT * 4;
-  framebuffer = malloc(size);
-  bzero(framebuffer, size);
-  printf("allocated fb to %p\n", framebuffer);
   struct ati_info *ai = (struct ati_info*)0xec806100ULL;
+  uint width = ai->width, height = ai->height;
   printf("base: 0x%x\n", ai->base);
-  printf("resolution: %dx%d\n", ai->width, ai->height);
-
-  volatile uint32_t *fb = (uint32_t*)((1ULL << 63) | 0x1e000000);
-  if (false) {
-    for (int x=0; x<32; x++) {
-      int out = (x & 0x3) | ((x & 0x1c) << 1);
-      fb[out] = (x&1) ? 0 : 0xffffff00;
-    }
-  }
-  for (int y=0; y<32; y++) {
-    int out = ((y & ~1) * 64) | ((y&1) * 4);
-    //fb[out] = (y&1) ? 0 : 0xffffff00;
+  printf("resolution: %ux%u\n", width, height);
+  if (!width || width > RETILE_MAX_WIDTH || width % 4 || !height || height > 2 * RETILE_MAX_WIDTH) {
+    width = DEFAULT_WIDTH;
+    height = DEFAULT_HEIGHT;
   }
+
+#if XENON_FB_SHADOW
+  uint32_t size = width * height * 4;
+  framebuffer = memalign(CACHE_LINE, size);
+  bzero(framebuffer, size);
+  printf("allocated fb to %p\n", framebuffer);
+#endif
+
+  volatile uint32_t *fb = TILED_FB;
   fb[0]   = 0xff000000;
   fb[4]   = 0x00ff0000;
   fb[64]  = 0x0000ff00;
@@ -218,60 +418,116 @@ void fb_init(void) {
   fb[192] = 0xff000000;
   fb[196] = 0x00ff0000;
   //fb[201] = 0x0000ff00;
-}
 
-int xeFbConvert(int x, int y, int width) {
-  return (((y >> 5) * 32 * width +
-    ((x >> 5) << 10) +
-    (x & 3) + ((y & 1) << 2) +
-    (((x & 31) >> 2) << 3) +
-    (((y & 31) >> 1) << 6))
-    ^ ((y & 8) << 2));
+  retile_init(&retile, framebuffer, TILED_FB, width, height);
+  retile_ready = true;
 }
 
+#if XENON_FB_SHADOW
+// lib/gfx only says which rows changed, a caller that knows the columns too can use xenon_fb_damage()
 void retile_framebuffer(uint starty, uint endy) {
-#ifndef WITH_LIB_GFXCONSOLE
-  printf("retile_framebuffer(%d, %d)\n", starty, endy);
-#endif
-  volatile uint32_t *fb = (uint32_t*)((1ULL << 63) | 0x1e000000);
-  uint32_t *input = framebuffer;
-  int stride = WIDTH;
-
-  for (int y = starty; y < endy; y++) {
-    int yoff = y * stride;
-
-    //if (y > 0) continue;
-
-    for (int x = 0; x < WIDTH; x++) {
-      //if (x > 64) continue;
-      int tilex = x / 32;
-      int tilex2 = x % 32;
-      uint32_t pixel = fix_color(input[yoff + x]);
-      int out = (tilex * 1024) + (tilex2) + (y * 1024 * 2);
-      out = xeFbConvert(x, y, WIDTH);
-      //printf("%d,%x -> %d == %06x\n", x, y, out, pixel);
-      fb[out] = pixel;
-    }
-  }
+  retile_damage(&retile, 0, starty, retile.width, endy);
+  xenon_fb_flush();
 }
 
 __WEAK status_t display_get_framebuffer(struct display_framebuffer *fb) {
-  if (framebuffer == NULL) fb_init();
+  if (!retile_ready) fb_init();
 
-  const int w = WIDTH;
-  const int h = HEIGHT;
-  const gfx_format fmt = GFX_FORMAT_RGB_332;
   fb->image.pixels = framebuffer;
   fb->format = DISPLAY_FORMAT_ARGB_8888;
   fb->image.format = IMAGE_FORMAT_ARGB_8888;
-  fb->image.rowbytes = 1280 * 4;
-  fb->image.width = w;
-  fb->image.height = h;
-  fb->image.stride = 1280;
+  fb->image.rowbytes = retile.width * 4;
+  fb->image.width = retile.width;
+  fb->image.height = retile.height;
+  fb->image.stride = retile.width;
   fb->flush = retile_framebuffer;
 
   return NO_ERROR;
 }
+#else
+// lib/gfx assumes a linear display_framebuffer, there is none, draw through xenon_fb_surface()
+__WEAK status_t display_get_framebuffer(struct display_framebuffer *fb) {
+  return ERR_NOT_SUPPORTED;
+}
+#endif
+
+void xenon_fb_damage(uint x0, uint y0, uint x1, uint y1) {
+  retile_damage(&retile, x0, y0, x1, y1);
+}
+
+void xenon_fb_flush(void) {
+  // vmx only from threads, an interrupt handler must not touch it
+  retile.vmx = mfmsr() & MSR_EE;
+  lk_ticks_t start = lk_ticks();
+  retile_flush(&retile);
+  retile_ticks += lk_ticks() - start;
+}
+
+// surface ops drawing straight into the tiles, gfx has clipped everything by the time they run
+// and hands over ARGB8888, the format has no translate_color
+// gfx functions that touch surface->ptr themselves (blend, pattern) still assume a linear layout
+static void tiled_putpixel(gfx_surface *surface, uint x, uint y, uint color) {
+  retile_put(&retile, x, y, color);
+}
+
+static void tiled_fillrect(gfx_surface *surface, uint x, uint y, uint width, uint height, uint color) {
+  retile_fill(&retile, x, y, width, height, color);
+}
+
+static void tiled_copyrect(gfx_surface *surface, uint x, uint y, uint width, uint height, uint x2, uint y2) {
+  retile_copy(&retile, x, y, width, height, x2, y2);
+}
+
+gfx_surface *xenon_fb_surface(void) {
+  static gfx_surface *surface;
+  if (surface) return surface;
+  if (!retile_ready) fb_init();
+  if (retile.src) return NULL;
+
+  surface = gfx_create_surface(TILED_FB, retile.width, retile.height, retile.pitch, GFX_FORMAT_ARGB_8888);
+  if (!surface) return NULL;
+  surface->len = retile_dst_words(retile.width, retile.height) * 4;
+  surface->putpixel = tiled_putpixel;
+  surface->fillrect = tiled_fillrect;
+  surface->copyrect = tiled_copyrect;
+  surface->flush = NULL;
+  return surface;
+}
+
+static uint64_t retile_frame_us(uint frames, bool vmx) {
+  lk_ticks_t start = lk_ticks();
+  for (uint i = 0; i < frames; i++) {
+    retile_damage(&retile, 0, 0, retile.width, retile.height);
+    retile.vmx = vmx;
+    retile_flush(&retile);
+  }
+  return lk_ticks_to_us(lk_ticks() - start) / frames;
+}
+
+static int cmd_retile(int argc, const console_cmd_args *argv) {
+  if (!retile_ready) fb_init();
+  uint frames = argc > 1 ? argv[1].u : 30;
+  if (!frames) return ERR_INVALID_ARGS;
+
+  if (retile.src) {
+    printf("%llu flushes, %llu pixels retiled, %llu us\n", retile.flushes, retile.groups * 4,
+           lk_ticks_to_us(retile_ticks));
+    uint64_t scalar = retile_frame_us(frames, false);
+    uint64_t vmx = retile_frame_us(frames, true);
+    printf("%ux%u frame: scalar %llu us, vmx %llu us\n", retile.width, retile.height, scalar, vmx);
+    return 0;
+  }
+
+  // direct mode, what a clear and a console scroll by one 16 row line cost
+  lk_ticks_t start = lk_ticks();
+  for (uint i = 0; i < frames; i++) retile_fill(&retile, 0, 0, retile.width, retile.height, 0xff000000 | i);
+  uint64_t fill = lk_ticks_to_us(lk_ticks() - start) / frames;
+  start = lk_ticks();
+  for (uint i = 0; i < frames; i++) retile_copy(&retile, 0, 16, retile.width, retile.height - 16, 0, 0);
+  uint64_t scroll = lk_ticks_to_us(lk_ticks() - start) / frames;
+  printf("%ux%u direct: fill %llu us, scroll %llu us\n", retile.width, retile.height, fill, scroll);
+  return 0;
+}
 #endif
 
 static int cmd_p(int argc, const console_cmd_args *argv) {
@@ -296,62 +552,6 @@ static int cmd_p(int argc, const console_cmd_args *argv) {
   return 0;
 }
 
-uint64_t *page_table;
-
-void mmu_setup(void) {
-  page_table = memalign(256<<10, 256<<10);
-  memset(page_table, 0, 256<<10);
-  printf("%p\n", page_table);
-  sdr1_write((uint64_t)page_table);
-}
-
-typedef struct {
-  uint64_t pte0, pte1;
-} pte_t;
-
-typedef struct {
-  pte_t e[8];
-} pteg_t;
-
-static void map_page(uint64_t vpn, uint64_t physical) {
-  uint64_t avpn = vpn >> 11;
-  uint64_t pte0 = (avpn << 7) | 1;
-  uint64_t pte1 = physical | 0x10 | 2;
-  uint64_t addr_upper = 1; // TODO
-  uint64_t hash = (vpn ^ addr_upper) & 0x7ff;
-  pteg_t *p = page_table;
-  p[hash].e[0].pte0 = pte0;
-  p[hash].e[0].pte1 = pte1;
-  printf("mapping virt 0x%x -> phys 0x%x\n", (uint32_t)(vpn << 12), (uint32_t)physical);
-  printf("PTE[0x%llx] = 0x%llx 0x%llx\n", hash, pte0, pte1);
-}
-
-extern uint8_t _start, _end;
-
-static int cmd_x(int argc, const console_cmd_args *argv) {
-  mmu_setup();
-
-  uint64_t virt_start = ROUNDDOWN((uint64_t)&_start, 4096);
-  uint64_t virt_end = ROUNDUP((uint64_t)&_end, 4096);
-  uint64_t phys_start = virt_start;
-  virt_end += 1<<20; // since activating late, the heap has grown, TODO improve
-  printf("mapping 0x%llx to 0x%llx->0x%llx\n", phys_start, virt_start, virt_end);
-  printf("vpn range 0x%llx -> 0x%llx\n", virt_start>>12, virt_end >> 12);
-  for (uint64_t vpn = virt_start >> 12; vpn < (virt_end>>12); vpn++) {
-    map_page(vpn, vpn << 12);
-  }
-
-  uint64_t lpcr = lpcr_read();
-  lpcr &= ~0x400; // clear SW TLB bit
-  lpcr_write(lpcr);
-
-  const uint64_t vsid = 256 >> 8; // TODO
-  const uint64_t esid = 1; // TODO
-  slbmte(vsid, 1, 1, 0, 0, 0, esid, 1, 0);
-  msr_write(1ULL<<63 | 1ULL<<60 | 1ULL<<4 | 1ULL<<5);
-  return 0;
-}
-
 void test1(uint64_t *a, uint64_t *b, uint64_t *c);
 
 static int cmd_f(int argc, const console_cmd_args *argv) {
@@ -365,51 +565,33 @@ static int cmd_f(int argc, const console_cmd_args *argv) {
   return 0;
 }
 
+static void print_msg(const uint8_t *msg) {
+  for (int i = 0; i < SMC_MSG_SIZE; i++) {
+    printf("0x%x ", msg[i]);
+  }
+  puts("");
+}
+
 static int cmd_smc(int argc, const console_cmd_args *argv) {
   if (argc < 2) {
     printf("not enough arguments:\n");
 usage:
     printf("%s test : manually constructs a buffer\n", argv[0].str);
-    printf("%s recieve : recieves an message from the SMC\n", argv[0].str);
-    printf("%s recieve_response : recieves a message response from the SMC\n", argv[0].str);
     printf("%s send [1-16 byte block] : sends a message to the SMC\n", argv[0].str);
-    printf("%s send_recieve [1-16 byte block] : sends a message to the SMC, then recieves the data\n", argv[0].str);
+    printf("%s send_recieve [1-16 byte block] : sends a message to the SMC, then waits for its reply\n", argv[0].str);
+    printf("%s stats : mailbox counters\n", argv[0].str);
 
     return -1;
   }
 
   if (!strcmp(argv[1].str, "test")) {
     uint8_t msg[16] = { 0x82, 0x04, 0x12, 0x00 };
-    smc_send_message(msg);
-  } else if (!strcmp(argv[1].str, "recieve")) {
-    uint8_t msg[16] = {};
-    smc_recieve_message(msg);
-    for (int i=0; i<sizeof(msg); i++) {
-      printf("0x%lx ", msg[i]);
-    }
-    puts("");
-  } else if (!strcmp(argv[1].str, "recieve_response")) {
-    uint8_t msg[16] = {};
-    smc_recieve_response(msg);
-    for (int i=0; i<sizeof(msg); i++) {
-      printf("0x%lx ", msg[i]);
-    }
-    puts("");
-  } else if (!strcmp(argv[1].str, "send")) {
-    if (argc-2 > 16) {
-      printf("too many arguments!\n");
-      goto usage;
-    }
-    else if (argc-2 <= 0) {
-      printf("not enough arguments!\n");
-      goto usage;
-    }
-    uint8_t msg[16] = {};
-    for (int i=0; i<argc-2; i++) {
-      msg[i] = argv[i+2].u;
-    }
-    smc_send_message(msg);
-  } else if (!strcmp(argv[1].str, "send_recieve")) {
+    return xenon_smc_transact(msg, NULL, SMC_TIMEOUT_MS);
+  } else if (!strcmp(argv[1].str, "stats")) {
+    printf("%llu requests, %llu replies, %llu timed out, %llu stray\n", smc.requests, smc.replies,
+           smc.timeouts, smc.stray);
+    printf("%llu bulk messages, %llu unhandled, %u handlers\n", smc.bulk_msgs, smc.unhandled, smc.nbulk);
+  } else if (!strcmp(argv[1].str, "send") || !strcmp(argv[1].str, "send_recieve")) {
     if (argc-2 > 16) {
       printf("too many arguments!\n");
       goto usage;
@@ -422,12 +604,13 @@ usage:
     for (int i=2; i<argc; i++) {
       msg[i-2] = argv[i].u;
     }
-    smc_send_message(msg);
-    smc_recieve_response(msg);
-    for (int i=0; i<sizeof(msg); i++) {
-      printf("0x%lx ", msg[i]);
+    bool reply = !strcmp(argv[1].str, "send_recieve");
+    status_t err = xenon_smc_transact(msg, reply ? msg : NULL, SMC_TIMEOUT_MS);
+    if (err < 0) {
+      printf("no reply from the SMC\n");
+      return err;
     }
-    puts("");
+    if (reply) print_msg(msg);
   } else {
     printf("unrecognized subcommand!\n");
     goto usage;
@@ -0,0 +1,203 @@
+#include <platform/retile.h>
+
+#include <string.h>
+
+// inside a tile, a row is 8 groups of 4 pixels, each group 4 consecutive words of the output
+//   word = (x & 3) | (y & 1) << 2 | (x >> 2 & 7) << 3 | (y >> 1 & 15) << 6, with bit 5 flipped on rows with y & 8
+// so a row of the frame is one base offset plus a fixed offset per group, the same for every row
+// of a tile row apart from that flip, both patterns are worked out once in retile_init()
+
+#if __powerpc64__ && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define HAVE_VMX 1
+
+// retile_vmx.S
+void xenon_retile_groups(uint32_t *dst, const uint32_t *src, const uint32_t *offset, uint count,
+                         const uint8_t *perm);
+
+// output bytes b, g, r, 0 from input bytes a, r, g, b, index 16 is a byte of the zero vector
+static const uint8_t swizzle[16] __attribute__((aligned(16))) = {
+  3, 2, 1, 16, 7, 6, 5, 16, 11, 10, 9, 16, 15, 14, 13, 16,
+};
+#endif
+
+uint retile_offset(uint pitch, uint x, uint y) {
+  return ((y >> 5) * 32 * pitch + ((x >> 5) << 10) + (x & 3) + ((y & 1) << 2) + (((x & 31) >> 2) << 3) +
+          (((y & 31) >> 1) << 6)) ^ ((y & 8) << 2);
+}
+
+static inline uint row_base(const struct retile_fb *fb, uint y) {
+  return (y >> 5) * RETILE_TILE * fb->pitch + ((y & 1) << 2) + (((y & 31) >> 1) << 6);
+}
+
+int retile_init(struct retile_fb *fb, const uint32_t *src, uint32_t *dst, uint width, uint height) {
+  if (!width || width % 4 || width > RETILE_MAX_WIDTH || !height) return -1;
+  memset(fb, 0, sizeof(*fb));
+  fb->src = src;
+  fb->dst = dst;
+  fb->width = width;
+  fb->height = height;
+  fb->pitch = retile_pitch(width);
+  for (uint g = 0; g < fb->pitch / 4; g++) {
+    uint offset = ((g >> 3) << 10) + ((g & 7) << 3);
+    fb->group_offset[0][g] = offset;
+    fb->group_offset[1][g] = offset ^ 32;
+  }
+  return 0;
+}
+
+static bool touches(const struct retile_rect *a, const struct retile_rect *b) {
+  return a->x0 <= b->x1 && b->x0 <= a->x1 && a->y0 <= b->y1 && b->y0 <= a->y1;
+}
+
+static void merge(struct retile_rect *into, const struct retile_rect *r) {
+  if (r->x0 < into->x0) into->x0 = r->x0;
+  if (r->y0 < into->y0) into->y0 = r->y0;
+  if (r->x1 > into->x1) into->x1 = r->x1;
+  if (r->y1 > into->y1) into->y1 = r->y1;
+}
+
+// a console line lands next to the previous one, so most damage merges into an existing rect
+// once the list is full the rest goes into the last one, which only costs some extra conversion
+void retile_damage(struct retile_fb *fb, uint x0, uint y0, uint x1, uint y1) {
+  if (x1 > fb->width) x1 = fb->width;
+  if (y1 > fb->height) y1 = fb->height;
+  if (x0 >= x1 || y0 >= y1) return;
+  struct retile_rect r = { x0 & ~3, y0, (x1 + 3) & ~3, y1 };
+
+  for (uint i = 0; i < fb->ndirty; i++) {
+    if (touches(&fb->dirty[i], &r)) {
+      merge(&fb->dirty[i], &r);
+      return;
+    }
+  }
+  if (fb->ndirty == RETILE_RECTS) {
+    merge(&fb->dirty[RETILE_RECTS - 1], &r);
+    return;
+  }
+  fb->dirty[fb->ndirty++] = r;
+}
+
+static void convert_scalar(uint32_t *dst, const uint32_t *src, const uint32_t *offset, uint count) {
+  for (uint g = 0; g < count; g++, src += 4) {
+    uint32_t *d = dst + offset[g];
+    d[0] = retile_pixel(src[0]);
+    d[1] = retile_pixel(src[1]);
+    d[2] = retile_pixel(src[2]);
+    d[3] = retile_pixel(src[3]);
+  }
+}
+
+static void convert_rect(struct retile_fb *fb, const struct retile_rect *r) {
+  uint g0 = r->x0 / 4, count = (r->x1 - r->x0) / 4;
+  for (uint y = r->y0; y < r->y1; y++) {
+    const uint32_t *src = fb->src + y * fb->width + r->x0;
+    uint32_t *dst = fb->dst + row_base(fb, y);
+    const uint32_t *offset = &fb->group_offset[(y >> 3) & 1][g0];
+#if HAVE_VMX
+    if (fb->vmx) {
+      xenon_retile_groups(dst, src, offset, count, swizzle);
+      continue;
+    }
+#endif
+    convert_scalar(dst, src, offset, count);
+  }
+}
+
+uint retile_flush(struct retile_fb *fb) {
+  uint groups = 0;
+  if (!fb->src) {
+    fb->ndirty = 0;
+    return 0;
+  }
+  for (uint i = 0; i < fb->ndirty; i++) {
+    const struct retile_rect *r = &fb->dirty[i];
+    convert_rect(fb, r);
+    groups += (r->x1 - r->x0) / 4 * (r->y1 - r->y0);
+  }
+  fb->ndirty = 0;
+  fb->flushes++;
+  fb->groups += groups;
+  return groups;
+}
+
+static inline uint32_t *pixel_at(struct retile_fb *fb, uint x, uint y) {
+  return fb->dst + row_base(fb, y) + fb->group_offset[(y >> 3) & 1][x >> 2] + (x & 3);
+}
+
+void retile_put(struct retile_fb *fb, uint x, uint y, uint32_t argb) {
+  *pixel_at(fb, x, y) = retile_pixel(argb);
+}
+
+// the whole groups of a row are 4 consecutive words each, only the ragged ends go a pixel at a time
+void retile_fill(struct retile_fb *fb, uint x, uint y, uint w, uint h, uint32_t argb) {
+  uint32_t pixel = retile_pixel(argb);
+  uint head = (4 - (x & 3)) & 3;
+  if (head > w) head = w;
+  uint groups = (w - head) / 4;
+  uint tail = (w - head) & 3;
+  for (uint row = y; row < y + h; row++) {
+    uint cx = x;
+    for (uint i = 0; i < head; i++, cx++) *pixel_at(fb, cx, row) = pixel;
+    uint32_t *base = fb->dst + row_base(fb, row);
+    const uint32_t *offset = fb->group_offset[(row >> 3) & 1];
+    for (uint g = 0; g < groups; g++, cx += 4) {
+      uint32_t *d = base + offset[cx >> 2];
+      d[0] = pixel;
+      d[1] = pixel;
+      d[2] = pixel;
+      d[3] = pixel;
+    }
+    for (uint i = 0; i < tail; i++, cx++) *pixel_at(fb, cx, row) = pixel;
+  }
+}
+
+// whole tile rows of whole tiles are one run of words, the tiles of a tile row being next to each other
+static void copy_tiles(struct retile_fb *fb, uint x, uint y, uint w, uint h, uint x2, uint y2) {
+  uint bands = h / RETILE_TILE;
+  size_t words = (size_t)(w / RETILE_TILE) << 10;
+  bool up = y2 > y;
+  for (uint b = 0; b < bands; b++) {
+    uint sy = up ? y + (bands - 1 - b) * RETILE_TILE : y + b * RETILE_TILE;
+    uint dy = up ? y2 + (bands - 1 - b) * RETILE_TILE : y2 + b * RETILE_TILE;
+    memmove(fb->dst + row_base(fb, dy) + ((x2 / RETILE_TILE) << 10),
+            fb->dst + row_base(fb, sy) + ((x / RETILE_TILE) << 10), words * sizeof(uint32_t));
+  }
+}
+
+// a group is 4 consecutive words, so a row goes over as two doubleword loads and stores per group,
+// half the trips to the uncached framebuffer of a pixel at a time
+static inline void copy_group(uint32_t *d, const uint32_t *s) {
+  uint64_t lo = ((const uint64_t *)s)[0], hi = ((const uint64_t *)s)[1];
+  ((uint64_t *)d)[0] = lo;
+  ((uint64_t *)d)[1] = hi;
+}
+
+// rows go bottom up when moving down, and a row right to left when moving right within itself,
+// so no source pixel is overwritten before it has been read
+void retile_copy(struct retile_fb *fb, uint x, uint y, uint w, uint h, uint x2, uint y2) {
+  if (((x | x2 | w | y | y2 | h) & (RETILE_TILE - 1)) == 0) {
+    copy_tiles(fb, x, y, w, h, x2, y2);
+    return;
+  }
+  bool groups = ((x | x2 | w) & 3) == 0;
+  bool up = y2 > y;
+  for (uint r = 0; r < h; r++) {
+    uint sy = up ? y + h - 1 - r : y + r;
+    uint dy = up ? y2 + h - 1 - r : y2 + r;
+    bool left = sy == dy && x2 > x;
+    if (groups) {
+      const uint32_t *sbase = fb->dst + row_base(fb, sy), *soff = fb->group_offset[(sy >> 3) & 1];
+      uint32_t *dbase = fb->dst + row_base(fb, dy);
+      const uint32_t *doff = fb->group_offset[(dy >> 3) & 1];
+      for (uint i = 0; i < w / 4; i++) {
+        uint k = left ? w / 4 - 1 - i : i;
+        copy_group(dbase + doff[x2 / 4 + k], sbase + soff[x / 4 + k]);
+      }
+      continue;
+    }
+    for (uint i = 0; i < w; i++) {
+      uint k = left ? w - 1 - i : i;
+      *pixel_at(fb, x2 + k, dy) = *pixel_at(fb, x + k, sy);
+    }
+  }
+}
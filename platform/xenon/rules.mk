@@ -5,11 +5,21 @@ MODULE := $(LOCAL_DIR)
 MEMBASE := 0x10000000
 MEMSIZE := 0x10000000
 
-GLOBAL_DEFINES += SMP_MAX_CPUS=6
+WITH_SMP := 1
+SMP_MAX_CPUS := 6
 GLOBAL_DEFINES += MEMBASE=$(MEMBASE) MEMSIZE=$(MEMSIZE)
+GLOBAL_DEFINES += CONSOLE_HAS_INPUT_BUFFER=1
+
+# lib/gfx draws straight into the tiled framebuffer, 1 brings back the linear shadow retiled on every flush
+XENON_FB_SHADOW ?= 0
+GLOBAL_DEFINES += XENON_FB_SHADOW=$(XENON_FB_SHADOW)
 
 LINKER_SCRIPT += $(LOCAL_DIR)/stage1.ld
 
+MODULE_SRCS += $(LOCAL_DIR)/iic.c
 MODULE_SRCS += $(LOCAL_DIR)/platform.c
+MODULE_SRCS += $(LOCAL_DIR)/retile.c $(LOCAL_DIR)/retile_vmx.S
+MODULE_SRCS += $(LOCAL_DIR)/smc.c
+MODULE_SRCS += $(LOCAL_DIR)/uart.c
 
 include make/module.mk
@@ -0,0 +1,111 @@
+#include <platform/smc.h>
+
+#include <string.h>
+
+// one request is on the wire at a time, the smc has a single reply slot and answers in order
+// a reply carries the command byte of its request in msg[0], anything else that is not a bulk
+// message is a late reply to a request that already timed out, and gets dropped
+
+static inline bool expired(const struct smc_request *req, uint32_t now) {
+  return req->timeout && (int32_t)(now - req->deadline) >= 0;
+}
+
+void smc_init(struct smc *smc, const struct smc_mailbox *mbox) {
+  memset(smc, 0, sizeof(*smc));
+  smc->mbox = mbox;
+}
+
+int smc_register_bulk(struct smc *smc, uint8_t first, uint8_t last, smc_bulk_fn fn, void *arg) {
+  if (first > last || !fn || smc->nbulk == SMC_BULK_HANDLERS) return -1;
+  smc->bulk[smc->nbulk++] = (struct smc_bulk_handler){ first, last, fn, arg };
+  return 0;
+}
+
+static void dispatch_bulk(struct smc *smc, const uint8_t *msg) {
+  smc->bulk_msgs++;
+  for (uint i = smc->nbulk; i-- > 0;) {
+    const struct smc_bulk_handler *h = &smc->bulk[i];
+    if (msg[1] >= h->first && msg[1] <= h->last) {
+      h->fn(msg, h->arg);
+      return;
+    }
+  }
+  smc->unhandled++;
+}
+
+// unlinks req, prev being the request in front of it or NULL for the head
+static void complete(struct smc *smc, struct smc_request *prev, struct smc_request *req, int status) {
+  if (prev) {
+    prev->next = req->next;
+  } else {
+    smc->head = req->next;
+    smc->sent = false;
+  }
+  if (smc->tail == req) smc->tail = prev;
+  req->next = NULL;
+  req->status = status;
+  if (req->done) req->done(req);
+}
+
+static uint send_next(struct smc *smc) {
+  uint completed = 0;
+  while (smc->head && !smc->sent && smc->mbox->can_send(smc->mbox->ctx)) {
+    struct smc_request *req = smc->head;
+    smc->mbox->send(smc->mbox->ctx, req->msg);
+    if (req->want_reply) {
+      smc->sent = true;
+      break;
+    }
+    complete(smc, NULL, req, SMC_OK);
+    completed++;
+  }
+  return completed;
+}
+
+void smc_submit(struct smc *smc, struct smc_request *req, uint32_t now) {
+  req->status = SMC_PENDING;
+  req->deadline = now + req->timeout;
+  req->next = NULL;
+  if (smc->tail) {
+    smc->tail->next = req;
+  } else {
+    smc->head = req;
+  }
+  smc->tail = req;
+  smc->requests++;
+  send_next(smc);
+}
+
+uint smc_service(struct smc *smc, uint32_t now) {
+  uint completed = 0;
+  uint8_t msg[SMC_MSG_SIZE];
+  while (smc->mbox->receive(smc->mbox->ctx, msg)) {
+    if (msg[0] == SMC_BULK) {
+      dispatch_bulk(smc, msg);
+    } else if (smc->sent && msg[0] == smc->head->msg[0]) {
+      memcpy(smc->head->reply, msg, SMC_MSG_SIZE);
+      smc->replies++;
+      complete(smc, NULL, smc->head, SMC_OK);
+      completed++;
+    } else {
+      smc->stray++;
+    }
+  }
+
+  // queued ones time out too, a request stuck behind a dead one should not wait out its own timeout
+  // and then some
+  struct smc_request *prev = NULL;
+  for (struct smc_request *req = smc->head; req;) {
+    struct smc_request *next = req->next;
+    if (expired(req, now)) {
+      smc->timeouts++;
+      complete(smc, prev, req, SMC_TIMED_OUT);
+      completed++;
+    } else {
+      prev = req;
+    }
+    req = next;
+  }
+
+  return completed + send_next(smc);
+}
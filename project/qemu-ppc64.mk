@@ -1,12 +1,16 @@
 LOCAL_DIR := $(GET_LOCAL_DIR)
 
 # tested with: qemu-system-ppc64 -serial mon:stdio -M pseries -cpu 970 -kernel ~/apps/ppc/lk-ppc/build-qemu-ppc64/lk.elf
+# add -smp 6 to bring up the secondary cpus
+# add -M pseries,cap-hpt-max-page-size=16M to run the kernel translated, on the 16MB linear map
 
 TARGET := qemu-ppc64
 
 MODULES += app/shell
+MODULES += app/ppcbench
 MODULES += app/tests
 MODULES += lib/debugcommands
+MODULES += unittest
 #MODULES += lib/gfx
 #MODULES += lib/gfxconsole
 
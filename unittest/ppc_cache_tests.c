@@ -0,0 +1,69 @@
+/*
+ * Cache range op tests, code written through the dcache runs once the range
+ * is synced, and clean/flush of unaligned ranges leave the data intact.
+ */
+#include <lib/unittest.h>
+
+#include <arch/ops.h>
+#include <arch/ppc64.h>
+#include <lk/debug.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#define LI_R3(v) (0x38600000 | ((v) & 0xffff))
+#define BLR      0x4e800020
+
+// two 128 byte blocks, code[32] starts the second
+static uint32_t code[64] __ALIGNED(128);
+static uint8_t data[1024] __ALIGNED(128);
+
+static int call_at(uint i) {
+  int (*fn)(void) = (int (*)(void))&code[i];
+  return fn();
+}
+
+static bool test_sync_runs_new_code(void) {
+  BEGIN_TEST;
+
+  // the same words rewritten a few times, a stale icache block would return the previous value
+  for (int v = 1; v <= 5; v++) {
+    code[0] = LI_R3(v);
+    code[1] = BLR;
+    code[32] = LI_R3(100 + v);
+    code[33] = BLR;
+    arch_sync_cache_range((addr_t)code, sizeof(code));
+    EXPECT_EQ(v, call_at(0), "first block");
+    EXPECT_EQ(100 + v, call_at(32), "second block");
+  }
+
+  // a range that starts and ends mid block still covers both ends
+  code[31] = LI_R3(7);
+  code[32] = BLR;
+  arch_sync_cache_range((addr_t)&code[31], 2 * sizeof(uint32_t));
+  EXPECT_EQ(7, call_at(31), "unaligned range");
+
+  END_TEST;
+}
+
+static bool test_clean_keeps_data(void) {
+  BEGIN_TEST;
+
+  for (uint i = 0; i < sizeof(data); i++) data[i] = (uint8_t)(i * 13);
+  arch_clean_cache_range((addr_t)data + 5, 300);
+  arch_clean_invalidate_cache_range((addr_t)data + 131, 700);
+  arch_invalidate_cache_range((addr_t)data + 1, 0);
+  bool same = true;
+  for (uint i = 0; i < sizeof(data); i++) {
+    if (data[i] != (uint8_t)(i * 13)) same = false;
+  }
+  EXPECT_TRUE(same, "contents survive clean and flush");
+  EXPECT_GE(ppc64_dcache_block, 32U, "dcache block size");
+  EXPECT_GE(ppc64_icache_block, 32U, "icache block size");
+
+  END_TEST;
+}
+
+BEGIN_TEST_CASE(ppc_cache)
+RUN_TEST(test_sync_runs_new_code);
+RUN_TEST(test_clean_keeps_data);
+END_TEST_CASE(ppc_cache)
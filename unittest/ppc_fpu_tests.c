@@ -0,0 +1,91 @@
+/*
+ * Lazy fp switching tests, threads sharing one cpu keep their own fp
+ * registers across switches and integer-only threads never load them.
+ */
+#include <lib/unittest.h>
+
+#include <arch/ppc64.h>
+#include <kernel/thread.h>
+#include <lk/debug.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#define FP_ROUNDS 200
+
+struct fp_worker {
+  double seed;
+  double result;
+  uint64_t traps;
+};
+
+static double fp_step(double acc, double seed) {
+  return acc * 1.0000001 + seed;
+}
+
+static int fp_worker(void *arg) {
+  struct fp_worker *w = arg;
+  // the compiler is free to keep acc in a nonvolatile fpr across thread_yield()
+  double acc = 0;
+  for (uint i = 0; i < FP_ROUNDS; i++) {
+    acc = fp_step(acc, w->seed);
+    thread_yield();
+  }
+  w->result = acc;
+  w->traps = get_current_thread()->arch.fp_traps;
+  return 0;
+}
+
+static int int_worker(void *arg) {
+  uint64_t *traps = arg;
+  volatile uint64_t acc = 0;
+  for (uint i = 0; i < FP_ROUNDS; i++) {
+    acc = acc * 3 + i;
+    thread_yield();
+  }
+  *traps = get_current_thread()->arch.fp_traps + get_current_thread()->arch.vmx_traps;
+  return 0;
+}
+
+static bool test_fp_across_switches(void) {
+  BEGIN_TEST;
+
+  struct fp_worker w[3] = { { .seed = 1.5 }, { .seed = -2.25 }, { .seed = 1e10 } };
+  thread_t *t[3];
+  for (uint i = 0; i < countof(w); i++) {
+    t[i] = thread_create("fp worker", &fp_worker, &w[i], DEFAULT_PRIORITY, DEFAULT_STACK_SIZE);
+    thread_set_pinned_cpu(t[i], 0);
+    thread_resume(t[i]);
+  }
+  for (uint i = 0; i < countof(w); i++) {
+    thread_join(t[i], NULL, INFINITE_TIME);
+    double expect = 0;
+    for (uint r = 0; r < FP_ROUNDS; r++) expect = fp_step(expect, w[i].seed);
+    EXPECT_TRUE(w[i].result == expect, "same result as without switches");
+    EXPECT_GE(w[i].traps, 1ULL, "loaded lazily");
+  }
+
+  END_TEST;
+}
+
+static bool test_int_thread_never_loads(void) {
+  BEGIN_TEST;
+
+  uint64_t traps = UINT64_MAX;
+  struct fp_worker w = { .seed = 3.0 };
+  thread_t *ti = thread_create("int worker", &int_worker, &traps, DEFAULT_PRIORITY, DEFAULT_STACK_SIZE);
+  thread_t *tf = thread_create("fp worker", &fp_worker, &w, DEFAULT_PRIORITY, DEFAULT_STACK_SIZE);
+  thread_set_pinned_cpu(ti, 0);
+  thread_set_pinned_cpu(tf, 0);
+  thread_resume(ti);
+  thread_resume(tf);
+  thread_join(ti, NULL, INFINITE_TIME);
+  thread_join(tf, NULL, INFINITE_TIME);
+  EXPECT_EQ(0ULL, traps, "no fp or vmx loads");
+
+  END_TEST;
+}
+
+BEGIN_TEST_CASE(ppc_fpu)
+RUN_TEST(test_fp_across_switches);
+RUN_TEST(test_int_thread_never_loads);
+END_TEST_CASE(ppc_fpu)
@@ -0,0 +1,41 @@
+/*
+ * The insnbench chains from app/ppcbench, checked for computing what they
+ * should, a chain that lost its dependency would time the wrong thing.
+ */
+#include <lib/unittest.h>
+
+#include <app/insnbench.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+CHAIN(add, I_ADD)
+CHAIN(addi, I_ADDI)
+CHAIN(neg, I_NEG)
+CHAIN(mulli, I_MULLI)
+CHAIN(rldcl, I_RLDCL)
+
+static bool test_chains(void) {
+  BEGIN_TEST;
+
+  EXPECT_EQ(1ULL + 10 * LAT_REPT, add_lat(10, 1, 1), "add chain");
+  EXPECT_EQ(1ULL + 10 * LAT_REPT, addi_lat(10, 1, 0), "addi chain");
+  uint64_t m = 1;
+  for (uint i = 0; i < LAT_REPT; i++) m *= 3;
+  EXPECT_EQ(m, mulli_lat(1, 1, 0), "mulli chain");
+
+  // LAT_REPT rotates by 5 go all the way round
+  const uint64_t x = 0xfedcba9876543210ULL;
+  EXPECT_EQ(x, rldcl_lat(1, x, 5), "rldcl chain");
+  EXPECT_EQ(x, neg_lat(1, x, 0), "neg chain");
+
+  // six chains, each advanced by TPUT_REPT
+  uint64_t expect = 0;
+  for (uint i = 0; i < CHAINS; i++) expect ^= 100 + i + 3 * TPUT_REPT;
+  EXPECT_EQ(expect, add_tput(3, 100, 1), "independent add chains");
+
+  END_TEST;
+}
+
+BEGIN_TEST_CASE(ppc_insnbench)
+RUN_TEST(test_chains);
+END_TEST_CASE(ppc_insnbench)
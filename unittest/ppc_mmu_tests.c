@@ -0,0 +1,219 @@
+/*
+ * Hashed page table engine tests, the hash helpers on their own and
+ * map/query/unmap through a private aspace, including PTEG overflow.
+ */
+#include <lib/unittest.h>
+
+#include <arch/hpt.h>
+#include <arch/mmu.h>
+#include <arch/ppc64.h>
+#include <lk/debug.h>
+#include <lk/err.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+static bool test_hpte_vpn(void) {
+  BEGIN_TEST;
+
+  const uint64_t mask = (1ULL << HPT_MIN_PTEG_SHIFT) - 1;
+  const uint64_t eas[] = { 0x0, 0x1000, 0x0ffff000, 0x12345000, 0xc000000001234000ULL, 0x7fffabcd000ULL };
+
+  for (uint32_t ctx = 0; ctx < 3; ctx++) {
+    for (uint i = 0; i < countof(eas); i++) {
+      uint64_t vsid = hpt_vsid(ctx, eas[i] >> HPT_SEGMENT_SHIFT);
+      uint64_t vpn = hpt_vpn(vsid, eas[i]);
+      uint64_t v = hpte_v(vsid, eas[i]);
+      uint64_t hash = hpt_hash(vsid, eas[i]);
+
+      uint64_t ptex = (hash & mask) * HPT_PTEG_SLOTS + 5;
+      EXPECT_EQ(vpn, hpte_vpn(v, ptex), "primary slot gives the vpn back");
+      ptex = (~hash & mask) * HPT_PTEG_SLOTS + 2;
+      EXPECT_EQ(vpn, hpte_vpn(v | HPTE_V_SECONDARY, ptex), "secondary slot gives the vpn back");
+    }
+  }
+
+  // a large page's hash only has the 16MB page index, the avpn gives back all of it
+  const uint64_t large_ea = PPC64_LINEAR_BASE + (5ULL << HPT_LARGE_SHIFT);
+  uint64_t vsid = hpt_vsid(0, large_ea >> HPT_SEGMENT_SHIFT);
+  uint64_t ptex = (hpt_hash_shift(vsid, large_ea, HPT_LARGE_SHIFT) & mask) * HPT_PTEG_SLOTS;
+  EXPECT_EQ(hpt_vpn(vsid, large_ea), hpte_vpn(hpte_v(vsid, large_ea) | HPTE_V_LARGE, ptex), "large page vpn");
+
+  END_TEST;
+}
+
+// the avpn has to match the vsid slbmte loads for the segment, all 37 bits of it
+static bool test_hpte_avpn(void) {
+  BEGIN_TEST;
+
+  // linear segment 0, its vsid has the top bit set so the va does not fit in 64 bits
+  const uint64_t ea = PPC64_LINEAR_BASE + 0x0abcd000;
+  const uint64_t esid = ea >> HPT_SEGMENT_SHIFT;
+  uint64_t vsid = hpt_vsid(0, esid);
+  ASSERT_GE(vsid, 1ULL << (VSID_BITS - 1), "a 65 bit va");
+
+  // the vsid the slb actually holds, if the segment is bolted on this cpu
+  for (uint i = 0; i < SLB_ENTRIES; i++) {
+    uint64_t slb_esid, slb_vsid;
+    __asm__ volatile("slbmfee %0, %1" : "=r"(slb_esid) : "r"((uint64_t)i));
+    __asm__ volatile("slbmfev %0, %1" : "=r"(slb_vsid) : "r"((uint64_t)i));
+    if (!(slb_esid & (1ULL << 27)) || slb_esid >> HPT_SEGMENT_SHIFT != esid) continue;
+    EXPECT_EQ(vsid, (slb_vsid >> 12) & VSID_MODULUS, "the slb holds the same vsid");
+    vsid = (slb_vsid >> 12) & VSID_MODULUS;
+    break;
+  }
+
+  uint64_t v = hpte_v(vsid, ea);
+  EXPECT_EQ(vsid, v >> (HPTE_V_AVPN_SHIFT + 5), "the avpn carries the whole vsid");
+  EXPECT_EQ(0x0abcd000ULL >> 23, (v >> HPTE_V_AVPN_SHIFT) & 0x1f, "then the top of the offset");
+  EXPECT_EQ(vsid, hpt_vpn(vsid, ea) >> (HPT_SEGMENT_SHIFT - HPT_PAGE_SHIFT), "and so does the vpn");
+
+  END_TEST;
+}
+
+static bool test_vsid_unique(void) {
+  BEGIN_TEST;
+
+  // every pair among a few contexts and segments of both regions
+  uint64_t seen[4 * 64 * 2];
+  uint n = 0;
+  for (uint32_t ctx = 0; ctx < 4; ctx++) {
+    for (uint64_t esid = 0; esid < 64; esid++) {
+      seen[n++] = hpt_vsid(ctx, esid);
+      seen[n++] = hpt_vsid(ctx, 0xc00000000ULL + esid);
+    }
+  }
+  uint dups = 0;
+  for (uint i = 0; i < n; i++) {
+    EXPECT_LT(seen[i], 1ULL << VSID_BITS, "vsid fits");
+    for (uint j = i + 1; j < n; j++) {
+      if (seen[i] == seen[j]) dups++;
+    }
+  }
+  EXPECT_EQ(0U, dups, "no two segments share a vsid");
+
+  END_TEST;
+}
+
+static bool test_map_query_unmap(void) {
+  BEGIN_TEST;
+
+  arch_aspace_t aspace;
+  const vaddr_t base = 0x200000000ULL;
+  const paddr_t pa = 0x1234000;
+  ASSERT_EQ(NO_ERROR, arch_mmu_init_aspace(&aspace, base, 1 << 20, 0), "aspace");
+
+  uint flags = ARCH_MMU_FLAG_PERM_RO | ARCH_MMU_FLAG_PERM_NO_EXECUTE;
+  EXPECT_EQ(NO_ERROR, arch_mmu_map(&aspace, base + 0x3000, pa, 3, flags), "map");
+  EXPECT_EQ(ERR_ALREADY_EXISTS, arch_mmu_map(&aspace, base + 0x4000, pa, 1, 0), "no double map");
+  EXPECT_EQ(ERR_OUT_OF_RANGE, arch_mmu_map(&aspace, base + (1 << 20), pa, 1, 0), "outside the aspace");
+  EXPECT_EQ(NO_ERROR, arch_mmu_map(&aspace, base, pa, 0, 0), "nothing to map");
+  EXPECT_EQ(NO_ERROR, arch_mmu_unmap(&aspace, base, 0), "nothing to unmap");
+
+  paddr_t out;
+  uint out_flags;
+  EXPECT_EQ(NO_ERROR, arch_mmu_query(&aspace, base + 0x5abc, &out, &out_flags), "query");
+  EXPECT_EQ(pa + 0x2abc, out, "physical address");
+  EXPECT_EQ(flags, out_flags, "flags");
+  EXPECT_EQ(ERR_NOT_FOUND, arch_mmu_query(&aspace, base + 0x2000, &out, NULL), "hole before");
+
+  EXPECT_EQ(NO_ERROR, arch_mmu_unmap(&aspace, base + 0x4000, 1), "unmap");
+  EXPECT_EQ(ERR_NOT_FOUND, arch_mmu_query(&aspace, base + 0x4000, &out, NULL), "gone");
+  EXPECT_EQ(NO_ERROR, arch_mmu_query(&aspace, base + 0x3000, &out, NULL), "neighbour stays");
+
+  EXPECT_EQ(NO_ERROR, arch_mmu_destroy_aspace(&aspace), "destroy");
+
+  END_TEST;
+}
+
+static bool test_protect_and_batch_unmap(void) {
+  BEGIN_TEST;
+
+  arch_aspace_t aspace;
+  const vaddr_t base = 0x300000000ULL;
+  const uint pages = 2 * HPT_BATCH + 1;
+  ASSERT_EQ(NO_ERROR, arch_mmu_init_aspace(&aspace, base, 1 << 20, 0), "aspace");
+  EXPECT_EQ(NO_ERROR, arch_mmu_map(&aspace, base, 0x2000000, pages, ARCH_MMU_FLAG_UNCACHED), "map");
+
+  struct hpt_stats before, after;
+  hpt_get_stats(&before);
+  uint flags = ARCH_MMU_FLAG_PERM_RO | ARCH_MMU_FLAG_PERM_NO_EXECUTE;
+  EXPECT_EQ(NO_ERROR, ppc64_mmu_protect(&aspace, base, pages, flags), "protect");
+  hpt_get_stats(&after);
+  EXPECT_EQ((uint64_t)pages, after.protects - before.protects, "done in place");
+
+  paddr_t pa;
+  uint out_flags;
+  EXPECT_EQ(NO_ERROR, arch_mmu_query(&aspace, base + 0x1000, &pa, &out_flags), "query");
+  EXPECT_EQ(0x2001000, pa, "same page");
+  EXPECT_EQ(flags | ARCH_MMU_FLAG_UNCACHED, out_flags, "cache bits kept");
+
+  // a hole in the middle, and a range that does not end on a whole batch
+  EXPECT_EQ(NO_ERROR, arch_mmu_unmap(&aspace, base + 0x2000, 1), "unmap one");
+  hpt_get_stats(&before);
+  EXPECT_EQ(NO_ERROR, arch_mmu_unmap(&aspace, base, pages), "unmap all");
+  hpt_get_stats(&after);
+  EXPECT_EQ((uint64_t)pages - 1, (after.removes - before.removes) + (after.stale - before.stale), "each page once");
+  for (uint i = 0; i < pages; i++) {
+    EXPECT_EQ(ERR_NOT_FOUND, arch_mmu_query(&aspace, base + i * 0x1000, &pa, NULL), "gone");
+  }
+  EXPECT_EQ(NO_ERROR, arch_mmu_destroy_aspace(&aspace), "destroy");
+
+  END_TEST;
+}
+
+#define COLLIDING_PAGES 20
+
+static bool test_pteg_overflow(void) {
+  BEGIN_TEST;
+
+  struct hpt_stats before, after;
+  hpt_get_stats(&before);
+  if (before.ptegs > (1ULL << 16)) {
+    // the page index only reaches 16 bits of the hash, colliding pages would need matching vsids too
+    unittest_printf("table too large to aim at one PTEG, skipping\n");
+    END_TEST;
+  }
+
+  // one page per segment, each picked so the full 16 bits of its hash land on the same value
+  arch_aspace_t aspace;
+  ASSERT_EQ(NO_ERROR, arch_mmu_init_aspace(&aspace, 0, 1ULL << 40, 0), "aspace");
+  const uint64_t target = 0x1234;
+  vaddr_t ea[COLLIDING_PAGES];
+  for (uint i = 0; i < COLLIDING_PAGES; i++) {
+    uint64_t esid = i + 1;
+    uint64_t page = (target ^ hpt_vsid(aspace.ctx, esid)) & 0xffff;
+    ea[i] = (esid << HPT_SEGMENT_SHIFT) | (page << HPT_PAGE_SHIFT);
+    EXPECT_EQ(target, hpt_hash(hpt_vsid(aspace.ctx, esid), ea[i]) & 0xffff, "aimed");
+    EXPECT_EQ(NO_ERROR, arch_mmu_map(&aspace, ea[i], 0x100000 + i * 0x1000, 1, 0), "map");
+  }
+
+  hpt_get_stats(&after);
+  // 8 primary and 8 secondary slots, everything past that pushes something out
+  EXPECT_GE(after.evictions - before.evictions, (uint64_t)(COLLIDING_PAGES - 2 * HPT_PTEG_SLOTS), "evicted");
+  EXPECT_GT(after.secondary - before.secondary, 0ULL, "used the secondary PTEG");
+
+  // the radix tree still knows every one of them
+  for (uint i = 0; i < COLLIDING_PAGES; i++) {
+    paddr_t pa;
+    EXPECT_EQ(NO_ERROR, arch_mmu_query(&aspace, ea[i], &pa, NULL), "still mapped");
+    EXPECT_EQ(0x100000 + i * 0x1000, pa, "right page");
+  }
+
+  for (uint i = 0; i < COLLIDING_PAGES; i++) {
+    EXPECT_EQ(NO_ERROR, arch_mmu_unmap(&aspace, ea[i], 1), "unmap");
+  }
+  hpt_get_stats(&after);
+  EXPECT_GE(after.stale - before.stale, (uint64_t)(COLLIDING_PAGES - 2 * HPT_PTEG_SLOTS), "evicted ones were stale");
+  EXPECT_EQ(NO_ERROR, arch_mmu_destroy_aspace(&aspace), "destroy");
+
+  END_TEST;
+}
+
+BEGIN_TEST_CASE(ppc_mmu)
+RUN_TEST(test_hpte_vpn);
+RUN_TEST(test_hpte_avpn);
+RUN_TEST(test_vsid_unique);
+RUN_TEST(test_map_query_unmap);
+RUN_TEST(test_protect_and_batch_unmap);
+RUN_TEST(test_pteg_overflow);
+END_TEST_CASE(ppc_mmu)
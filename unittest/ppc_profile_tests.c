@@ -0,0 +1,101 @@
+/*
+ * Profiler tests, the back chain walk against a known call chain, the
+ * symbol table when the image has one, and samples from a short run.
+ */
+#include <lib/unittest.h>
+
+#include <arch/ppc64.h>
+#include <arch/ticks.h>
+#include <kernel/thread.h>
+#include <lk/compiler.h>
+#include <lk/err.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#define CHAIN_MAX 8
+
+static uint64_t chain[CHAIN_MAX];
+static uint chain_len;
+static uint64_t ret_into_a, ret_into_b;
+
+static __NO_INLINE void chain_c(void) {
+  ret_into_b = (uint64_t)__builtin_return_address(0);
+  uint64_t sp;
+  __asm__ volatile("mr %0, %%r1" : "=r"(sp));
+  thread_t *t = get_current_thread();
+  chain_len = ppc64_backchain(sp, (uint64_t)t->stack, (uint64_t)t->stack + t->stack_size, chain, CHAIN_MAX);
+}
+
+static __NO_INLINE void chain_b(void) {
+  ret_into_a = (uint64_t)__builtin_return_address(0);
+  chain_c();
+  __asm__ volatile("" ::: "memory");  // not a tail call, b keeps its frame
+}
+
+static __NO_INLINE void chain_a(void) {
+  chain_b();
+  __asm__ volatile("" ::: "memory");
+}
+
+static bool test_backchain(void) {
+  BEGIN_TEST;
+
+  chain_a();
+  ASSERT_GE(chain_len, 3u, "up to here at least");
+  EXPECT_EQ(ret_into_b, chain[0], "c returns into b");
+  EXPECT_EQ(ret_into_a, chain[1], "b returns into a");
+
+  uint64_t none[1];
+  EXPECT_EQ(0u, ppc64_backchain(0x1234, 0, 0x10000, none, 1), "misaligned sp");
+  thread_t *t = get_current_thread();
+  EXPECT_EQ(0u, ppc64_backchain((uint64_t)t->stack, (uint64_t)t->stack, (uint64_t)t->stack, none, 1), "empty bounds");
+
+  END_TEST;
+}
+
+static bool test_ksym(void) {
+  BEGIN_TEST;
+
+  EXPECT_NULL(ppc64_ksym(0, NULL), "outside the kernel");
+  uint64_t start;
+  const char *name = ppc64_ksym((uint64_t)&ppc64_backchain + 4, &start);
+  if (!name) {
+    unittest_printf("no symbol table in this image, skipping\n");
+    END_TEST;
+  }
+  EXPECT_EQ(0, strcmp(name, "ppc64_backchain"), "inside the function");
+  EXPECT_EQ((uint64_t)&ppc64_backchain, start, "its start");
+
+  END_TEST;
+}
+
+static bool test_samples(void) {
+  BEGIN_TEST;
+
+  ASSERT_EQ(NO_ERROR, ppc64_profile_start(1000, 256), "start");
+  EXPECT_EQ(ERR_BUSY, ppc64_profile_start(1000, 256), "already running");
+  lk_ticks_t start = lk_ticks();
+  while (lk_ticks() - start < lk_ms_to_ticks(20));
+  ppc64_profile_stop();
+
+  uint total = 0;
+  for (uint cpu = 0; cpu < SMP_MAX_CPUS; cpu++) total += ppc64_profile_count(cpu);
+  EXPECT_GE(total, 10u, "about 20 on this cpu alone");
+  uint stopped = total;
+  start = lk_ticks();
+  while (lk_ticks() - start < lk_ms_to_ticks(5));
+  total = 0;
+  for (uint cpu = 0; cpu < SMP_MAX_CPUS; cpu++) total += ppc64_profile_count(cpu);
+  EXPECT_EQ(stopped, total, "nothing after the stop");
+
+  EXPECT_EQ(ERR_INVALID_ARGS, ppc64_profile_start(0, 256), "no rate");
+
+  END_TEST;
+}
+
+BEGIN_TEST_CASE(ppc_profile)
+RUN_TEST(test_backchain);
+RUN_TEST(test_ksym);
+RUN_TEST(test_samples);
+END_TEST_CASE(ppc_profile)
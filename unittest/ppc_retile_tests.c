@@ -0,0 +1,175 @@
+/*
+ * Xenon framebuffer retile tests, scalar and vmx conversion of whole and
+ * partial frames against a per pixel reference, and direct drawing into the
+ * tiles against the same drawing on a linear frame, into memory instead of the gpu.
+ * The block copies also run on a frame that is not a whole number of tiles wide.
+ */
+#include <lib/unittest.h>
+
+#include <lk/debug.h>
+#include <platform/retile.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#define W 96
+#define H 40
+
+static uint32_t src[W * H] __ALIGNED(16);
+static uint32_t dst[W * 64] __ALIGNED(16);
+static uint32_t ref[W * 64] __ALIGNED(16);
+static struct retile_fb fb;
+
+// the per pixel loop retile.c replaced
+static void reference(uint x0, uint y0, uint x1, uint y1) {
+  for (uint y = y0; y < y1; y++) {
+    for (uint x = x0; x < x1; x++) {
+      uint32_t in = src[y * W + x];
+      uint8_t r = in >> 16, g = in >> 8, b = in;
+      ref[retile_offset(W, x, y)] = (r << 8) | (g << 16) | ((uint32_t)b << 24);
+    }
+  }
+}
+
+static void paint(uint x0, uint y0, uint x1, uint y1, uint32_t seed) {
+  for (uint y = y0; y < y1; y++) {
+    for (uint x = x0; x < x1; x++) src[y * W + x] = (y * W + x) * 2654435761u + seed;
+  }
+}
+
+static bool run(bool vmx) {
+  BEGIN_TEST;
+
+  memset(dst, 0, sizeof(dst));
+  memset(ref, 0, sizeof(ref));
+  ASSERT_EQ(0, retile_init(&fb, src, dst, W, H), "init");
+  fb.vmx = vmx;
+  EXPECT_LE(retile_dst_words(W, H), countof(dst), "tiled size");
+
+  paint(0, 0, W, H, 1);
+  reference(0, 0, W, H);
+  retile_damage(&fb, 0, 0, W, H);
+  EXPECT_EQ(W / 4 * H, retile_flush(&fb), "whole frame");
+  EXPECT_BYTES_EQ((uint8_t *)ref, (uint8_t *)dst, sizeof(dst), "whole frame");
+
+  // two separate updates, not group aligned, one of them running off the edge
+  paint(5, 3, 42, 19, 2);
+  paint(60, 30, W, H, 3);
+  reference(4, 3, 44, 19);
+  reference(60, 30, W, H);
+  retile_damage(&fb, 5, 3, 42, 19);
+  retile_damage(&fb, 60, 30, W + 50, H + 50);
+  EXPECT_EQ(10 * 16 + 9 * 10, retile_flush(&fb), "only the damaged groups");
+  EXPECT_BYTES_EQ((uint8_t *)ref, (uint8_t *)dst, sizeof(dst), "partial update");
+
+  EXPECT_EQ(0, retile_flush(&fb), "nothing left");
+
+  END_TEST;
+}
+
+static void linear_fill(uint x, uint y, uint w, uint h, uint32_t c) {
+  for (uint j = y; j < y + h; j++) {
+    for (uint i = x; i < x + w; i++) src[j * W + i] = c;
+  }
+}
+
+static bool test_direct(void) {
+  BEGIN_TEST;
+
+  memset(dst, 0, sizeof(dst));
+  memset(ref, 0, sizeof(ref));
+  ASSERT_EQ(0, retile_init(&fb, NULL, dst, W, H), "init");
+
+  paint(0, 0, W, H, 4);
+  for (uint y = 0; y < H; y++) {
+    for (uint x = 0; x < W; x++) retile_put(&fb, x, y, src[y * W + x]);
+  }
+  retile_fill(&fb, 3, 5, 1, 7, 0xff102030);
+  linear_fill(3, 5, 1, 7, 0xff102030);
+  retile_fill(&fb, 6, 9, 77, 20, 0xff405060);
+  linear_fill(6, 9, 77, 20, 0xff405060);
+
+  // a console scroll, then a move right within the same rows
+  retile_copy(&fb, 0, 16, W, H - 16, 0, 0);
+  memmove(src, src + 16 * W, (H - 16) * W * sizeof(uint32_t));
+  retile_copy(&fb, 10, 2, 50, 4, 13, 2);
+  for (uint y = 2; y < 6; y++) memmove(&src[y * W + 13], &src[y * W + 10], 50 * sizeof(uint32_t));
+
+  reference(0, 0, W, H);
+  EXPECT_BYTES_EQ((uint8_t *)ref, (uint8_t *)dst, sizeof(dst), "same as drawing linearly");
+  EXPECT_EQ(0, retile_flush(&fb), "nothing to flush");
+
+  END_TEST;
+}
+
+// a width that is not whole tiles, pitch 128, tall enough for two tile rows
+#define W2 100
+#define H2 72
+
+static uint32_t lin2[W2 * H2];
+static uint32_t dst2[128 * 96] __ALIGNED(16);
+
+static void linear_copy(uint x, uint y, uint w, uint h, uint x2, uint y2) {
+  static uint32_t tmp[W2 * H2];
+  for (uint j = 0; j < h; j++) memcpy(&tmp[j * w], &lin2[(y + j) * W2 + x], w * sizeof(uint32_t));
+  for (uint j = 0; j < h; j++) memcpy(&lin2[(y2 + j) * W2 + x2], &tmp[j * w], w * sizeof(uint32_t));
+}
+
+static bool matches_linear(void) {
+  for (uint y = 0; y < H2; y++) {
+    for (uint x = 0; x < W2; x++) {
+      if (dst2[retile_offset(fb.pitch, x, y)] != retile_pixel(lin2[y * W2 + x])) return false;
+    }
+  }
+  return true;
+}
+
+// each of the copy paths, whole tiles, whole groups and single pixels, against the same copy done linearly
+static bool test_copy(void) {
+  BEGIN_TEST;
+
+  memset(dst2, 0, sizeof(dst2));
+  ASSERT_EQ(0, retile_init(&fb, NULL, dst2, W2, H2), "init");
+  EXPECT_LE(retile_dst_words(W2, H2), countof(dst2), "tiled size");
+  for (uint y = 0; y < H2; y++) {
+    for (uint x = 0; x < W2; x++) {
+      lin2[y * W2 + x] = (y * W2 + x) * 2654435761u + 5;
+      retile_put(&fb, x, y, lin2[y * W2 + x]);
+    }
+  }
+  ASSERT_TRUE(matches_linear(), "drawn");
+
+  static const struct {
+    uint x, y, w, h, x2, y2;
+    const char *what;
+  } copies[] = {
+    { 0, 12, W2, H2 - 12, 0, 0, "a console scroll, whole groups across a row the width of the frame" },
+    { 0, 0, 64, 32, 32, 32, "whole tiles, down and right" },
+    { 32, 32, 64, 32, 0, 32, "whole tiles, left within the same tile row" },
+    { 8, 3, 60, 9, 12, 3, "whole groups, right within the same rows" },
+    { 40, 20, 16, 30, 40, 25, "whole groups, down by less than the height" },
+    { 3, 40, 33, 17, 5, 38, "single pixels, up and right" },
+  };
+  for (uint i = 0; i < countof(copies); i++) {
+    retile_copy(&fb, copies[i].x, copies[i].y, copies[i].w, copies[i].h, copies[i].x2, copies[i].y2);
+    linear_copy(copies[i].x, copies[i].y, copies[i].w, copies[i].h, copies[i].x2, copies[i].y2);
+    EXPECT_TRUE(matches_linear(), copies[i].what);
+  }
+
+  END_TEST;
+}
+
+static bool test_scalar(void) {
+  return run(false);
+}
+
+static bool test_vmx(void) {
+  return run(true);
+}
+
+BEGIN_TEST_CASE(ppc_retile)
+RUN_TEST(test_scalar);
+RUN_TEST(test_vmx);
+RUN_TEST(test_direct);
+RUN_TEST(test_copy);
+END_TEST_CASE(ppc_retile)
@@ -0,0 +1,246 @@
+/*
+ * Xenon smc protocol tests, the request queue, replies, timeouts and bulk
+ * dispatch driven against a simulated mailbox with a fake clock instead of the smc.
+ */
+#include <lib/unittest.h>
+
+#include <lk/debug.h>
+#include <platform/smc.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#define SIM_MSGS 8
+
+static struct sim {
+  bool busy;                          // tx side not taking messages
+  uint8_t sent[SIM_MSGS][SMC_MSG_SIZE];
+  uint nsent;
+  uint8_t rx[SIM_MSGS][SMC_MSG_SIZE];
+  uint rx_head, rx_tail;
+} sim;
+
+static bool sim_can_send(void *ctx) {
+  return !sim.busy;
+}
+
+static void sim_send(void *ctx, const uint8_t *msg) {
+  if (sim.nsent < SIM_MSGS) memcpy(sim.sent[sim.nsent], msg, SMC_MSG_SIZE);
+  sim.nsent++;
+}
+
+static bool sim_receive(void *ctx, uint8_t *msg) {
+  if (sim.rx_head == sim.rx_tail) return false;
+  memcpy(msg, sim.rx[sim.rx_head++ % SIM_MSGS], SMC_MSG_SIZE);
+  return true;
+}
+
+// what the smc puts in the rx side
+static void sim_push(uint8_t b0, uint8_t b1, uint8_t b2, uint8_t b3) {
+  uint8_t *msg = sim.rx[sim.rx_tail++ % SIM_MSGS];
+  memset(msg, 0, SMC_MSG_SIZE);
+  msg[0] = b0;
+  msg[1] = b1;
+  msg[2] = b2;
+  msg[3] = b3;
+}
+
+static const struct smc_mailbox sim_mbox = {
+  .can_send = sim_can_send,
+  .send = sim_send,
+  .receive = sim_receive,
+};
+
+static struct smc smc;
+static uint done_count;
+static struct smc_request *done_last;
+
+static void record_done(struct smc_request *req) {
+  done_count++;
+  done_last = req;
+}
+
+static uint bulk_count[2];
+static uint8_t bulk_last[SMC_MSG_SIZE];
+
+static void record_bulk(const uint8_t *msg, void *arg) {
+  bulk_count[(uintptr_t)arg]++;
+  memcpy(bulk_last, msg, SMC_MSG_SIZE);
+}
+
+static void reset(void) {
+  memset(&sim, 0, sizeof(sim));
+  smc_init(&smc, &sim_mbox);
+  done_count = 0;
+  done_last = NULL;
+  memset(bulk_count, 0, sizeof(bulk_count));
+}
+
+static void request(struct smc_request *req, uint8_t cmd, bool want_reply, uint32_t timeout) {
+  memset(req, 0, sizeof(*req));
+  req->msg[0] = cmd;
+  req->want_reply = want_reply;
+  req->timeout = timeout;
+  req->done = record_done;
+}
+
+static bool test_no_reply(void) {
+  BEGIN_TEST;
+
+  reset();
+  struct smc_request req;
+  request(&req, 0x82, false, 0);
+  req.msg[1] = 0x04;
+  smc_submit(&smc, &req, 0);
+  EXPECT_EQ(1u, sim.nsent, "sent at once");
+  EXPECT_EQ(0x82, sim.sent[0][0], "as given");
+  EXPECT_EQ(0x04, sim.sent[0][1], "as given");
+  EXPECT_EQ(1u, done_count, "done once sent");
+  EXPECT_EQ(SMC_OK, req.status, "status");
+  EXPECT_FALSE(smc_busy(&smc), "queue empty");
+
+  END_TEST;
+}
+
+static bool test_reply_and_bulk(void) {
+  BEGIN_TEST;
+
+  reset();
+  ASSERT_EQ(0, smc_register_bulk(&smc, SMC_BULK_IR, SMC_BULK_IR, record_bulk, (void *)0), "register");
+  struct smc_request req;
+  request(&req, 0x04, true, 0);
+  smc_submit(&smc, &req, 0);
+  EXPECT_EQ(SMC_PENDING, req.status, "waiting for the reply");
+  EXPECT_EQ(0u, smc_service(&smc, 1), "nothing in yet");
+
+  // a key press arrives ahead of the reply
+  sim_push(SMC_BULK, SMC_BULK_IR, 0x12, 0x34);
+  sim_push(0x04, 0xaa, 0xbb, 0xcc);
+  EXPECT_EQ(1u, smc_service(&smc, 2), "one completed");
+  EXPECT_EQ(1u, bulk_count[0], "bulk dispatched");
+  EXPECT_EQ(0x12, bulk_last[2], "ir key");
+  EXPECT_EQ(0x34, bulk_last[3], "ir key");
+  EXPECT_EQ(SMC_OK, req.status, "status");
+  EXPECT_EQ(0xaa, req.reply[1], "reply");
+  EXPECT_EQ(0xcc, req.reply[3], "reply");
+  EXPECT_EQ(1u, done_count, "done once");
+
+  END_TEST;
+}
+
+static bool test_queue_order(void) {
+  BEGIN_TEST;
+
+  reset();
+  struct smc_request a, b, c;
+  request(&a, 0x01, true, 0);
+  request(&b, 0x07, true, 0);
+  request(&c, 0x99, false, 0);
+  smc_submit(&smc, &a, 0);
+  smc_submit(&smc, &b, 0);
+  smc_submit(&smc, &c, 0);
+  EXPECT_EQ(1u, sim.nsent, "one on the wire");
+
+  // a reply for b before a has its own is not b's
+  sim_push(0x07, 1, 0, 0);
+  EXPECT_EQ(0u, smc_service(&smc, 1), "not a's reply");
+  EXPECT_EQ(1u, smc.stray, "dropped");
+
+  sim_push(0x01, 2, 0, 0);
+  EXPECT_EQ(1u, smc_service(&smc, 2), "a done");
+  EXPECT_EQ(&a, done_last, "a first");
+  EXPECT_EQ(2u, sim.nsent, "b sent behind it");
+  EXPECT_EQ(0x07, sim.sent[1][0], "b");
+
+  sim_push(0x07, 3, 0, 0);
+  EXPECT_EQ(2u, smc_service(&smc, 3), "b done, c sent and done");
+  EXPECT_EQ(3, b.reply[1], "b's reply");
+  EXPECT_EQ(&c, done_last, "c last");
+  EXPECT_EQ(3u, sim.nsent, "all sent");
+  EXPECT_FALSE(smc_busy(&smc), "queue empty");
+
+  END_TEST;
+}
+
+static bool test_busy_mailbox(void) {
+  BEGIN_TEST;
+
+  reset();
+  sim.busy = true;
+  struct smc_request req;
+  request(&req, 0x82, false, 0);
+  smc_submit(&smc, &req, 0);
+  EXPECT_EQ(0u, smc_service(&smc, 1), "mailbox busy");
+  EXPECT_EQ(0u, sim.nsent, "nothing sent");
+  EXPECT_TRUE(smc_busy(&smc), "still queued");
+
+  sim.busy = false;
+  EXPECT_EQ(1u, smc_service(&smc, 2), "sent once free");
+  EXPECT_EQ(1u, sim.nsent, "sent");
+
+  END_TEST;
+}
+
+static bool test_timeout(void) {
+  BEGIN_TEST;
+
+  reset();
+  struct smc_request a, b, c;
+  request(&a, 0x01, true, 100);
+  request(&b, 0x07, true, 500);
+  request(&c, 0x12, true, 50);
+  smc_submit(&smc, &a, 0xffffffc0);
+  smc_submit(&smc, &b, 0xffffffc0);
+  smc_submit(&smc, &c, 0xffffffc0);
+
+  EXPECT_EQ(0u, smc_service(&smc, 0xffffffc0 + 49), "none due");
+  // c expires while still queued behind a, across the clock wrapping
+  EXPECT_EQ(1u, smc_service(&smc, 0xffffffc0 + 50), "c due");
+  EXPECT_EQ(SMC_TIMED_OUT, c.status, "c timed out");
+  EXPECT_EQ(1u, sim.nsent, "c never sent");
+
+  EXPECT_EQ(1u, smc_service(&smc, 0xffffffc0 + 100), "a due");
+  EXPECT_EQ(SMC_TIMED_OUT, a.status, "a timed out");
+  EXPECT_EQ(2u, sim.nsent, "b sent");
+
+  // a's late reply is not b's
+  sim_push(0x01, 0, 0, 0);
+  sim_push(0x07, 9, 0, 0);
+  EXPECT_EQ(1u, smc_service(&smc, 0xffffffc0 + 101), "b done");
+  EXPECT_EQ(SMC_OK, b.status, "b status");
+  EXPECT_EQ(9, b.reply[1], "b's reply");
+  EXPECT_EQ(1u, smc.stray, "late reply dropped");
+  EXPECT_EQ(2u, smc.timeouts, "timeouts");
+  EXPECT_FALSE(smc_busy(&smc), "queue empty");
+
+  END_TEST;
+}
+
+static bool test_bulk_override(void) {
+  BEGIN_TEST;
+
+  reset();
+  ASSERT_EQ(0, smc_register_bulk(&smc, SMC_BULK_TRAY_FIRST, SMC_BULK_TRAY_LAST, record_bulk, (void *)0), "tray");
+  ASSERT_EQ(0, smc_register_bulk(&smc, 0x62, 0x62, record_bulk, (void *)1), "override");
+  EXPECT_NE(0, smc_register_bulk(&smc, 0x20, 0x10, record_bulk, NULL), "bad range");
+
+  sim_push(SMC_BULK, 0x61, 0, 0);
+  sim_push(SMC_BULK, 0x62, 0, 0);
+  sim_push(SMC_BULK, 0x70, 0, 0);
+  EXPECT_EQ(0u, smc_service(&smc, 0), "no requests");
+  EXPECT_EQ(1u, bulk_count[0], "the tray range");
+  EXPECT_EQ(1u, bulk_count[1], "the newer handler");
+  EXPECT_EQ(3u, smc.bulk_msgs, "bulk messages");
+  EXPECT_EQ(1u, smc.unhandled, "nobody for 0x70");
+
+  END_TEST;
+}
+
+BEGIN_TEST_CASE(ppc_smc)
+RUN_TEST(test_no_reply);
+RUN_TEST(test_reply_and_bulk);
+RUN_TEST(test_queue_order);
+RUN_TEST(test_busy_mailbox);
+RUN_TEST(test_timeout);
+RUN_TEST(test_bulk_override);
+END_TEST_CASE(ppc_smc)
@@ -0,0 +1,155 @@
+/*
+ * Ticket spinlock tests, plus a contention benchmark that runs the same
+ * lock/increment/unlock loop on 1..SMP_MAX_CPUS cpus, one thread pinned to each.
+ */
+#include <lib/unittest.h>
+
+#include <arch/cpu_regs.h>
+#include <arch/ppc64.h>
+#include <arch/spinlock.h>
+#include <kernel/spinlock.h>
+#include <kernel/thread.h>
+#include <lk/console_cmd.h>
+#include <lk/debug.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdint.h>
+
+#define BENCH_ITERATIONS 100000
+
+static spin_lock_t bench_lock = SPIN_LOCK_INITIAL_VALUE;
+static volatile uint64_t bench_counter;
+static volatile uint bench_ready;
+static volatile bool bench_go;
+
+struct spin_worker {
+  uint iterations;
+  uint64_t start;
+  uint64_t end;
+};
+
+static int spin_worker(void *arg) {
+  struct spin_worker *w = arg;
+
+  __atomic_fetch_add(&bench_ready, 1, __ATOMIC_RELAXED);
+  while (!bench_go);
+
+  w->start = tbl_read();
+  for (uint i = 0; i < w->iterations; i++) {
+    spin_lock_saved_state_t state;
+    spin_lock_irqsave(&bench_lock, state);
+    bench_counter++;
+    spin_unlock_irqrestore(&bench_lock, state);
+  }
+  w->end = tbl_read();
+  return 0;
+}
+
+static uint online_cpus(void) {
+  uint n = 1;
+  while (n < SMP_MAX_CPUS && ppc64_get_percpu_for(n)->online) n++;
+  return n;
+}
+
+// runs the loop on cpus 0..nthreads-1, the caller moves to cpu 0 and takes part itself, the others
+// get a pinned worker each, so a worker waiting for the start never holds a cpu the caller needs
+// returns the elapsed timebase ticks
+static uint64_t run_spin_workers(uint nthreads, uint iterations) {
+  struct spin_worker workers[SMP_MAX_CPUS];
+  thread_t *threads[SMP_MAX_CPUS];
+  thread_t *self = get_current_thread();
+  int pinned = self->pinned_cpu;
+
+  bench_counter = 0;
+  bench_ready = 0;
+  bench_go = false;
+
+  thread_set_pinned_cpu(self, 0);
+  while (arch_curr_cpu_num() != 0) thread_yield();
+
+  for (uint i = 0; i < nthreads; i++) workers[i].iterations = iterations;
+  for (uint i = 1; i < nthreads; i++) {
+    threads[i] = thread_create("spin worker", &spin_worker, &workers[i], DEFAULT_PRIORITY, DEFAULT_STACK_SIZE);
+    thread_set_pinned_cpu(threads[i], i);
+    thread_resume(threads[i]);
+  }
+  while (bench_ready != nthreads - 1);
+  bench_go = true;
+  spin_worker(&workers[0]);
+
+  uint64_t start = workers[0].start, end = workers[0].end;
+  for (uint i = 1; i < nthreads; i++) {
+    thread_join(threads[i], NULL, INFINITE_TIME);
+    if (workers[i].start < start) start = workers[i].start;
+    if (workers[i].end > end) end = workers[i].end;
+  }
+  thread_set_pinned_cpu(self, pinned);
+  return end - start;
+}
+
+static bool test_spinlock_basic(void) {
+  BEGIN_TEST;
+
+  spin_lock_t lock = SPIN_LOCK_INITIAL_VALUE;
+  EXPECT_FALSE(arch_spin_lock_held(&lock), "fresh lock is free");
+  arch_spin_lock(&lock);
+  EXPECT_TRUE(arch_spin_lock_held(&lock), "lock is held");
+  EXPECT_NE(0, arch_spin_trylock(&lock), "trylock fails on a held lock");
+  arch_spin_unlock(&lock);
+  EXPECT_FALSE(arch_spin_lock_held(&lock), "lock is free again");
+  EXPECT_EQ(0, arch_spin_trylock(&lock), "trylock takes a free lock");
+  EXPECT_TRUE(arch_spin_lock_held(&lock), "trylock left the lock held");
+  arch_spin_unlock(&lock);
+
+  END_TEST;
+}
+
+static bool test_spinlock_wrap(void) {
+  BEGIN_TEST;
+
+  // the ticket halves must wrap together
+  spin_lock_t lock = 0xfffefffe;
+  for (int i = 0; i < 4; i++) {
+    arch_spin_lock(&lock);
+    EXPECT_TRUE(arch_spin_lock_held(&lock), "lock is held");
+    arch_spin_unlock(&lock);
+    EXPECT_FALSE(arch_spin_lock_held(&lock), "lock is free");
+  }
+  EXPECT_EQ(0x00020002U, lock, "tickets wrapped");
+
+  END_TEST;
+}
+
+static bool test_spinlock_contended(void) {
+  BEGIN_TEST;
+
+  uint n = online_cpus();
+  run_spin_workers(n, BENCH_ITERATIONS / 10);
+  EXPECT_EQ((uint64_t)n * (BENCH_ITERATIONS / 10), bench_counter, "no lost increments");
+  EXPECT_FALSE(arch_spin_lock_held(&bench_lock), "lock released");
+
+  END_TEST;
+}
+
+BEGIN_TEST_CASE(ppc_spinlock)
+RUN_TEST(test_spinlock_basic);
+RUN_TEST(test_spinlock_wrap);
+RUN_TEST(test_spinlock_contended);
+END_TEST_CASE(ppc_spinlock)
+
+static int cmd_spinbench(int argc, const console_cmd_args *argv) {
+  uint iterations = argc > 1 ? argv[1].u : BENCH_ITERATIONS;
+
+  printf("threads  acquisitions  tb_ticks  ticks_per_acquire\n");
+  for (uint n = 1; n <= online_cpus(); n++) {
+    uint64_t ticks = run_spin_workers(n, iterations);
+    uint64_t total = (uint64_t)n * iterations;
+    printf("%7u  %12llu  %8llu  %17llu%s\n", n, total, ticks, ticks / total,
+        bench_counter == total ? "" : "  LOST UPDATES");
+  }
+  return 0;
+}
+
+STATIC_COMMAND_START
+STATIC_COMMAND("spinbench", "spinlock contention benchmark [iterations]", &cmd_spinbench)
+STATIC_COMMAND_END(ppc_spinlock);
@@ -0,0 +1,121 @@
+/*
+ * arch string routine tests, every alignment of source and destination
+ * against a byte loop, at sizes that reach the scalar, vmx and dcbz paths.
+ */
+#include <lib/unittest.h>
+
+#include <arch/ops.h>
+#include <lk/debug.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#define BUF_SIZE 4096
+
+static uint8_t buf_a[BUF_SIZE] __ALIGNED(128);
+static uint8_t buf_b[BUF_SIZE] __ALIGNED(128);
+static uint8_t ref[BUF_SIZE] __ALIGNED(128);
+
+static const size_t lengths[] = { 0, 1, 7, 8, 15, 16, 31, 63, 64, 255, 256, 300, 511, 512, 1000, 2049 };
+
+static void fill(uint8_t *p, uint8_t seed) {
+  for (uint i = 0; i < BUF_SIZE; i++) p[i] = (uint8_t)(i * 7 + seed);
+}
+
+static bool same(const uint8_t *a, const uint8_t *b) {
+  for (uint i = 0; i < BUF_SIZE; i++) {
+    if (a[i] != b[i]) return false;
+  }
+  return true;
+}
+
+static bool test_memcpy_alignments(void) {
+  BEGIN_TEST;
+
+  for (uint l = 0; l < countof(lengths); l++) {
+    for (uint d = 0; d < 16; d++) {
+      for (uint s = 0; s < 16; s++) {
+        size_t n = lengths[l];
+        fill(buf_a, 1);
+        fill(buf_b, 2);
+        fill(ref, 1);
+        for (size_t i = 0; i < n; i++) ref[d + i] = buf_b[s + i];
+        memcpy(buf_a + d, buf_b + s, n);
+        if (!same(buf_a, ref)) {
+          unittest_printf("memcpy dst +%u src +%u len %zu\n", d, s, n);
+          EXPECT_TRUE(false, "memcpy matches a byte loop");
+        }
+      }
+    }
+  }
+
+  END_TEST;
+}
+
+static bool test_memmove_overlap(void) {
+  BEGIN_TEST;
+
+  for (uint l = 0; l < countof(lengths); l++) {
+    for (int delta = -17; delta <= 17; delta++) {
+      size_t n = lengths[l];
+      uint s = 40, d = s + delta;
+      fill(buf_a, 3);
+      fill(ref, 3);
+      fill(buf_b, 3);
+      for (size_t i = 0; i < n; i++) ref[d + i] = buf_b[s + i];
+      memmove(buf_a + d, buf_a + s, n);
+      if (!same(buf_a, ref)) {
+        unittest_printf("memmove delta %d len %zu\n", delta, n);
+        EXPECT_TRUE(false, "memmove matches a copy through a second buffer");
+      }
+    }
+  }
+
+  END_TEST;
+}
+
+static bool test_memset_alignments(void) {
+  BEGIN_TEST;
+
+  const int values[] = { 0, 0xa5 };
+  for (uint v = 0; v < countof(values); v++) {
+    for (uint l = 0; l < countof(lengths); l++) {
+      for (uint d = 0; d < 136; d += 9) {
+        size_t n = lengths[l];
+        fill(buf_a, 4);
+        fill(ref, 4);
+        for (size_t i = 0; i < n; i++) ref[d + i] = values[v];
+        memset(buf_a + d, values[v], n);
+        if (!same(buf_a, ref)) {
+          unittest_printf("memset %#x dst +%u len %zu\n", values[v], d, n);
+          EXPECT_TRUE(false, "memset matches a byte loop");
+        }
+      }
+    }
+  }
+
+  END_TEST;
+}
+
+// the vmx paths only run with interrupts on, run the copies once more with them off
+static bool test_scalar_with_ints_off(void) {
+  BEGIN_TEST;
+
+  fill(buf_a, 5);
+  fill(buf_b, 6);
+  fill(ref, 5);
+  for (size_t i = 0; i < 1000; i++) ref[3 + i] = buf_b[5 + i];
+  arch_disable_ints();
+  memcpy(buf_a + 3, buf_b + 5, 1000);
+  arch_enable_ints();
+  EXPECT_TRUE(same(buf_a, ref), "scalar memcpy");
+
+  END_TEST;
+}
+
+BEGIN_TEST_CASE(ppc_string)
+RUN_TEST(test_memcpy_alignments);
+RUN_TEST(test_memmove_overlap);
+RUN_TEST(test_memset_alignments);
+RUN_TEST(test_scalar_with_ints_off);
+END_TEST_CASE(ppc_string)
@@ -0,0 +1,214 @@
+/*
+ * Timer wheel tests, driven through a private wheel with a fake clock,
+ * plus a check that the decrementer backed LK timers actually fire.
+ */
+#include <lib/unittest.h>
+
+#include <arch/ticks.h>
+#include <arch/timer_wheel.h>
+#include <kernel/thread.h>
+#include <kernel/timer.h>
+#include <lk/debug.h>
+#include <platform.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdint.h>
+
+#define MAX_FIRED 16
+
+static uint64_t fired_at[MAX_FIRED];
+static struct ppc64_timer *fired_timer[MAX_FIRED];
+static uint fired_count;
+
+static enum handler_return record_fire(struct ppc64_timer *t, uint64_t now, void *arg) {
+  if (fired_count < MAX_FIRED) {
+    fired_at[fired_count] = now;
+    fired_timer[fired_count] = t;
+  }
+  fired_count++;
+  return INT_NO_RESCHEDULE;
+}
+
+static void reset_fired(void) {
+  fired_count = 0;
+}
+
+static struct timer_wheel wheel;
+
+static bool test_wheel_order(void) {
+  BEGIN_TEST;
+
+  const uint64_t base = 0x123456;
+  struct ppc64_timer a = PPC64_TIMER_INITIAL_VALUE;
+  struct ppc64_timer b = PPC64_TIMER_INITIAL_VALUE;
+  struct ppc64_timer c = PPC64_TIMER_INITIAL_VALUE;
+
+  timer_wheel_init(&wheel, base);
+  reset_fired();
+  timer_wheel_add(&wheel, &c, base + 5000000, 0, record_fire, NULL); // level 3
+  timer_wheel_add(&wheel, &a, base + 100, 0, record_fire, NULL);     // level 0
+  timer_wheel_add(&wheel, &b, base + 20000, 0, record_fire, NULL);   // level 1
+
+  // step the clock the way the decrementer would, one deadline at a time
+  uint64_t deadline;
+  uint steps = 0;
+  while (timer_wheel_next(&wheel, &deadline) && steps++ < 64) {
+    EXPECT_GE(deadline, wheel.clk, "deadlines never go backwards");
+    timer_wheel_run(&wheel, deadline);
+  }
+
+  EXPECT_EQ(3U, fired_count, "all three fired");
+  EXPECT_EQ(&a, fired_timer[0], "a first");
+  EXPECT_EQ(&b, fired_timer[1], "b second");
+  EXPECT_EQ(&c, fired_timer[2], "c last");
+  EXPECT_GE(fired_at[0], base + 100, "a not early");
+  EXPECT_GE(fired_at[1], base + 20000, "b not early");
+  EXPECT_GE(fired_at[2], base + 5000000, "c not early");
+  EXPECT_LT(fired_at[2], base + 5000000 + (1 << TIMER_WHEEL_SHIFT0), "c within one level 0 granule");
+  EXPECT_GT(wheel.cascaded, 0ULL, "c was re-filed on the way down");
+
+  END_TEST;
+}
+
+static bool test_wheel_cancel(void) {
+  BEGIN_TEST;
+
+  struct ppc64_timer a = PPC64_TIMER_INITIAL_VALUE;
+  struct ppc64_timer b = PPC64_TIMER_INITIAL_VALUE;
+
+  timer_wheel_init(&wheel, 0);
+  reset_fired();
+  timer_wheel_add(&wheel, &a, 1000, 0, record_fire, NULL);
+  timer_wheel_add(&wheel, &b, 1000, 0, record_fire, NULL);
+  EXPECT_TRUE(timer_wheel_cancel(&a), "a was pending");
+  EXPECT_FALSE(timer_wheel_cancel(&a), "a is gone");
+
+  timer_wheel_run(&wheel, 2000);
+  EXPECT_EQ(1U, fired_count, "only b fired");
+  EXPECT_EQ(&b, fired_timer[0], "b fired");
+  EXPECT_FALSE(timer_wheel_cancel(&b), "b is no longer pending");
+
+  uint64_t deadline;
+  EXPECT_FALSE(timer_wheel_next(&wheel, &deadline), "wheel is empty");
+
+  // re-arming moves the timer rather than queueing it twice
+  timer_wheel_add(&wheel, &a, 5000, 0, record_fire, NULL);
+  timer_wheel_add(&wheel, &a, 3000, 0, record_fire, NULL);
+  timer_wheel_run(&wheel, 4000);
+  EXPECT_EQ(2U, fired_count, "a fired at its new deadline");
+  timer_wheel_run(&wheel, 10000);
+  EXPECT_EQ(2U, fired_count, "and only once");
+
+  END_TEST;
+}
+
+static bool test_wheel_slack(void) {
+  BEGIN_TEST;
+
+  struct ppc64_timer t[4];
+  const uint64_t expires[4] = { 100000, 100300, 100700, 101000 };
+
+  timer_wheel_init(&wheel, 0);
+  reset_fired();
+  for (uint i = 0; i < 4; i++) {
+    t[i] = (struct ppc64_timer)PPC64_TIMER_INITIAL_VALUE;
+    timer_wheel_add(&wheel, &t[i], expires[i], 3000, record_fire, NULL);
+  }
+
+  // every window contains 0x19000, the most aligned instant in each, so all four share that deadline
+  uint64_t deadline;
+  EXPECT_TRUE(timer_wheel_next(&wheel, &deadline), "wheel has work");
+  uint runs = 0;
+  while (timer_wheel_next(&wheel, &deadline) && runs++ < 64) {
+    timer_wheel_run(&wheel, deadline);
+    if (fired_count) break;
+  }
+  EXPECT_EQ(4U, fired_count, "one interrupt fires all four");
+  EXPECT_GE(fired_at[0], expires[3], "none fired early");
+  EXPECT_LE(fired_at[0], expires[0] + 3000, "within the slack");
+
+  END_TEST;
+}
+
+static bool test_wheel_far_future(void) {
+  BEGIN_TEST;
+
+  struct ppc64_timer a = PPC64_TIMER_INITIAL_VALUE;
+  const uint64_t far = 1ULL << 40;
+
+  timer_wheel_init(&wheel, 0);
+  reset_fired();
+  timer_wheel_add(&wheel, &a, far, 0, record_fire, NULL);
+
+  uint64_t deadline;
+  uint steps = 0;
+  while (timer_wheel_next(&wheel, &deadline) && steps++ < 1000) {
+    timer_wheel_run(&wheel, deadline);
+  }
+  EXPECT_EQ(1U, fired_count, "fired");
+  EXPECT_GE(fired_at[0], far, "not early");
+
+  END_TEST;
+}
+
+// on local scales, the kernel's own are in use by every timer while this runs
+static bool test_tb_scale(void) {
+  BEGIN_TEST;
+
+  const uint64_t freqs[] = { 50000000, 512000000, 33333333 };
+  const uint64_t samples[] = { 0, 1, 49, 50, 999999, 123456789, 1ULL << 40, 0x0123456789abcdefULL };
+
+  for (uint f = 0; f < countof(freqs); f++) {
+    struct tb_scale to_us = tb_scale_make(1000000, freqs[f]);
+    struct tb_scale to_ms = tb_scale_make(1000, freqs[f]);
+    struct tb_scale us_to_tb = tb_scale_make(freqs[f], 1000000);
+    for (uint i = 0; i < countof(samples); i++) {
+      uint64_t t = samples[i];
+      // the binary fraction may round down by at most one unit
+      uint64_t us = (uint64_t)((unsigned __int128)t * 1000000 / freqs[f]);
+      uint64_t got = tb_scale_apply(&to_us, t);
+      EXPECT_TRUE(got == us || got + 1 == us, "ticks to us");
+      uint64_t ms = (uint64_t)((unsigned __int128)t * 1000 / freqs[f]);
+      got = tb_scale_apply(&to_ms, t);
+      EXPECT_TRUE(got == ms || got + 1 == ms, "ticks to ms");
+    }
+    EXPECT_EQ(freqs[f] / 1000, tb_scale_apply(&us_to_tb, 1000), "ms to ticks");
+  }
+
+  END_TEST;
+}
+
+static volatile uint lk_timer_hits;
+
+static enum handler_return lk_timer_cb(struct timer *t, lk_time_t now, void *arg) {
+  lk_timer_hits++;
+  return INT_NO_RESCHEDULE;
+}
+
+static bool test_lk_timers(void) {
+  BEGIN_TEST;
+
+  lk_time_t start = current_time();
+  thread_sleep(20);
+  EXPECT_GE(current_time() - start, 20U, "thread_sleep slept");
+
+  timer_t timers[8];
+  lk_timer_hits = 0;
+  for (uint i = 0; i < countof(timers); i++) {
+    timer_initialize(&timers[i]);
+    timer_set_oneshot(&timers[i], 5 + i, lk_timer_cb, NULL);
+  }
+  thread_sleep(50);
+  EXPECT_EQ(countof(timers), lk_timer_hits, "every timer fired");
+
+  END_TEST;
+}
+
+BEGIN_TEST_CASE(ppc_timer_wheel)
+RUN_TEST(test_wheel_order);
+RUN_TEST(test_wheel_cancel);
+RUN_TEST(test_wheel_slack);
+RUN_TEST(test_wheel_far_future);
+RUN_TEST(test_tb_scale);
+RUN_TEST(test_lk_timers);
+END_TEST_CASE(ppc_timer_wheel)
@@ -4,11 +4,25 @@ MODULE := $(LOCAL_DIR)
 
 MODULE_SRCS := \
 	$(LOCAL_DIR)/ppc_alu_tests.c \
+	$(LOCAL_DIR)/ppc_cache_tests.c \
 	$(LOCAL_DIR)/ppc_cmp_tests.c \
+	$(LOCAL_DIR)/ppc_fpu_tests.c \
+	$(LOCAL_DIR)/ppc_insnbench_tests.c \
 	$(LOCAL_DIR)/ppc_logical_tests.c \
+	$(LOCAL_DIR)/ppc_mmu_tests.c \
+	$(LOCAL_DIR)/ppc_profile_tests.c \
 	$(LOCAL_DIR)/ppc_rotate_tests.c \
 	$(LOCAL_DIR)/ppc_shift_tests.c \
+	$(LOCAL_DIR)/ppc_spinlock_tests.c \
+	$(LOCAL_DIR)/ppc_string_tests.c \
+	$(LOCAL_DIR)/ppc_timer_wheel_tests.c \
 
-MODULES += lib/unittest
+# the retiler and the smc protocol are part of the xenon platform
+ifeq ($(PLATFORM),xenon)
+MODULE_SRCS += $(LOCAL_DIR)/ppc_retile_tests.c
+MODULE_SRCS += $(LOCAL_DIR)/ppc_smc_tests.c
+endif
+
+MODULES += app/ppcbench lib/unittest
 
 include make/module.mk